@@ -7,8 +7,8 @@ namespace Diana {
 // ============================================================================
 // WORLD
 // - really 'diana' but world is a better name
-World::World(void *(*malloc)(size_t), void (*free)(void *)) {
-	allocate_diana(malloc, free, &diana);
+World::World(void *(*_malloc)(size_t), void (*_free)(void *)) {
+	allocate_diana(_malloc, _free, &diana);
 }
 
 void World::registerSystem(System *system) {
@@ -33,6 +33,18 @@ Entity World::spawn() {
 	return Entity(this, eid);
 }
 
+unsigned int World::createPrefab(Entity &entity) {
+	unsigned int pid;
+	diana_createPrefab(diana, entity.getId(), &pid);
+	return pid;
+}
+
+Entity World::instantiate(unsigned int prefab) {
+	unsigned int eid;
+	diana_instantiate(diana, prefab, &eid);
+	return Entity(this, eid);
+}
+
 // ============================================================================
 // ENTITY
 void Entity::add() {
@@ -20,7 +20,7 @@ class Manager;
 
 class World {
 public:
-	World(void *(*malloc)(size_t) = malloc, void (*free)(void *) = free);
+	World(void *(*_malloc)(size_t) = ::malloc, void (*_free)(void *) = ::free);
 
 	template<class T>
 	unsigned int registerComponent() {
@@ -47,6 +47,9 @@ public:
 
 	Entity spawn();
 
+	unsigned int createPrefab(Entity &entity);
+	Entity instantiate(unsigned int prefab);
+
 	void process(float delta);
 
 	struct diana *getDiana() { return diana; }
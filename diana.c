@@ -66,16 +66,14 @@ struct _sparseIntegerSet {
 	unsigned int capacity;
 };
 
-/* UNUSED
 static int _sparseIntegerSet_contains(struct diana *diana, struct _sparseIntegerSet *is, unsigned int i) {
+	unsigned int a;
 	if(i >= is->capacity) {
 		return 0;
 	}
-	unsigned int a = is->sparse[i];
-	unsigned int n = is->population;
-	return a < n && is->dense[a] == i;
+	a = is->sparse[i];
+	return a < is->population && is->dense[a] == i;
 }
-*/
 
 static int _sparseIntegerSet_insert(struct diana *diana, struct _sparseIntegerSet *is, unsigned int i) {
 	if(i >= is->capacity) {
@@ -101,10 +99,10 @@ static int _sparseIntegerSet_delete(struct diana *diana, struct _sparseIntegerSe
 	}
 	unsigned int a = is->sparse[i];
 	unsigned int n = is->population - 1;
-	if(a <= n || is->dense[a] == i) {
+	if(a <= n && is->dense[a] == i) {
 		unsigned int e = is->dense[n];
 		is->population = n;
-		is->dense[n] = e;
+		is->dense[a] = e;
 		is->sparse[e] = a;
 		return 1;
 	}
@@ -132,6 +130,37 @@ static void _sparseIntegerSet_free(struct diana *diana, struct _sparseIntegerSet
 	memset(is, 0, sizeof(*is));
 }
 
+// renumber every element through 'remap', dropping the ones mapped to
+// UINT_MAX, and resize to 'capacity'
+static int _sparseIntegerSet_remap(struct diana *diana, struct _sparseIntegerSet *is, const unsigned int *remap, unsigned int n, unsigned int capacity) {
+	unsigned int i, population = 0;
+	int err;
+
+	for(i = 0; i < is->population; i++) {
+		unsigned int e = is->dense[i] < n ? remap[is->dense[i]] : UINT_MAX;
+		if(e != UINT_MAX) {
+			is->dense[population++] = e;
+		}
+	}
+	is->population = population;
+
+	err = _realloc(diana, is->dense, is->capacity * sizeof(unsigned int), capacity * sizeof(unsigned int), (void **)&is->dense);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+	err = _realloc(diana, is->sparse, is->capacity * sizeof(unsigned int), capacity * sizeof(unsigned int), (void **)&is->sparse);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+	is->capacity = capacity;
+
+	for(i = 0; i < population; i++) {
+		is->sparse[is->dense[i]] = i;
+	}
+
+	return DL_ERROR_NONE;
+}
+
 // ============================================================================
 // DENSE INTEGER SET
 // - more memory effecient
@@ -160,11 +189,9 @@ struct _denseIntegerSet {
 	unsigned int capacity;
 };
 
-/* UNUSED
 static int _denseIntegerSet_contains(struct diana *diana, struct _denseIntegerSet *is, unsigned int i) {
 	return i < is->capacity && _bits_isSet(is->bytes, i);
 }
-*/
 
 static unsigned int _denseIntegerSet_insert(struct diana *diana, struct _denseIntegerSet *is, unsigned int i) {
 	if(i >= is->capacity) {
@@ -182,11 +209,13 @@ static unsigned int _denseIntegerSet_delete(struct diana *diana, struct _denseIn
 	return 0;
 }
 
-/* UNUSED
 static void _denseIntegerSet_clear(struct diana *diana, struct _denseIntegerSet *is) {
-	memset(is->bytes, 0, (is->capacity + 7) >> 3);
+	if(is->bytes != NULL) {
+		memset(is->bytes, 0, (is->capacity + 7) >> 3);
+	}
 }
 
+/* UNUSED
 static int _denseIntegerSet_isEmpty(struct diana *diana, struct _denseIntegerSet *is) {
 	unsigned int n = (is->capacity + 7) >> 3, i = 0;
 	for(; i < n; i++) {
@@ -203,6 +232,27 @@ static void _denseIntegerSet_free(struct diana *diana, struct _denseIntegerSet *
 	memset(is, 0, sizeof(*is));
 }
 
+// renumber the set in place through 'remap', which must never move an
+// element up, and resize to 'capacity'
+static int _denseIntegerSet_remap(struct diana *diana, struct _denseIntegerSet *is, const unsigned int *remap, unsigned int n, unsigned int capacity) {
+	unsigned int i, end = is->capacity < n ? is->capacity : n;
+	int err;
+
+	for(i = 0; i < end; i++) {
+		if(_bits_clear(is->bytes, i) && remap[i] != UINT_MAX) {
+			_bits_set(is->bytes, remap[i]);
+		}
+	}
+
+	err = _realloc(diana, is->bytes, (is->capacity + 7) >> 3, (capacity + 7) >> 3, (void **)&is->bytes);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+	is->capacity = capacity;
+
+	return DL_ERROR_NONE;
+}
+
 // ============================================================================
 // PRIMARY DATA
 struct _componentBag {
@@ -210,6 +260,28 @@ struct _componentBag {
 	unsigned int *indexes;
 };
 
+// indexed and multiple component data is kept in chunks of slots so bulk
+// allocation touches the allocator once per chunk and slot addresses stay
+// stable while the pool grows
+#define DL_POOL_CHUNK_SHIFT 6
+#define DL_POOL_CHUNK_SIZE  (1 << DL_POOL_CHUNK_SHIFT)
+
+struct _change {
+	unsigned int entity;
+	unsigned long long tick;
+};
+
+// entities that got or lost a component, kept until every subscriber drained
+// them. positions are counted from the first entry ever queued, 'base' is how
+// many were dropped from the front
+struct _eventQueue {
+	int subscribed;
+	unsigned int *entities;
+	unsigned int count;
+	unsigned int capacity;
+	unsigned int base;
+};
+
 struct _component {
 	const char *name;
 	size_t size;
@@ -217,6 +289,7 @@ struct _component {
 	unsigned int flags;
 
 	void **data;
+	unsigned int numDataChunks;
 	struct _sparseIntegerSet freeDataIndexes;
 	unsigned int nextDataIndex;
 
@@ -224,24 +297,60 @@ struct _component {
 	void (*compute)(struct diana *, void *, unsigned int entity, unsigned int index, void *);
 	void *userData;
 
-	struct _sparseIntegerSet componentsToDirty;
+	// per entity, the first edge to what was computed from this component
+	unsigned int *dependents;
+	unsigned int dependentsCapacity;
+
+	// dirty instances, a bit per entity and a list of the entities that got
+	// it set. clearing only drops the bit, the list is cleaned up on demand
+	struct _denseIntegerSet dirty;
+	unsigned int *dirtyList;
+	unsigned int dirtyCount;
+	unsigned int dirtyCapacity;
+
+	// eager components are recomputed in a batch during diana_process
+	int eager;
 #endif
+
+	// when a system watches this component for changes, the tick each entity
+	// last changed it at and a log of the changes in tick order
+	int tracked;
+	unsigned long long *changeTicks;
+	unsigned int changeTicksCapacity;
+	struct _change *changeLog;
+	unsigned int changeLogCount;
+	unsigned int changeLogCapacity;
+
+	// indexed by DL_COMPONENT_EVENT_ADDED and DL_COMPONENT_EVENT_REMOVED
+	struct _eventQueue events[3];
 };
 
 static void _component_free(struct diana *diana, struct _component *component) {
 	unsigned int i = 0;
 	_free(diana, (void *)component->name);
-	for(i = 0; i < component->nextDataIndex; i++) {
+	for(i = 0; i < component->numDataChunks; i++) {
 		_free(diana, component->data[i]);
 	}
 	_free(diana, component->data);
 	_sparseIntegerSet_free(diana, &component->freeDataIndexes);
 #if DL_COMPUTE
-	_sparseIntegerSet_free(diana, &component->componentsToDirty);
+	_free(diana, component->dependents);
+	_denseIntegerSet_free(diana, &component->dirty);
+	_free(diana, component->dirtyList);
 #endif
+	_free(diana, component->changeTicks);
+	_free(diana, component->changeLog);
+	_free(diana, component->events[DL_COMPONENT_EVENT_ADDED].entities);
+	_free(diana, component->events[DL_COMPONENT_EVENT_REMOVED].entities);
 	memset(component, 0, sizeof(*component));
 }
 
+struct _eventSubscription {
+	unsigned int component;
+	unsigned int event;
+	unsigned int position;
+};
+
 struct _system {
 	const char *name;
 	unsigned int flags;
@@ -254,6 +363,29 @@ struct _system {
 	struct _sparseIntegerSet watch;
 	struct _sparseIntegerSet exclude;
 	struct _denseIntegerSet entities;
+
+	// components watched for changes, with those only entities changed since
+	// the tick of the last run are processed
+	struct _sparseIntegerSet changed;
+	unsigned long long lastRun;
+	unsigned int *changedEntities;
+	unsigned int changedEntitiesCapacity;
+
+	// component event queues and how far this system drained each
+	unsigned int num_eventSubscriptions;
+	struct _eventSubscription *eventSubscriptions;
+
+	// diana_process runs the system every 'rateFrames' frames, or once
+	// 'rateInterval' of delta built up, with the delta since its last run
+	unsigned int rateFrames;
+	unsigned int rateFrame;
+	float rateInterval;
+	float rateDelta;
+
+	// how long a run may take in profile clock units, 0 for as long as it
+	// needs, and the entity the next run starts at
+	unsigned long long budget;
+	unsigned int cursor;
 };
 
 static void _system_free(struct diana *diana, struct _system *system) {
@@ -261,6 +393,9 @@ static void _system_free(struct diana *diana, struct _system *system) {
 	_sparseIntegerSet_free(diana, &system->watch);
 	_sparseIntegerSet_free(diana, &system->exclude);
 	_denseIntegerSet_free(diana, &system->entities);
+	_sparseIntegerSet_free(diana, &system->changed);
+	_free(diana, system->changedEntities);
+	_free(diana, system->eventSubscriptions);
 	memset(system, 0, sizeof(*system));
 }
 
@@ -279,13 +414,216 @@ static void _manager_free(struct diana *diana, struct _manager *manager) {
 	memset(manager, 0, sizeof(*manager));
 }
 
+// a captured entity row plus the data of every indexed and multiple instance
+// it held, stored back to back in component order
+struct _prefab {
+	int used;
+	unsigned char *row;
+	unsigned int *counts;
+	unsigned char *data;
+};
+
+static void _prefab_free(struct diana *diana, struct _prefab *prefab) {
+	_free(diana, prefab->row);
+	_free(diana, prefab->counts);
+	_free(diana, prefab->data);
+	memset(prefab, 0, sizeof(*prefab));
+}
+
 #if DL_COMPUTE
 struct _computingComponentStack {
 	struct _computingComponentStack *previous;
+	unsigned int entity;
 	unsigned int component;
 };
+
+// an edge to an entity's component that was computed from another one,
+// chained per source
+struct _dependency {
+	unsigned int entity;
+	unsigned int component;
+	unsigned int next;
+};
 #endif
 
+// the last samples of one profile scope, see PROFILE. the fixed scopes
+// come first, then three per system, then one per manager
+#ifndef DL_PROFILE_WINDOW
+#define DL_PROFILE_WINDOW 128
+#endif
+
+#define DL_PROFILE_WINDOW_FRAME    0
+#define DL_PROFILE_WINDOW_SIGNAL   1
+#define DL_PROFILE_WINDOW_FIX_DATA 5
+#define DL_PROFILE_WINDOW_COMPUTE  6
+#define DL_PROFILE_WINDOW_GROW     7
+#define DL_PROFILE_WINDOW_TIMERS   8
+#define DL_PROFILE_WINDOW_SYSTEMS  9
+
+struct _profileWindow {
+	unsigned long long samples[DL_PROFILE_WINDOW];
+	unsigned int count;
+	unsigned int next;
+};
+
+// where each counter lives, see COUNTERS
+#define DL_COUNTER_SLOT_SPAWNS     0
+#define DL_COUNTER_SLOT_CLONES     1
+#define DL_COUNTER_SLOT_DELETES    2
+#define DL_COUNTER_SLOT_SIGNALS    3
+#define DL_COUNTER_SLOT_GROWS      7
+#define DL_COUNTER_SLOT_GROW_BYTES 8
+#define DL_COUNTER_SLOT_TIMERS     9
+#define DL_COUNTER_SLOT_SYSTEMS    10
+
+// the calls a recording holds, see RECORD
+#define DL_RECORD_MAGIC   0x43455244
+#define DL_RECORD_VERSION 1
+
+#define DL_RECORD_SPAWN          0
+#define DL_RECORD_CLONE          1
+#define DL_RECORD_SIGNAL         2
+#define DL_RECORD_SET            3
+#define DL_RECORD_GET            4
+#define DL_RECORD_REMOVE         5
+#define DL_RECORD_APPEND         6
+#define DL_RECORD_REMOVE_ALL     7
+#define DL_RECORD_MARK_CHANGED   8
+#define DL_RECORD_CREATE_PREFAB  9
+#define DL_RECORD_INSTANTIATE    10
+#define DL_RECORD_INSTANTIATE_N  11
+#define DL_RECORD_FREE_PREFAB    12
+#define DL_RECORD_PROCESS        13
+#define DL_RECORD_PROCESS_SYSTEM 14
+#define DL_RECORD_CLEAR          15
+#define DL_RECORD_COMPACT        16
+#define DL_RECORD_REWIND         17
+#define DL_RECORD_FORK           18
+#define DL_RECORD_DISCARD_FORK   19
+#define DL_RECORD_KEEP_FORK      20
+#define DL_RECORD_SCHEDULE_TIMER 21
+#define DL_RECORD_CANCEL_TIMER   22
+#define DL_RECORD_SET_PARENT     23
+#define DL_RECORD_REMOVE_PARENT  24
+#define DL_RECORD_OPS            25
+
+// set on the op of calls made while diana_process runs
+#define DL_RECORD_PROCESSING 0x80
+
+// a scheduled timer, in its wheel slot's list and its entity's list, see
+// TIMERS. timers are numbered from 1, 0 ends a list. a timer id has the
+// number in its low DL_TIMER_INDEX_BITS bits and the generation above them
+#define DL_TIMER_SLOT_BITS  6
+#define DL_TIMER_SLOTS      (1 << DL_TIMER_SLOT_BITS)
+#define DL_TIMER_LEVELS     4
+#define DL_TIMER_INDEX_BITS 20
+#define DL_TIMER_INDEX_MASK ((1u << DL_TIMER_INDEX_BITS) - 1)
+
+struct _timer {
+	unsigned int generation;
+	unsigned int entity;
+	unsigned int payload;
+	unsigned long long due;
+	unsigned int slot;
+	unsigned int next;
+	unsigned int prev;
+	unsigned int entityNext;
+	unsigned int entityPrev;
+};
+
+// a uniform grid of enabled entities by a position in an inline component,
+// see SPATIAL. cells hash into buckets, a bucket can hold more than one cell
+// and each entity's bucket, next and previous are kept with the entity, +1 so
+// 0 is none
+struct _spatialEntry {
+	unsigned int bucket;
+	unsigned int next;
+	unsigned int prev;
+};
+
+struct _spatial {
+	unsigned int component;
+	unsigned int dimensions;
+	size_t offsets[3];
+	float cellSize;
+	float inverseCellSize;
+	unsigned int *buckets;
+	unsigned int *stamps;
+	unsigned int num_buckets;
+	unsigned int stamp;
+	unsigned int count;
+	struct _spatialEntry *entries;
+	unsigned int entriesCapacity;
+	unsigned int *results;
+	unsigned int resultsCapacity;
+};
+
+// entities by the bytes at 'offset' in a component, see KEYS. laid out as
+// the spatial index is, with buckets by the hash of the key
+struct _keyIndex {
+	unsigned int component;
+	size_t offset;
+	size_t size;
+	unsigned int flags;
+	unsigned int *buckets;
+	unsigned int num_buckets;
+	unsigned int count;
+	struct _spatialEntry *entries;
+	unsigned int entriesCapacity;
+	unsigned int *results;
+	unsigned int resultsCapacity;
+};
+
+// an entity's place in the hierarchy, see HIERARCHY. entities are +1 so 0
+// is none, children are in the order they were given their parent
+struct _relation {
+	unsigned int parent;
+	unsigned int firstChild;
+	unsigned int lastChild;
+	unsigned int next;
+	unsigned int prev;
+};
+
+// a timer, a wheel slot's list head, an entity's timer list head or an
+// entity's links as they were before they changed, see UNDO
+#define DL_UNDO_TIMER         0
+#define DL_UNDO_WHEEL         1
+#define DL_UNDO_ENTITY_TIMERS 2
+#define DL_UNDO_RELATION      3
+
+struct _undoWrite {
+	unsigned int kind;
+	unsigned int index;
+	union {
+		struct _timer timer;
+		struct _relation relation;
+		unsigned int head;
+	} old;
+};
+
+// what it takes to put the world back to where the log started, see UNDO
+struct _undoLog {
+	unsigned char *data;
+	size_t size;
+	size_t capacity;
+	unsigned int nextEntityId;
+	struct _undoWrite *writes;
+	unsigned int num_writes;
+	unsigned int writesCapacity;
+	unsigned long long timerNow;
+	float timerDelta;
+	unsigned int nextTimer;
+	unsigned int freeTimers;
+};
+
+// the entities already in an undo log
+struct _undoCaptures {
+	struct _denseIntegerSet set;
+	unsigned int *list;
+	unsigned int count;
+	unsigned int capacity;
+};
+
 struct diana {
 	void *(*malloc)(size_t);
 	void (*free)(void *);
@@ -295,9 +633,21 @@ struct diana {
 
 	// manage the entity ids
 	// reuse deleted entity ids
+	// with DL_ENTITY_RECYCLE_LOWEST the ids are also kept as bits, scanned
+	// from the lowest one that might be free
+	unsigned int entityRecycling;
 	struct _sparseIntegerSet freeEntityIds;
+	struct _denseIntegerSet freeEntityBits;
+	unsigned int freeEntityHint;
 	unsigned int nextEntityId;
 
+	// generation of each entity id, bumped when the id is freed so stale
+	// handles can be told apart. slots that appear later start above every
+	// generation handed out so far
+	unsigned int *generations;
+	unsigned int generationsCapacity;
+	unsigned int maxGeneration;
+
 	// entity data
 	// first 'column' is bits of components defined
 	// the rest are the components
@@ -306,6 +656,10 @@ struct diana {
 	unsigned int dataHeightCapacity;
 	void *data;
 
+	// rows from dataHeight up to this still hold what diana_clear left
+	// behind, they are cleaned as they come back into use
+	unsigned int staleHeight;
+
 	unsigned int processingDataHeight;
 	void **processingData;
 
@@ -318,6 +672,10 @@ struct diana {
 	// all active entities (added and enabled)
 	struct _denseIntegerSet active;
 
+	// bumped after every system run, changes are stamped with it. 64 bits so
+	// it never wraps, 0 stays the tick of never changed
+	unsigned long long changeTick;
+
 	unsigned int num_components;
 	struct _component *components;
 
@@ -327,14 +685,130 @@ struct diana {
 	unsigned int num_managers;
 	struct _manager *managers;
 
+	unsigned int num_prefabs;
+	struct _prefab *prefabs;
+	struct _sparseIntegerSet freePrefabIds;
+
+	// entities changed since the last snapshot, once there was one. a bit
+	// per entity and the list of the ones that got it set
+	int tracking;
+	struct _denseIntegerSet touched;
+	unsigned int *touchedList;
+	unsigned int touchedCount;
+	unsigned int touchedCapacity;
+
+	// the last frames, as undo logs, when rolling back is on
+	unsigned int rollbackFrames;
+	struct _undoLog *rollback;
+	unsigned int rollbackFrame;
+	unsigned int rollbackCount;
+	struct _undoCaptures rollbackCaptures;
+
+	// the speculative branch started by diana_fork
+	int forked;
+	int forkErr;
+	struct _undoLog fork;
+	struct _undoCaptures forkCaptures;
+
+	// set while an undo log is being applied, nothing is captured then
+	int undoing;
+
+	// profile windows while profiling, and each manager's time this frame
+	unsigned long long (*profileClock)(void *);
+	void *profileUserData;
+	struct _profileWindow *profile;
+	unsigned long long *profileManagers;
+
+	// the trace being recorded, with each manager's time in the current signal
+	// pass and the events not written yet
+	unsigned int traceFrames;
+	int (*traceWrite)(void *, const void *, size_t);
+	void *traceUserData;
+	unsigned long long traceOrigin;
+	unsigned long long *traceManagers;
+	unsigned int traceEvents;
+	char *traceData;
+	size_t traceSize;
+	size_t traceCapacity;
+	int traceErr;
+
+	// every counter since initializing, where they stood at the end of the
+	// last frame and how much the last frame added, see COUNTERS
+	unsigned long long *counters;
+	unsigned long long *countersMark;
+	unsigned long long *countersFrame;
+	unsigned int num_counters;
+
+	// the journal diana_process commits to, and the record being put together
+	int (*journalWrite)(void *, const void *, size_t);
+	void *journalUserData;
+	unsigned char *journalData;
+	size_t journalSize;
+	size_t journalCapacity;
+
+	// the timer wheel: a list head per slot of each level, the timers and the
+	// first timer of each entity. free timers are chained through 'next'
+	void (*timerFired)(struct diana *, void *, unsigned int entity, unsigned int payload);
+	void *timerUserData;
+	float timerInterval;
+	float timerDelta;
+	unsigned long long timerNow;
+	unsigned int *timerWheel;
+	struct _timer *timers;
+	unsigned int timersCapacity;
+	unsigned int nextTimer;
+	unsigned int freeTimers;
+	unsigned int *entityTimers;
+	unsigned int entityTimersCapacity;
+
+	struct _spatial *spatials;
+	unsigned int num_spatials;
+
+	struct _keyIndex *keyIndexes;
+	unsigned int num_keyIndexes;
+
+	// the hierarchy, and the entities in it breadth first with where their
+	// parents are, made again when asked for after a change
+	struct _relation *relations;
+	unsigned int relationsCapacity;
+	unsigned int *hierarchyOrder;
+	unsigned int *hierarchyParents;
+	unsigned int hierarchyCapacity;
+	unsigned int hierarchyCount;
+	int hierarchyDirty;
+	unsigned int *children;
+	unsigned int childrenCapacity;
+
+	// the recording diana_record writes to, and the calls made since the last
+	// write
+	int (*recordWrite)(void *, const void *, size_t);
+	void *recordUserData;
+	unsigned char *recordData;
+	size_t recordSize;
+	size_t recordCapacity;
+	int recordErr;
+
+	// an image from diana_loadImage the world points into, see _free
+	unsigned char *image;
+	size_t imageSize;
+
 #if DL_COMPUTE
 	struct _computingComponentStack *computingComponentStack;
+
+	struct _dependency *dependencies;
+	unsigned int dependenciesCapacity;
+	unsigned int nextDependency;
+	struct _sparseIntegerSet freeDependencies;
+
+	// work list while invalidating
+	struct _dependency *invalidating;
+	unsigned int invalidatingCapacity;
 #endif
 };
 
 // ============================================================================
 // UTILITY
-#define FOREACH_SPARSEINTSET(I, N, S) for(N = 0, I = (S)->dense ? (S)->dense[N] : 0; N < (S)->population; N++, I = (S)->dense[N])
+#define FOREACH_SPARSEINTSET(I, N, S) for(N = 0; N < (S)->population && ((I = (S)->dense[N]), 1); N++)
 #define FOREACH_DENSEINTSET(I, D) for(I = 0; I < (D)->capacity; I++) if(_bits_isSet((D)->bytes, I))
 #define FOREACH_ARRAY(T, N, A, S) for(N = 0, T = A; N < S; N++, T++)
 
@@ -348,7 +822,8 @@ static int _malloc(struct diana *diana, size_t size, void ** r) {
 }
 
 static int _free(struct diana *diana, void *ptr) {
-	if(ptr != NULL) {
+	// memory inside a loaded image belongs to the caller
+	if(ptr != NULL && !((unsigned char *)ptr >= diana->image && (unsigned char *)ptr < diana->image + diana->imageSize)) {
 		diana->free(ptr);
 	}
 	return DL_ERROR_NONE;
@@ -369,25 +844,30 @@ static int _strdup(struct diana *diana, const char *s, char ** r) {
 }
 
 static int _realloc(struct diana *diana, void *ptr, size_t oldSize, size_t newSize, void ** r) {
+	void *p;
+
 	if(oldSize == newSize) {
 		*r = ptr;
 		return DL_ERROR_NONE;
 	}
 	if(newSize == 0) {
 		_free(diana, ptr);
+		*r = NULL;
 		return DL_ERROR_NONE;
 	}
-	*r = diana->malloc(newSize);
-	if(*r == NULL) {
+	// the old block stays put when the new one can not be had
+	p = diana->malloc(newSize);
+	if(p == NULL) {
 		return DL_ERROR_OUT_OF_MEMORY;
 	}
 	if(oldSize < newSize) {
-		memset((unsigned char *)(*r) + oldSize, 0, newSize - oldSize);
+		memset((unsigned char *)p + oldSize, 0, newSize - oldSize);
 	}
 	if(ptr != NULL) {
-		memcpy(*r, ptr, oldSize < newSize ? oldSize : newSize);
-		diana->free(ptr);
+		memcpy(p, ptr, oldSize < newSize ? oldSize : newSize);
+		_free(diana, ptr);
 	}
+	*r = p;
 	return DL_ERROR_NONE;
 }
 
@@ -399,35 +879,122 @@ int allocate_diana(void *(*malloc)(size_t), void (*free)(void *), struct diana *
 	memset(*r, 0, sizeof(**r));
 	(*r)->malloc = malloc;
 	(*r)->free = free;
+	(*r)->changeTick = 1;
 	return DL_ERROR_NONE;
 }
 
 static int _fixData(struct diana *diana);
+static void _capture(struct diana *diana, unsigned int entity);
+static int _rollback_begin(struct diana *diana);
+static void _undo_reset(struct diana *diana);
+static void _undo_free(struct diana *diana);
+static void _stripEntity(struct diana *diana, unsigned int entity);
+static int _journal_commit(struct diana *diana);
+static void _timers_cancelEntity(struct diana *diana, unsigned int entity);
+static void _timers_advance(struct diana *diana, float delta);
+static void _timers_clear(struct diana *diana);
+static void _timers_remap(struct diana *diana, const unsigned int *remap, unsigned int n);
+static int _spatial_changed(struct diana *diana, unsigned int entity, unsigned int component);
+static int _spatial_sync(struct diana *diana, unsigned int entity);
+static void _spatial_remove(struct diana *diana, unsigned int entity);
+static void _spatial_clear(struct diana *diana);
+static void _spatial_remap(struct diana *diana, const unsigned int *remap, unsigned int n);
+static int _keys_taken(struct diana *diana, unsigned int entity, unsigned int component, const void *data);
+static int _keys_changed(struct diana *diana, unsigned int entity, unsigned int component);
+static void _keys_remove(struct diana *diana, unsigned int entity);
+static void _keys_clear(struct diana *diana);
+static void _keys_remap(struct diana *diana, const unsigned int *remap, unsigned int n);
+static void _hierarchy_signalDeleted(struct diana *diana, unsigned int entity);
+static void _hierarchy_deleted(struct diana *diana, unsigned int entity);
+static void _hierarchy_detach(struct diana *diana, unsigned int entity);
+static void _hierarchy_clear(struct diana *diana);
+static void _hierarchy_remap(struct diana *diana, const unsigned int *remap, unsigned int n);
+static void _record_call(struct diana *diana, unsigned int op, unsigned int count, unsigned int a, unsigned int b, unsigned int c);
+static void _record_uint(struct diana *diana, unsigned int i);
+static void _record_data(struct diana *diana, unsigned int component, const void *data);
+static void _record_float(struct diana *diana, float f);
+static int _record_flush(struct diana *diana);
+static int _record_stop(struct diana *diana);
+static void _count(struct diana *diana, unsigned int counter, unsigned long long n);
+static unsigned int _systemCounter(struct diana *diana, struct _system *system, unsigned int which);
+static unsigned int _componentCounter(struct diana *diana, struct _component *c, unsigned int which);
+static void _countGrowth(struct diana *diana, size_t bytes);
+static void _counters_endFrame(struct diana *diana);
+static unsigned long long _profile_clock(struct diana *diana);
+static void _profile_record(struct diana *diana, unsigned int window, unsigned long long *start);
+static void _profile_manager(struct diana *diana, unsigned int manager, unsigned long long start);
+static int _profile_endFrame(struct diana *diana);
+static void _freeBags(struct diana *diana);
+static void _cleanRows(struct diana *diana, unsigned int begin, unsigned int end);
+static void _cleanStaleRows(struct diana *diana);
+static int _removeAllComponents(struct diana *diana, unsigned int entity);
+static void _runSystem(struct diana *diana, struct _system *system, float delta);
+static void _trimChangeLogs(struct diana *diana);
+static void _changes_clear(struct diana *diana);
+static int _changes_remap(struct diana *diana, const unsigned int *remap, unsigned int n);
+static void _trimEventQueues(struct diana *diana);
+static void _events_clear(struct diana *diana);
+static void _events_remap(struct diana *diana, const unsigned int *remap, unsigned int n);
+#if DL_COMPUTE
+static void _recomputeEager(struct diana *diana);
+static void _dependencies_clear(struct diana *diana);
+static int _dependencies_remap(struct diana *diana, const unsigned int *remap, unsigned int n, unsigned int live);
+#endif
 
 int diana_free(struct diana *diana) {
 	struct _component *component;
 	struct _system *system;
 	struct _manager *manager;
-	unsigned int i, j;
+	struct _prefab *prefab;
+	unsigned int i;
 
 	int err = _fixData(diana);
 	if(err != DL_ERROR_NONE) {
 		return err;
 	}
 
-	for(i = 0; i < diana->nextEntityId; i++) {
-		for(j = 0; j < diana->num_components; j++) {
-			diana_removeComponents(diana, i, j);
-		}
-	}
+	// pools are released whole below, so only bags need looking at
+	_freeBags(diana);
 
 	_free(diana, diana->data);
 	_sparseIntegerSet_free(diana, &diana->freeEntityIds);
+	_denseIntegerSet_free(diana, &diana->freeEntityBits);
+	_free(diana, diana->generations);
 	_sparseIntegerSet_free(diana, &diana->added);
 	_sparseIntegerSet_free(diana, &diana->enabled);
 	_sparseIntegerSet_free(diana, &diana->disabled);
 	_sparseIntegerSet_free(diana, &diana->deleted);
 	_denseIntegerSet_free(diana, &diana->active);
+	_denseIntegerSet_free(diana, &diana->touched);
+	_free(diana, diana->touchedList);
+	_undo_free(diana);
+	_free(diana, diana->journalData);
+	_record_stop(diana);
+	_free(diana, diana->recordData);
+	_free(diana, diana->timerWheel);
+	_free(diana, diana->timers);
+	_free(diana, diana->entityTimers);
+	for(i = 0; i < diana->num_spatials; i++) {
+		_free(diana, diana->spatials[i].buckets);
+		_free(diana, diana->spatials[i].stamps);
+		_free(diana, diana->spatials[i].entries);
+		_free(diana, diana->spatials[i].results);
+	}
+	_free(diana, diana->spatials);
+	for(i = 0; i < diana->num_keyIndexes; i++) {
+		_free(diana, diana->keyIndexes[i].buckets);
+		_free(diana, diana->keyIndexes[i].entries);
+		_free(diana, diana->keyIndexes[i].results);
+	}
+	_free(diana, diana->keyIndexes);
+	_free(diana, diana->relations);
+	_free(diana, diana->hierarchyOrder);
+	_free(diana, diana->hierarchyParents);
+	_free(diana, diana->children);
+	_free(diana, diana->counters);
+	_free(diana, diana->profile);
+	_free(diana, diana->profileManagers);
+	_free(diana, diana->traceData);
 
 	FOREACH_ARRAY(component, i, diana->components, diana->num_components) {
 		_component_free(diana, component);
@@ -444,6 +1011,18 @@ int diana_free(struct diana *diana) {
 	}
 	_free(diana, diana->managers);
 
+	FOREACH_ARRAY(prefab, i, diana->prefabs, diana->num_prefabs) {
+		_prefab_free(diana, prefab);
+	}
+	_free(diana, diana->prefabs);
+	_sparseIntegerSet_free(diana, &diana->freePrefabIds);
+
+#if DL_COMPUTE
+	_free(diana, diana->dependencies);
+	_sparseIntegerSet_free(diana, &diana->freeDependencies);
+	_free(diana, diana->invalidating);
+#endif
+
 	diana->free(diana);
 
 	return DL_ERROR_NONE;
@@ -454,6 +1033,7 @@ int diana_free(struct diana *diana) {
 int diana_initialize(struct diana *diana) {
 	unsigned int extraBytes = (diana->num_components + 7) >> 3, n;
 	struct _component *c;
+	int err;
 
 	if(diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
@@ -465,8 +1045,52 @@ int diana_initialize(struct diana *diana) {
 
 	diana->dataWidth += extraBytes;
 
+	// counters are always on, the fixed ones then two per system and three
+	// per component
+	diana->num_counters = DL_COUNTER_SLOT_SYSTEMS + diana->num_systems * 2 + diana->num_components * 3;
+	err = _malloc(diana, sizeof(unsigned long long) * diana->num_counters * 3, (void **)&diana->counters);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+	diana->countersMark = diana->counters + diana->num_counters;
+	diana->countersFrame = diana->countersMark + diana->num_counters;
+
 	diana->initialized = 1;
 
+	if(diana->rollbackFrames) {
+		err = _malloc(diana, sizeof(struct _undoLog) * diana->rollbackFrames, (void **)&diana->rollback);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		return _rollback_begin(diana);
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// keep what is needed to go back 'frames' frames with diana_rewind, 0 turns
+// it off
+int diana_rollback(struct diana *diana, unsigned int frames) {
+	if(diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	diana->rollbackFrames = frames;
+
+	return DL_ERROR_NONE;
+}
+
+int diana_entityRecycling(struct diana *diana, unsigned int policy) {
+	if(diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(policy != DL_ENTITY_RECYCLE_LIFO && policy != DL_ENTITY_RECYCLE_LOWEST) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	diana->entityRecycling = policy;
+
 	return DL_ERROR_NONE;
 }
 
@@ -503,18 +1127,6 @@ int diana_createComponent(
 
 	diana->dataWidth += size;
 
-	if(flags & DL_COMPONENT_LIMITED_BIT) {
-		unsigned int count = (flags >> 3);
-		err = _malloc(diana, c.size * count, (void **)&c.data);
-		if(err != DL_ERROR_NONE) {
-			_free(diana, (void *)c.name);
-			return err;
-		}
-		while(count) {
-			_sparseIntegerSet_insert(diana, &c.freeDataIndexes, count--);
-		}
-	}
-
 	err = _realloc(diana, diana->components, sizeof(*diana->components) * diana->num_components, sizeof(*diana->components) * (diana->num_components + 1), (void **)&diana->components);
 	if(err != DL_ERROR_NONE) {
 		_free(diana, (void *)c.name);
@@ -539,14 +1151,21 @@ int diana_componentCompute(struct diana *diana, unsigned int component, void (*c
 
 	diana->components[component].compute = compute;
 	diana->components[component].userData = userData;
-	diana->dataWidth += sizeof(char);
 
-	// give this component room
-	while(component < diana->num_components) {
-		diana->components[component].offset += sizeof(char);
-		component++;
+	return DL_ERROR_NONE;
+}
+
+int diana_componentEager(struct diana *diana, unsigned int component) {
+	if(diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(component >= diana->num_components || diana->components[component].compute == NULL) {
+		return DL_ERROR_INVALID_VALUE;
 	}
 
+	diana->components[component].eager = 1;
+
 	return DL_ERROR_NONE;
 }
 #endif
@@ -633,6 +1252,122 @@ int diana_exclude(struct diana *diana, unsigned int system, unsigned int compone
 	return DL_ERROR_NONE;
 }
 
+// like diana_watch, but the system only processes entities that changed the
+// component since it last ran
+int diana_watchChanged(struct diana *diana, unsigned int system, unsigned int component) {
+	if(diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(system >= diana->num_systems) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_sparseIntegerSet_insert(diana, &diana->systems[system].watch, component);
+	_sparseIntegerSet_insert(diana, &diana->systems[system].changed, component);
+	diana->components[component].tracked = 1;
+
+	return DL_ERROR_NONE;
+}
+
+// queue the entities that get or lose 'component' for the system to drain,
+// 'events' is a mask of DL_COMPONENT_EVENT_*
+int diana_subscribeComponentEvents(struct diana *diana, unsigned int system, unsigned int component, unsigned int events) {
+	struct _system *s;
+	unsigned int event;
+
+	if(diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(system >= diana->num_systems) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(events == 0 || (events & ~(DL_COMPONENT_EVENT_ADDED | DL_COMPONENT_EVENT_REMOVED))) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	s = diana->systems + system;
+
+	for(event = DL_COMPONENT_EVENT_ADDED; event <= DL_COMPONENT_EVENT_REMOVED; event++) {
+		unsigned int i;
+		int err;
+
+		if(!(events & event)) {
+			continue;
+		}
+
+		for(i = 0; i < s->num_eventSubscriptions; i++) {
+			if(s->eventSubscriptions[i].component == component && s->eventSubscriptions[i].event == event) {
+				break;
+			}
+		}
+		if(i < s->num_eventSubscriptions) {
+			continue;
+		}
+
+		err = _realloc(diana, s->eventSubscriptions, sizeof(struct _eventSubscription) * s->num_eventSubscriptions, sizeof(struct _eventSubscription) * (s->num_eventSubscriptions + 1), (void **)&s->eventSubscriptions);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		s->eventSubscriptions[s->num_eventSubscriptions].component = component;
+		s->eventSubscriptions[s->num_eventSubscriptions].event = event;
+		s->eventSubscriptions[s->num_eventSubscriptions].position = 0;
+		s->num_eventSubscriptions++;
+
+		diana->components[component].events[event].subscribed = 1;
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// run the system every 'frames' frames, or once 'interval' of delta built up.
+// it is handed the delta since it last ran
+int diana_systemRate(struct diana *diana, unsigned int system, unsigned int frames, float interval) {
+	if(diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(system >= diana->num_systems) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(!(interval >= 0) || (frames > 1 && interval > 0)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	diana->systems[system].rateFrames = frames;
+	diana->systems[system].rateInterval = interval;
+
+	return DL_ERROR_NONE;
+}
+
+// stop a run of the system once it took 'budget' in units of the clock given
+// to diana_profile, the next run carries on with the entities after the last
+// one processed. 0 lifts the limit
+int diana_systemBudget(struct diana *diana, unsigned int system, unsigned long long budget) {
+	if(diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(system >= diana->num_systems) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	diana->systems[system].budget = budget;
+
+	return DL_ERROR_NONE;
+}
+
 // ============================================================================
 // manager
 int diana_createManager(
@@ -686,24 +1421,496 @@ static unsigned char *_getEntityData(struct diana *diana, unsigned int entity) {
 	return (void *)((unsigned char *)diana->data + (diana->dataWidth * entity));
 }
 
-static void _subscribe(struct diana *diana, struct _system *system, unsigned int entity) {
-	int included = _denseIntegerSet_insert(diana, &system->entities, entity);
-	if(!included && system->subscribed != NULL) {
-		system->subscribed(diana, system->userData, entity);
+// remember the entity for the next delta, and as it is now for rewinding
+static void _touch(struct diana *diana, unsigned int entity) {
+	_capture(diana, entity);
+
+	if(!diana->tracking || _denseIntegerSet_insert(diana, &diana->touched, entity)) {
+		return;
+	}
+
+	if(diana->touchedCount >= diana->touchedCapacity) {
+		unsigned int newCapacity = (diana->touchedCount + 1) * 1.5;
+		if(_realloc(diana, diana->touchedList, sizeof(unsigned int) * diana->touchedCapacity, sizeof(unsigned int) * newCapacity, (void **)&diana->touchedList) != DL_ERROR_NONE) {
+			// without the list the next delta can not be made, stop tracking
+			// until the next full snapshot
+			diana->tracking = 0;
+			return;
+		}
+		diana->touchedCapacity = newCapacity;
 	}
+	diana->touchedList[diana->touchedCount++] = entity;
 }
 
-static void _unsubscribe(struct diana *diana, struct _system *system, unsigned int entity) {
-	int included = _denseIntegerSet_delete(diana, &system->entities, entity);
-	if(included && system->unsubscribed != NULL) {
-		system->unsubscribed(diana, system->userData, entity);
+// the world now matches a snapshot, deltas start from here
+static void _resetTouched(struct diana *diana) {
+	unsigned int i;
+
+	for(i = 0; i < diana->touchedCount; i++) {
+		_denseIntegerSet_delete(diana, &diana->touched, diana->touchedList[i]);
 	}
+	diana->touchedCount = 0;
+	diana->tracking = 1;
 }
 
-static void _check(struct diana *diana, struct _system *system, unsigned int entity) {
-	unsigned char *entity_components = _getEntityData(diana, entity);
-	unsigned int component, i;
-	int wanted = 1;
+static void _releaseEntityId(struct diana *diana, unsigned int entity) {
+	unsigned int generation;
+
+	_touch(diana, entity);
+
+	generation = ++diana->generations[entity];
+	if(generation > diana->maxGeneration) {
+		diana->maxGeneration = generation;
+	}
+
+	_sparseIntegerSet_insert(diana, &diana->freeEntityIds, entity);
+	if(diana->entityRecycling == DL_ENTITY_RECYCLE_LOWEST) {
+		_denseIntegerSet_insert(diana, &diana->freeEntityBits, entity);
+		if(entity < diana->freeEntityHint) {
+			diana->freeEntityHint = entity;
+		}
+	}
+}
+
+static int _growGenerations(struct diana *diana, unsigned int entity) {
+	unsigned int newCapacity = (entity + 1) * 1.5, i;
+	int err = _realloc(diana, diana->generations, sizeof(unsigned int) * diana->generationsCapacity, sizeof(unsigned int) * newCapacity, (void **)&diana->generations);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	diana->maxGeneration++;
+	for(i = diana->generationsCapacity; i < newCapacity; i++) {
+		diana->generations[i] = diana->maxGeneration;
+	}
+	diana->generationsCapacity = newCapacity;
+
+	return DL_ERROR_NONE;
+}
+
+static unsigned int _takeEntityId(struct diana *diana) {
+	unsigned int r, n;
+
+	if(_sparseIntegerSet_isEmpty(diana, &diana->freeEntityIds)) {
+		return diana->nextEntityId++;
+	}
+
+	if(diana->entityRecycling != DL_ENTITY_RECYCLE_LOWEST) {
+		return _sparseIntegerSet_pop(diana, &diana->freeEntityIds);
+	}
+
+	// everything below the hint is in use, skip whole bytes of used ids
+	n = (diana->freeEntityBits.capacity + 7) >> 3;
+	for(r = diana->freeEntityHint >> 3; r < n && !diana->freeEntityBits.bytes[r]; r++);
+	for(r <<= 3; !_bits_isSet(diana->freeEntityBits.bytes, r); r++);
+
+	_bits_clear(diana->freeEntityBits.bytes, r);
+	_sparseIntegerSet_delete(diana, &diana->freeEntityIds, r);
+	diana->freeEntityHint = r + 1;
+
+	return r;
+}
+
+// ============================================================================
+// CHANGE TRACKING
+// an entity is logged once per tick and component, an older entry of the same
+// entity is told apart by its tick not matching the entity's latest one
+static int _markChanged(struct diana *diana, unsigned int entity, unsigned int component) {
+	struct _component *c = diana->components + component;
+	int err;
+
+	if(diana->num_spatials) {
+		err = _spatial_changed(diana, entity, component);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	if(diana->num_keyIndexes) {
+		err = _keys_changed(diana, entity, component);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	if(!c->tracked) {
+		return DL_ERROR_NONE;
+	}
+
+	if(entity >= c->changeTicksCapacity) {
+		unsigned int newCapacity = (entity + 1) * 1.5;
+		err = _realloc(diana, c->changeTicks, sizeof(unsigned long long) * c->changeTicksCapacity, sizeof(unsigned long long) * newCapacity, (void **)&c->changeTicks);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		c->changeTicksCapacity = newCapacity;
+	}
+
+	if(c->changeTicks[entity] == diana->changeTick) {
+		return DL_ERROR_NONE;
+	}
+
+	if(c->changeLogCount >= c->changeLogCapacity) {
+		unsigned int newCapacity = (c->changeLogCount + 1) * 1.5;
+		err = _realloc(diana, c->changeLog, sizeof(struct _change) * c->changeLogCapacity, sizeof(struct _change) * newCapacity, (void **)&c->changeLog);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		c->changeLogCapacity = newCapacity;
+	}
+
+	c->changeTicks[entity] = diana->changeTick;
+	c->changeLog[c->changeLogCount].entity = entity;
+	c->changeLog[c->changeLogCount].tick = diana->changeTick;
+	c->changeLogCount++;
+
+	return DL_ERROR_NONE;
+}
+
+// fill system->changedEntities with the subscribed entities that changed any
+// of the watched components after 'since', each once
+static int _collectChanged(struct diana *diana, struct _system *system, unsigned long long since, unsigned int *count_ptr) {
+	unsigned int component, i, count = 0;
+
+	FOREACH_SPARSEINTSET(component, i, &system->changed) {
+		struct _component *c = diana->components + component;
+		unsigned int lo = 0, hi = c->changeLogCount, k;
+
+		// the log is in tick order, skip what was seen already
+		while(lo < hi) {
+			unsigned int mid = lo + ((hi - lo) >> 1);
+			if(c->changeLog[mid].tick <= since) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+
+		for(k = lo; k < c->changeLogCount; k++) {
+			unsigned int entity = c->changeLog[k].entity, j;
+
+			if(c->changeLog[k].tick != c->changeTicks[entity] || !_denseIntegerSet_contains(diana, &system->entities, entity)) {
+				continue;
+			}
+
+			// taken already through an earlier component
+			for(j = 0; j < i; j++) {
+				struct _component *other = diana->components + system->changed.dense[j];
+				if(entity < other->changeTicksCapacity && other->changeTicks[entity] > since) {
+					break;
+				}
+			}
+			if(j < i) {
+				continue;
+			}
+
+			if(count >= system->changedEntitiesCapacity) {
+				unsigned int newCapacity = (count + 1) * 1.5;
+				int err = _realloc(diana, system->changedEntities, sizeof(unsigned int) * system->changedEntitiesCapacity, sizeof(unsigned int) * newCapacity, (void **)&system->changedEntities);
+				if(err != DL_ERROR_NONE) {
+					return err;
+				}
+				system->changedEntitiesCapacity = newCapacity;
+			}
+			system->changedEntities[count++] = entity;
+		}
+	}
+
+	*count_ptr = count;
+
+	return DL_ERROR_NONE;
+}
+
+// one slice of a pass over the system's entities, at least one entity and
+// then as many as fit in the budget. a pass that reaches the end starts over
+// on the next run
+static void _runSlice(struct diana *diana, struct _system *system, float delta) {
+	unsigned long long start = _profile_clock(diana);
+	unsigned int entity;
+
+	for(entity = system->cursor; entity < system->entities.capacity; entity++) {
+		if(!_bits_isSet(system->entities.bytes, entity)) {
+			continue;
+		}
+		system->process(diana, system->userData, entity, delta);
+		if(_profile_clock(diana) - start >= system->budget) {
+			system->cursor = entity + 1;
+			return;
+		}
+	}
+
+	system->cursor = 0;
+}
+
+// whether diana_process runs the system this frame, and the delta it gets
+static int _systemDue(struct _system *system, float delta, float *delta_ptr) {
+	system->rateDelta += delta;
+
+	if(system->rateInterval > 0) {
+		if(system->rateDelta < system->rateInterval) {
+			return 0;
+		}
+	} else if(system->rateFrames > 1) {
+		if(++system->rateFrame < system->rateFrames) {
+			return 0;
+		}
+		system->rateFrame = 0;
+	}
+
+	*delta_ptr = system->rateDelta;
+	system->rateDelta = 0;
+
+	return 1;
+}
+
+static void _runSystem(struct diana *diana, struct _system *system, float delta) {
+	unsigned long long since = system->lastRun;
+	unsigned int entity, count, i;
+	unsigned int window = DL_PROFILE_WINDOW_SYSTEMS + (system - diana->systems) * 3;
+	unsigned long long start = _profile_clock(diana);
+
+	system->lastRun = diana->changeTick;
+
+	if(system->starting != NULL) {
+		system->starting(diana, system->userData);
+	}
+	_profile_record(diana, window + 0, &start);
+	if(system->changed.population && _collectChanged(diana, system, since, &count) == DL_ERROR_NONE) {
+		for(i = 0; i < count; i++) {
+			system->process(diana, system->userData, system->changedEntities[i], delta);
+		}
+	} else if(system->budget && diana->profileClock != NULL) {
+		_runSlice(diana, system, delta);
+	} else {
+		// without the list every entity is taken as changed
+		FOREACH_DENSEINTSET(entity, &system->entities) {
+			system->process(diana, system->userData, entity, delta);
+		}
+	}
+	_profile_record(diana, window + 1, &start);
+	if(system->ending != NULL) {
+		system->ending(diana, system->userData);
+	}
+	_profile_record(diana, window + 2, &start);
+
+	// changes made from here on are new to this system
+	diana->changeTick++;
+}
+
+// drop log entries every watching system has seen, and the ones an entity
+// has a later entry for
+static void _trimChangeLogs(struct diana *diana) {
+	struct _component *c;
+	struct _system *system;
+	unsigned int ci, i, k, count;
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		unsigned long long oldest = ULLONG_MAX;
+
+		if(!c->tracked) {
+			continue;
+		}
+
+		FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+			if(_sparseIntegerSet_contains(diana, &system->changed, ci) && system->lastRun < oldest) {
+				oldest = system->lastRun;
+			}
+		}
+
+		for(k = 0, count = 0; k < c->changeLogCount; k++) {
+			if(c->changeLog[k].tick > oldest && c->changeLog[k].tick == c->changeTicks[c->changeLog[k].entity]) {
+				c->changeLog[count++] = c->changeLog[k];
+			}
+		}
+		c->changeLogCount = count;
+	}
+}
+
+static void _changes_clear(struct diana *diana) {
+	struct _component *c;
+	unsigned int ci;
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		if(c->changeTicks != NULL) {
+			memset(c->changeTicks, 0, sizeof(unsigned long long) * c->changeTicksCapacity);
+		}
+		c->changeLogCount = 0;
+	}
+}
+
+// follow diana_compact, remap never moves an entity up so ticks can be moved
+// down in place
+static int _changes_remap(struct diana *diana, const unsigned int *remap, unsigned int n) {
+	struct _component *c;
+	unsigned int ci, entity, k, count;
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		unsigned int limit = c->changeTicksCapacity < n ? c->changeTicksCapacity : n;
+
+		for(entity = 0; entity < limit; entity++) {
+			unsigned long long tick = c->changeTicks[entity];
+			c->changeTicks[entity] = 0;
+			if(remap[entity] != UINT_MAX) {
+				c->changeTicks[remap[entity]] = tick;
+			}
+		}
+
+		for(k = 0, count = 0; k < c->changeLogCount; k++) {
+			entity = c->changeLog[k].entity;
+			if(entity < n && remap[entity] != UINT_MAX) {
+				c->changeLog[count].entity = remap[entity];
+				c->changeLog[count++].tick = c->changeLog[k].tick;
+			}
+		}
+		c->changeLogCount = count;
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// ============================================================================
+// COMPONENT EVENTS
+static int _queueEvent(struct diana *diana, struct _component *c, unsigned int event, unsigned int entity) {
+	struct _eventQueue *q = c->events + event;
+
+	if(!q->subscribed) {
+		return DL_ERROR_NONE;
+	}
+
+	if(q->count >= q->capacity) {
+		unsigned int newCapacity = (q->count + 1) * 1.5;
+		int err = _realloc(diana, q->entities, sizeof(unsigned int) * q->capacity, sizeof(unsigned int) * newCapacity, (void **)&q->entities);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		q->capacity = newCapacity;
+	}
+	q->entities[q->count++] = entity;
+
+	return DL_ERROR_NONE;
+}
+
+// drop what every subscriber drained already
+static void _trimEventQueues(struct diana *diana) {
+	struct _component *c;
+	struct _system *system;
+	unsigned int ci, event, i, j;
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		for(event = DL_COMPONENT_EVENT_ADDED; event <= DL_COMPONENT_EVENT_REMOVED; event++) {
+			struct _eventQueue *q = c->events + event;
+			unsigned int drained = q->base + q->count;
+
+			if(!q->subscribed || q->count == 0) {
+				continue;
+			}
+
+			FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+				for(j = 0; j < system->num_eventSubscriptions; j++) {
+					struct _eventSubscription *sub = system->eventSubscriptions + j;
+					if(sub->component == ci && sub->event == event && sub->position < drained) {
+						drained = sub->position;
+					}
+				}
+			}
+
+			drained -= q->base;
+			if(drained) {
+				memmove(q->entities, q->entities + drained, sizeof(unsigned int) * (q->count - drained));
+				q->count -= drained;
+				q->base += drained;
+			}
+		}
+	}
+}
+
+static void _events_clear(struct diana *diana) {
+	struct _component *c;
+	struct _system *system;
+	unsigned int ci, i, j;
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		c->events[DL_COMPONENT_EVENT_ADDED].base += c->events[DL_COMPONENT_EVENT_ADDED].count;
+		c->events[DL_COMPONENT_EVENT_ADDED].count = 0;
+		c->events[DL_COMPONENT_EVENT_REMOVED].base += c->events[DL_COMPONENT_EVENT_REMOVED].count;
+		c->events[DL_COMPONENT_EVENT_REMOVED].count = 0;
+	}
+
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		for(j = 0; j < system->num_eventSubscriptions; j++) {
+			struct _eventSubscription *sub = system->eventSubscriptions + j;
+			sub->position = diana->components[sub->component].events[sub->event].base;
+		}
+	}
+}
+
+// follow diana_compact. entries of entities that are gone are dropped, and
+// positions past them move back
+static void _events_remap(struct diana *diana, const unsigned int *remap, unsigned int n) {
+	struct _component *c;
+	struct _system *system;
+	unsigned int ci, event, i, j, k, count;
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		for(event = DL_COMPONENT_EVENT_ADDED; event <= DL_COMPONENT_EVENT_REMOVED; event++) {
+			struct _eventQueue *q = c->events + event;
+
+			if(!q->subscribed) {
+				continue;
+			}
+
+			FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+				for(j = 0; j < system->num_eventSubscriptions; j++) {
+					struct _eventSubscription *sub = system->eventSubscriptions + j;
+					unsigned int end;
+
+					if(sub->component != ci || sub->event != event) {
+						continue;
+					}
+
+					end = sub->position - q->base;
+					for(k = 0; k < end; k++) {
+						if(q->entities[k] >= n || remap[q->entities[k]] == UINT_MAX) {
+							sub->position--;
+						}
+					}
+				}
+			}
+
+			for(k = 0, count = 0; k < q->count; k++) {
+				if(q->entities[k] < n && remap[q->entities[k]] != UINT_MAX) {
+					q->entities[count++] = remap[q->entities[k]];
+				}
+			}
+			q->count = count;
+		}
+	}
+}
+
+static void _subscribe(struct diana *diana, struct _system *system, unsigned int entity) {
+	int included = _denseIntegerSet_insert(diana, &system->entities, entity);
+	if(!included) {
+		_count(diana, _systemCounter(diana, system, 0), 1);
+		if(system->subscribed != NULL) {
+			system->subscribed(diana, system->userData, entity);
+		}
+	}
+}
+
+static void _unsubscribe(struct diana *diana, struct _system *system, unsigned int entity) {
+	int included = _denseIntegerSet_delete(diana, &system->entities, entity);
+	if(included) {
+		_count(diana, _systemCounter(diana, system, 1), 1);
+		if(system->unsubscribed != NULL) {
+			system->unsubscribed(diana, system->userData, entity);
+		}
+	}
+}
+
+static void _check(struct diana *diana, struct _system *system, unsigned int entity) {
+	unsigned char *entity_components = _getEntityData(diana, entity);
+	unsigned int component, i;
+	int wanted = 1;
 
 	FOREACH_SPARSEINTSET(component, i, &system->watch) {
 		if(!(entity_components[component >> 3] & (1 << (component & 7)))) {
@@ -728,26 +1935,26 @@ static void _check(struct diana *diana, struct _system *system, unsigned int ent
 
 static int _fixData(struct diana *diana) {
 	// take care of spawns that happen during processing
+	// they were handed the ids right after the old capacity
 	if(diana->processingData != NULL) {
-		unsigned int newDataHeight = diana->dataHeight + diana->processingDataHeight, i;
+		unsigned int oldDataHeightCapacity = diana->dataHeightCapacity, i;
 
-		if(newDataHeight >= diana->dataHeightCapacity) {
-			unsigned int newDataHeightCapacity = (newDataHeight + 1) * 1.5;
+		if(diana->dataHeight > diana->dataHeightCapacity) {
+			unsigned int newDataHeightCapacity = (diana->dataHeight + 1) * 1.5;
 			int err = _realloc(diana, diana->data, diana->dataWidth * diana->dataHeightCapacity, diana->dataWidth * newDataHeightCapacity, (void **)&diana->data);
 			if(err != DL_ERROR_NONE) {
 				return err;
 			}
+			_countGrowth(diana, (size_t)diana->dataWidth * diana->dataHeightCapacity);
 			diana->dataHeightCapacity = newDataHeightCapacity;
 		}
 
 		for(i = 0; i < diana->processingDataHeight; i++) {
-			memcpy((unsigned char *)diana->data + (diana->dataWidth * (diana->dataHeight + i)), diana->processingData[i], diana->dataWidth);
+			memcpy((unsigned char *)diana->data + (diana->dataWidth * (oldDataHeightCapacity + i)), diana->processingData[i], diana->dataWidth);
 			diana->free(diana->processingData[i]);
 		}
 		diana->free(diana->processingData);
 
-		diana->dataHeight = newDataHeight;
-
 		diana->processingData = NULL;
 		diana->processingDataHeight = 0;
 	}
@@ -759,88 +1966,150 @@ int diana_process(struct diana *diana, float delta) {
 	unsigned int entity, i, j;
 	struct _system *system;
 	struct _manager *manager;
+	unsigned long long frame, start, call;
+	int err;
 	
 	if(!diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
 	}
 
+	_record_call(diana, DL_RECORD_PROCESS, 0, 0, 0, 0);
+	_record_float(diana, delta);
+
+	frame = start = _profile_clock(diana);
+
+	if(diana->rollbackFrames) {
+		_rollback_begin(diana);
+	}
+
 	diana->processing = 1;
 
 	FOREACH_SPARSEINTSET(entity, i, &diana->added) {
 		FOREACH_ARRAY(manager, j, diana->managers, diana->num_managers) {
 			if(manager->added != NULL) {
+				call = _profile_clock(diana);
 				manager->added(diana, manager->userData, entity);
+				_profile_manager(diana, j, call);
 			}
 		}
 	}
 	_sparseIntegerSet_clear(diana, &diana->added);
+	_profile_record(diana, DL_PROFILE_WINDOW_SIGNAL + DL_ENTITY_ADDED, &start);
 
 	FOREACH_SPARSEINTSET(entity, i, &diana->enabled) {
+		_touch(diana, entity);
 		FOREACH_ARRAY(system, j, diana->systems, diana->num_systems) {
 			_check(diana, system, entity);
 		}
 		FOREACH_ARRAY(manager, j, diana->managers, diana->num_managers) {
 			if(manager->enabled != NULL) {
+				call = _profile_clock(diana);
 				manager->enabled(diana, manager->userData, entity);
+				_profile_manager(diana, j, call);
 			}
 		}
 		_denseIntegerSet_insert(diana, &diana->active, entity);
+		if(diana->num_spatials) {
+			_spatial_sync(diana, entity);
+		}
 	}
 	_sparseIntegerSet_clear(diana, &diana->enabled);
+	_profile_record(diana, DL_PROFILE_WINDOW_SIGNAL + DL_ENTITY_ENABLED, &start);
 
 	FOREACH_SPARSEINTSET(entity, i, &diana->disabled) {
+		_touch(diana, entity);
 		FOREACH_ARRAY(system, j, diana->systems, diana->num_systems) {
 			_unsubscribe(diana, system, entity);
 		}
 		FOREACH_ARRAY(manager, j, diana->managers, diana->num_managers) {
 			if(manager->disabled != NULL) {
+				call = _profile_clock(diana);
 				manager->disabled(diana, manager->userData, entity);
+				_profile_manager(diana, j, call);
 			}
 		}
 		_denseIntegerSet_delete(diana, &diana->active, entity);
+		_spatial_remove(diana, entity);
 	}
 	_sparseIntegerSet_clear(diana, &diana->disabled);
+	_profile_record(diana, DL_PROFILE_WINDOW_SIGNAL + DL_ENTITY_DISABLED, &start);
 
 	FOREACH_SPARSEINTSET(entity, i, &diana->deleted) {
+		_touch(diana, entity);
 		FOREACH_ARRAY(system, j, diana->systems, diana->num_systems) {
 			_unsubscribe(diana, system, entity);
 		}
 		FOREACH_ARRAY(manager, j, diana->managers, diana->num_managers) {
 			if(manager->deleted != NULL) {
+				call = _profile_clock(diana);
 				manager->deleted(diana, manager->userData, entity);
+				_profile_manager(diana, j, call);
 			}
 		}
-		for(j = 0; j < diana->num_components; j++) {
-			diana_removeComponents(diana, entity, j);
-		}
-		_sparseIntegerSet_insert(diana, &diana->freeEntityIds, entity);
+		_removeAllComponents(diana, entity);
+		_timers_cancelEntity(diana, entity);
+		_spatial_remove(diana, entity);
+		_keys_remove(diana, entity);
+		_hierarchy_deleted(diana, entity);
+		_denseIntegerSet_delete(diana, &diana->active, entity);
+		_releaseEntityId(diana, entity);
+		_count(diana, DL_COUNTER_SLOT_DELETES, 1);
 	}
 	_sparseIntegerSet_clear(diana, &diana->deleted);
+	_profile_record(diana, DL_PROFILE_WINDOW_SIGNAL + DL_ENTITY_DELETED, &start);
+
+	if(diana->timerFired != NULL) {
+		_timers_advance(diana, delta);
+	}
+
+#if DL_COMPUTE
+	_recomputeEager(diana);
+	_profile_record(diana, DL_PROFILE_WINDOW_COMPUTE, &start);
+#endif
 
 	FOREACH_ARRAY(system, j, diana->systems, diana->num_systems) {
-		if(system->flags & DL_SYSTEM_PASSIVE_BIT) {
+		float systemDelta;
+
+		if(system->flags & DL_SYSTEM_PASSIVE_BIT || !_systemDue(system, delta, &systemDelta)) {
 			continue;
 		}
 
-		if(system->starting != NULL) {
-			system->starting(diana, system->userData);
-		}
-		FOREACH_DENSEINTSET(entity, &system->entities) {
-			system->process(diana, system->userData, entity, delta);
-		}
-		if(system->ending != NULL) {
-			system->ending(diana, system->userData);
-		}
+		_runSystem(diana, system, systemDelta);
 	}
 
+	_trimChangeLogs(diana);
+	_trimEventQueues(diana);
+
 	diana->processing = 0;
 
-	return _fixData(diana);
+	start = _profile_clock(diana);
+	err = _fixData(diana);
+	_profile_record(diana, DL_PROFILE_WINDOW_FIX_DATA, &start);
+
+	if(err == DL_ERROR_NONE && diana->journalWrite != NULL) {
+		err = _journal_commit(diana);
+	}
+
+	if(diana->recordWrite != NULL) {
+		int recordErr = _record_flush(diana);
+		if(err == DL_ERROR_NONE) {
+			err = recordErr;
+		}
+	}
+
+	_counters_endFrame(diana);
+
+	_profile_record(diana, DL_PROFILE_WINDOW_FRAME, &frame);
+	if(_profile_endFrame(diana) != DL_ERROR_NONE && err == DL_ERROR_NONE) {
+		err = DL_ERROR_IO;
+	}
+
+	return err;
 }
 
 int diana_processSystem(struct diana *diana, unsigned int system, float delta) {
-	struct _system *s;
-	unsigned int entity;
+	unsigned long long start;
+	int err;
 
 	if(!diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
@@ -850,70 +2119,343 @@ int diana_processSystem(struct diana *diana, unsigned int system, float delta) {
 		return DL_ERROR_INVALID_VALUE;
 	}
 
-	s = diana->systems + system;
+	_record_call(diana, DL_RECORD_PROCESS_SYSTEM, 1, system, 0, 0);
+	_record_float(diana, delta);
 
-	if(s->starting != NULL) {
-		s->starting(diana, s->userData);
-	}
-	FOREACH_DENSEINTSET(entity, &s->entities) {
-		s->process(diana, s->userData, entity, delta);
-	}
-	if(s->ending != NULL) {
-		s->ending(diana, s->userData);
+	_runSystem(diana, diana->systems + system, delta);
+	_trimChangeLogs(diana);
+	_trimEventQueues(diana);
+
+	start = _profile_clock(diana);
+	err = _fixData(diana);
+	_profile_record(diana, DL_PROFILE_WINDOW_FIX_DATA, &start);
+
+	if(diana->recordWrite != NULL) {
+		int recordErr = _record_flush(diana);
+		if(err == DL_ERROR_NONE) {
+			err = recordErr;
+		}
 	}
 
-	return _fixData(diana);
+	return err;
 }
 
-// ============================================================================
-// entity
-int diana_spawn(struct diana *diana, unsigned int * entity_ptr) {
-	unsigned int r;
-	int err = DL_ERROR_NONE;
+// hand the system every entity queued for 'event' on 'component' since its
+// last drain, oldest first. entities queued by the callback are handed too
+int diana_drainComponentEvents(struct diana *diana, unsigned int system, unsigned int component, unsigned int event, void (*callback)(struct diana *, void *, unsigned int entity)) {
+	struct _system *s;
+	struct _eventQueue *q;
+	unsigned int i;
 
 	if(!diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
 	}
 
-	if(_sparseIntegerSet_isEmpty(diana, &diana->freeEntityIds)) {
-		r = diana->nextEntityId++;
+	if(system >= diana->num_systems || component >= diana->num_components || callback == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	s = diana->systems + system;
+	for(i = 0; i < s->num_eventSubscriptions; i++) {
+		if(s->eventSubscriptions[i].component == component && s->eventSubscriptions[i].event == event) {
+			break;
+		}
+	}
+	if(i == s->num_eventSubscriptions) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	// the queue can move while the callback runs, index it each time
+	q = diana->components[component].events + event;
+	while(s->eventSubscriptions[i].position < q->base + q->count) {
+		unsigned int entity = q->entities[s->eventSubscriptions[i].position++ - q->base];
+		callback(diana, s->userData, entity);
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// drop every entity at once, without any per entity callbacks or teardown
+int diana_clear(struct diana *diana) {
+	struct _component *c;
+	struct _system *system;
+	unsigned int i;
+
+	if(!diana->initialized || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	_record_call(diana, DL_RECORD_CLEAR, 0, 0, 0, 0);
+
+	// pools keep their chunks for the next round of entities, rows and their
+	// bags are left as they are until they are used again
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		_sparseIntegerSet_clear(diana, &c->freeDataIndexes);
+		c->nextDataIndex = 0;
+	}
+
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		_denseIntegerSet_clear(diana, &system->entities);
+	}
+
+	_denseIntegerSet_clear(diana, &diana->active);
+	if(diana->dataHeight > diana->staleHeight) {
+		diana->staleHeight = diana->dataHeight;
+	}
+
+	_sparseIntegerSet_clear(diana, &diana->added);
+	_sparseIntegerSet_clear(diana, &diana->enabled);
+	_sparseIntegerSet_clear(diana, &diana->disabled);
+	_sparseIntegerSet_clear(diana, &diana->deleted);
+	_sparseIntegerSet_clear(diana, &diana->freeEntityIds);
+	_denseIntegerSet_clear(diana, &diana->freeEntityBits);
+	diana->freeEntityHint = 0;
+
+#if DL_COMPUTE
+	_dependencies_clear(diana);
+#endif
+	_changes_clear(diana);
+	_events_clear(diana);
+	_timers_clear(diana);
+	_spatial_clear(diana);
+	_keys_clear(diana);
+	_hierarchy_clear(diana);
+
+	// rows past the next delta's entity count are dropped by it, nothing is
+	// left to list
+	_denseIntegerSet_clear(diana, &diana->touched);
+	diana->touchedCount = 0;
+
+	// ids get fresh generations as they come back
+	_free(diana, diana->generations);
+	diana->generations = NULL;
+	diana->generationsCapacity = 0;
+
+	diana->nextEntityId = 0;
+	diana->dataHeight = 0;
+
+	_undo_reset(diana);
+
+	return DL_ERROR_NONE;
+}
+
+// move every live entity down into a dense prefix of the table, keeping
+// their order, and give back the memory past it
+int diana_compact(struct diana *diana, unsigned int ** remap_ptr, unsigned int * count_ptr) {
+	struct _system *system;
+	unsigned int *remap = NULL, n = diana->nextEntityId, live = 0, entity, i;
+	int err;
+
+	if(!diana->initialized || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	_record_call(diana, DL_RECORD_COMPACT, 0, 0, 0, 0);
+
+	_cleanStaleRows(diana);
+
+	err = _malloc(diana, sizeof(unsigned int) * (n + 1), (void **)&remap);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	// a slot that takes another entity's row gets a generation above any
+	// handed out before, old handles to either entity stop matching
+	diana->maxGeneration++;
+	for(entity = 0; entity < n; entity++) {
+		if(_sparseIntegerSet_contains(diana, &diana->freeEntityIds, entity)) {
+			remap[entity] = UINT_MAX;
+			continue;
+		}
+		if(entity != live) {
+			memcpy(_getEntityData(diana, live), _getEntityData(diana, entity), diana->dataWidth);
+			diana->generations[live] = diana->maxGeneration;
+		}
+		remap[entity] = live++;
+	}
+
+	err = _denseIntegerSet_remap(diana, &diana->active, remap, n, live);
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		if(err == DL_ERROR_NONE) {
+			err = _denseIntegerSet_remap(diana, &system->entities, remap, n, live);
+		}
+	}
+	if(err == DL_ERROR_NONE) {
+		err = _sparseIntegerSet_remap(diana, &diana->added, remap, n, live);
+	}
+	if(err == DL_ERROR_NONE) {
+		err = _sparseIntegerSet_remap(diana, &diana->enabled, remap, n, live);
+	}
+	if(err == DL_ERROR_NONE) {
+		err = _sparseIntegerSet_remap(diana, &diana->disabled, remap, n, live);
+	}
+	if(err == DL_ERROR_NONE) {
+		err = _sparseIntegerSet_remap(diana, &diana->deleted, remap, n, live);
+	}
+#if DL_COMPUTE
+	if(err == DL_ERROR_NONE) {
+		err = _dependencies_remap(diana, remap, n, live);
+	}
+#endif
+	if(err == DL_ERROR_NONE) {
+		err = _changes_remap(diana, remap, n);
+	}
+	if(err == DL_ERROR_NONE) {
+		_events_remap(diana, remap, n);
+		_timers_remap(diana, remap, n);
+		_spatial_remap(diana, remap, n);
+		_keys_remap(diana, remap, n);
+		_hierarchy_remap(diana, remap, n);
+	}
+	if(err != DL_ERROR_NONE) {
+		_free(diana, remap);
+		return err;
+	}
+
+	_sparseIntegerSet_free(diana, &diana->freeEntityIds);
+	_denseIntegerSet_free(diana, &diana->freeEntityBits);
+	diana->freeEntityHint = 0;
+
+	err = _realloc(diana, diana->data, diana->dataWidth * diana->dataHeightCapacity, diana->dataWidth * live, (void **)&diana->data);
+	if(err != DL_ERROR_NONE) {
+		_free(diana, remap);
+		return err;
+	}
+	diana->dataHeightCapacity = live;
+	diana->dataHeight = live;
+	diana->nextEntityId = live;
+
+	err = _realloc(diana, diana->generations, sizeof(unsigned int) * diana->generationsCapacity, sizeof(unsigned int) * live, (void **)&diana->generations);
+	if(err != DL_ERROR_NONE) {
+		_free(diana, remap);
+		return err;
+	}
+	diana->generationsCapacity = live;
+
+	// every entity may have moved, the next delta carries them all
+	if(diana->tracking) {
+		_denseIntegerSet_clear(diana, &diana->touched);
+		diana->touchedCount = 0;
+		for(entity = 0; entity < live; entity++) {
+			_touch(diana, entity);
+		}
+	}
+
+	// nor can earlier frames be gone back to
+	_undo_reset(diana);
+
+	if(remap_ptr != NULL) {
+		*remap_ptr = remap;
 	} else {
-		r = _sparseIntegerSet_pop(diana, &diana->freeEntityIds);
+		_free(diana, remap);
+	}
+	if(count_ptr != NULL) {
+		*count_ptr = n;
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// ============================================================================
+// entity
+// grow the table once ahead of 'count' spawns, spawns during processing are
+// kept on the side until _fixData and do not need this
+static int _reserveEntities(struct diana *diana, unsigned int count) {
+	unsigned int reused = diana->freeEntityIds.population, newDataHeightCapacity;
+	int err;
+
+	if(diana->processing || count <= reused) {
+		return DL_ERROR_NONE;
+	}
+
+	newDataHeightCapacity = diana->nextEntityId + (count - reused);
+	if(newDataHeightCapacity <= diana->dataHeightCapacity) {
+		return DL_ERROR_NONE;
+	}
+
+	err = _realloc(diana, diana->data, diana->dataWidth * diana->dataHeightCapacity, diana->dataWidth * newDataHeightCapacity, (void **)&diana->data);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+	_countGrowth(diana, (size_t)diana->dataWidth * diana->dataHeightCapacity);
+	diana->dataHeightCapacity = newDataHeightCapacity;
+
+	return DL_ERROR_NONE;
+}
+
+static int _spawn(struct diana *diana, unsigned int * entity_ptr) {
+	unsigned int r, height;
+	int err = DL_ERROR_NONE;
+
+	r = _takeEntityId(diana);
+	_touch(diana, r);
+	_count(diana, DL_COUNTER_SLOT_SPAWNS, 1);
+
+	if(r >= diana->generationsCapacity) {
+		err = _growGenerations(diana, r);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
 	}
 
-	diana->dataHeight = diana->dataHeight > (r + 1) ? diana->dataHeight : (r + 1);
+	height = diana->dataHeight > (r + 1) ? diana->dataHeight : (r + 1);
+
+	if(diana->dataHeight < diana->staleHeight) {
+		_cleanRows(diana, diana->dataHeight, height < diana->staleHeight ? height : diana->staleHeight);
+	}
 
-	if(diana->dataHeight > diana->dataHeightCapacity) {
+	if(height > diana->dataHeightCapacity) {
 		if(diana->processing) {
 			void *entityData;
 		 
 			err = _malloc(diana, diana->dataWidth, &entityData);
 			if(err != DL_ERROR_NONE) {
-				return err;
-			}
-
-			if(entityData == NULL) {
-				return 0;
+				goto error;
 			}
 
 			err = _realloc(diana, diana->processingData, sizeof(*diana->processingData) * diana->processingDataHeight, sizeof(*diana->processingData) * (diana->processingDataHeight + 1), (void **)&diana->processingData);
 			if(err != DL_ERROR_NONE) {
-				return err;
+				_free(diana, entityData);
+				goto error;
 			}
 
 			diana->processingData[diana->processingDataHeight++] = entityData;
 		} else {
-			unsigned int newDataHeightCapacity = diana->dataHeight * 1.5;
+			unsigned int newDataHeightCapacity = height * 1.5;
+			unsigned long long start = _profile_clock(diana);
 			err = _realloc(diana, diana->data, diana->dataWidth * diana->dataHeightCapacity, diana->dataWidth * newDataHeightCapacity, (void **)&diana->data);
 			if(err != DL_ERROR_NONE) {
-				return err;
+				goto error;
 			}
+			_countGrowth(diana, (size_t)diana->dataWidth * diana->dataHeightCapacity);
 			diana->dataHeightCapacity = newDataHeightCapacity;
+			_profile_record(diana, DL_PROFILE_WINDOW_GROW, &start);
 		}
 	}
 
+	diana->dataHeight = height;
+
 	*entity_ptr = r;
 
+	return err;
+
+error:
+	_releaseEntityId(diana, r);
+	return err;
+}
+
+int diana_spawn(struct diana *diana, unsigned int * entity_ptr) {
+	int err;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	err = _spawn(diana, entity_ptr);
+	if(err == DL_ERROR_NONE) {
+		_record_call(diana, DL_RECORD_SPAWN, 1, *entity_ptr, 0, 0);
+	}
+
 	return err;
 }
 
@@ -928,6 +2470,12 @@ int diana_signal(struct diana *diana, unsigned int entity, unsigned int signal)
 		return DL_ERROR_INVALID_VALUE;
 	}
 
+	_record_call(diana, DL_RECORD_SIGNAL, 2, entity, signal, 0);
+
+	if(signal <= DL_ENTITY_DELETED) {
+		_count(diana, DL_COUNTER_SLOT_SIGNALS + signal, 1);
+	}
+
 	switch(signal) {
 	case DL_ENTITY_ADDED:
 		_sparseIntegerSet_insert(diana, &diana->added, entity);
@@ -950,6 +2498,7 @@ int diana_signal(struct diana *diana, unsigned int entity, unsigned int signal)
 		_sparseIntegerSet_delete(diana, &diana->enabled, entity);
 		_sparseIntegerSet_insert(diana, &diana->disabled, entity);
 		_sparseIntegerSet_insert(diana, &diana->deleted, entity);
+		_hierarchy_signalDeleted(diana, entity);
 		break;
 	default:
 		err = DL_ERROR_INVALID_VALUE;
@@ -958,360 +2507,5257 @@ int diana_signal(struct diana *diana, unsigned int entity, unsigned int signal)
 	return err;
 }
 
+static void *_component_slot(struct _component *c, unsigned int index) {
+	return (unsigned char *)c->data[index >> DL_POOL_CHUNK_SHIFT] + c->size * (index & (DL_POOL_CHUNK_SIZE - 1));
+}
+
+// make sure the next 'count' index requests can be served without touching the
+// allocator again
+static int _component_reserve(struct diana *diana, struct _component *c, unsigned int count) {
+	unsigned int nextDataIndex, numDataChunks, i;
+	int err;
+
+	if(count <= c->freeDataIndexes.population) {
+		return DL_ERROR_NONE;
+	}
+	nextDataIndex = c->nextDataIndex + (count - c->freeDataIndexes.population);
+
+	if((c->flags & DL_COMPONENT_LIMITED_BIT) && nextDataIndex > (c->flags >> 3)) {
+		return DL_ERROR_FULL_COMPONENT;
+	}
+
+	numDataChunks = (nextDataIndex + DL_POOL_CHUNK_SIZE - 1) >> DL_POOL_CHUNK_SHIFT;
+	if(numDataChunks <= c->numDataChunks) {
+		return DL_ERROR_NONE;
+	}
+
+	err = _realloc(diana, c->data, sizeof(void *) * c->numDataChunks, sizeof(void *) * numDataChunks, (void **)&c->data);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	for(i = c->numDataChunks; i < numDataChunks; i++) {
+		err = _malloc(diana, c->size << DL_POOL_CHUNK_SHIFT, &c->data[i]);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		c->numDataChunks = i + 1;
+	}
+
+	return DL_ERROR_NONE;
+}
+
 static int _getAComponentIndex(struct diana *diana, struct _component *c, unsigned int * index) {
 	if(_sparseIntegerSet_isEmpty(diana, &c->freeDataIndexes)) {
-		if(c->flags & DL_COMPONENT_LIMITED_BIT) {
-			return DL_ERROR_FULL_COMPONENT;
+		int err = _component_reserve(diana, c, 1);
+		if(err != DL_ERROR_NONE) {
+			return err;
 		}
 
 		*index = c->nextDataIndex++;
-
-		return _realloc(diana, c->data, sizeof(void *) * *index, sizeof(void *) * c->nextDataIndex, (void **)&c->data) ||
-		       _malloc(diana, c->size, (void **)&c->data[*index]);
 	} else {
 		*index = _sparseIntegerSet_pop(diana, &c->freeDataIndexes);
 	}
 
+	_count(diana, _componentCounter(diana, c, 1), 1);
+
 	return DL_ERROR_NONE;
 }
 
-static int _setComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i, const void * data) {
-	unsigned char *entityData = _getEntityData(diana, entity);
-	struct _component *c = diana->components + component;
-	int defined = _bits_set(entityData, component);
-	void *componentData = NULL;
-	unsigned int err = DL_ERROR_NONE;
-
 #if DL_COMPUTE
-	if(c->compute) {
-		entityData[c->offset - 1] = !defined;
-	}
-#endif
-
-	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
-		struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
-		unsigned int index;
+// ============================================================================
+// COMPUTE
+// reads made while computing a component record an edge from the component
+// read to the one being computed, per entity. changing the source marks
+// everything computed from it dirty, transitively, and drops the edges, the
+// recompute records them again
+static int _isDirty(struct diana *diana, unsigned int entity, struct _component *c) {
+	return _denseIntegerSet_contains(diana, &c->dirty, entity);
+}
 
-		if(i >= bag->count) {
-			err = _getAComponentIndex(diana, c, &index);
-			if(err != DL_ERROR_NONE) {
-				return err;
-			}
+// drop entries that were cleared since they were listed, and the repeats of
+// an entity that went clean and dirty again. bits of kept entries are taken
+// down while going so a repeat is seen as clean, then put back
+static void _dirtyList_compact(struct diana *diana, struct _component *c) {
+	unsigned int i, count = 0;
 
-			err = _realloc(diana, bag->indexes, sizeof(unsigned int) * bag->count, sizeof(unsigned int) * (bag->count + 1), (void **)&bag->indexes);
-			if(err != DL_ERROR_NONE) {
-				return err;
-			}
-			bag->indexes[i = bag->count++] = index;
+	for(i = 0; i < c->dirtyCount; i++) {
+		if(_denseIntegerSet_delete(diana, &c->dirty, c->dirtyList[i])) {
+			c->dirtyList[count++] = c->dirtyList[i];
 		}
+	}
+	c->dirtyCount = count;
 
-		componentData = (void *)((unsigned char *)c->data[bag->indexes[i]]);
-	} else if(c->flags & DL_COMPONENT_INDEXED_BIT) {
-		unsigned int *index = (unsigned int *)(entityData + c->offset);
+	for(i = 0; i < count; i++) {
+		_bits_set(c->dirty.bytes, c->dirtyList[i]);
+	}
+}
 
-		if(!defined) {
-			err = _getAComponentIndex(diana, c, index);
-			if(err != DL_ERROR_NONE) {
-				return err;
-			}
-		}
+static int _setDirty(struct diana *diana, unsigned int entity, unsigned int component) {
+	struct _component *c = diana->components + component;
 
-		componentData = (void *)((unsigned char *)c->data[*index]);
-	} else {
-		componentData = (void *)(entityData + c->offset);
+	if(!_bits_isSet(_getEntityData(diana, entity), component) || _denseIntegerSet_insert(diana, &c->dirty, entity)) {
+		return 0;
 	}
 
-	if(data != NULL) {
-		memcpy(componentData, data, c->size);
+	if(c->dirtyCount >= c->dirtyCapacity) {
+		_dirtyList_compact(diana, c);
+	}
+	if(c->dirtyCount >= c->dirtyCapacity) {
+		unsigned int newCapacity = (c->dirtyCount + 1) * 1.5;
+		if(_realloc(diana, c->dirtyList, sizeof(unsigned int) * c->dirtyCapacity, sizeof(unsigned int) * newCapacity, (void **)&c->dirtyList) != DL_ERROR_NONE) {
+			_denseIntegerSet_delete(diana, &c->dirty, entity);
+			return 0;
+		}
+		c->dirtyCapacity = newCapacity;
 	}
+	c->dirtyList[c->dirtyCount++] = entity;
 
-	return err;
+	return 1;
 }
 
-static int _getComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i, void ** ptr) {
-	unsigned char *entityData = _getEntityData(diana, entity);
-	struct _component *c = diana->components + component;
-	void *componentData = NULL;
-	int err = DL_ERROR_NONE;
-
-#if DL_COMPUTE
-	unsigned int calculate = 0;
-#endif
+static void _clearDirty(struct diana *diana, unsigned int entity, struct _component *c) {
+	_denseIntegerSet_delete(diana, &c->dirty, entity);
+}
 
-	if(!_bits_isSet(entityData, component)) {
-		return DL_ERROR_INVALID_VALUE;
-	}
+static int _dependency_add(struct diana *diana, unsigned int entity, unsigned int component, unsigned int dependentEntity, unsigned int dependentComponent) {
+	struct _component *c = diana->components + component;
+	unsigned int d;
+	int err;
 
-#if DL_COMPUTE
-	if(diana->computingComponentStack) {
-		_sparseIntegerSet_insert(diana, &c->componentsToDirty, diana->computingComponentStack->component);
+	if(entity >= c->dependentsCapacity) {
+		unsigned int newCapacity = (entity + 1) * 1.5;
+		err = _realloc(diana, c->dependents, sizeof(unsigned int) * c->dependentsCapacity, sizeof(unsigned int) * newCapacity, (void **)&c->dependents);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		memset(c->dependents + c->dependentsCapacity, 0xFF, sizeof(unsigned int) * (newCapacity - c->dependentsCapacity));
+		c->dependentsCapacity = newCapacity;
 	}
 
-	if(c->compute) {
-		if(entityData[c->offset - 1]) {
-			calculate = 1;
-			entityData[c->offset - 1] = 0;
+	for(d = c->dependents[entity]; d != UINT_MAX; d = diana->dependencies[d].next) {
+		if(diana->dependencies[d].entity == dependentEntity && diana->dependencies[d].component == dependentComponent) {
+			return DL_ERROR_NONE;
 		}
 	}
-#endif
 
-	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
-		struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
-		if(i >= bag->count) {
-			return DL_ERROR_INVALID_VALUE;
-		}
-		componentData = (void *)((unsigned char *)c->data[bag->indexes[i]]);
-	} else if(c->flags & DL_COMPONENT_INDEXED_BIT) {
-		unsigned int *index = (unsigned int *)(entityData + c->offset);
-		if(*index == UINT_MAX) {
-			return err;
+	if(_sparseIntegerSet_isEmpty(diana, &diana->freeDependencies)) {
+		if(diana->nextDependency >= diana->dependenciesCapacity) {
+			unsigned int newCapacity = (diana->nextDependency + 1) * 1.5;
+			err = _realloc(diana, diana->dependencies, sizeof(struct _dependency) * diana->dependenciesCapacity, sizeof(struct _dependency) * newCapacity, (void **)&diana->dependencies);
+			if(err != DL_ERROR_NONE) {
+				return err;
+			}
+			diana->dependenciesCapacity = newCapacity;
 		}
-		componentData = (void *)((unsigned char *)c->data[*index]);
+		d = diana->nextDependency++;
 	} else {
-		componentData = (void *)(entityData + c->offset);
+		d = _sparseIntegerSet_pop(diana, &diana->freeDependencies);
 	}
 
-#if DL_COMPUTE
-	if(calculate) {
-		struct _computingComponentStack ccs;
-		ccs.previous = diana->computingComponentStack;
-		ccs.component = component;
-		diana->computingComponentStack = &ccs;
+	diana->dependencies[d].entity = dependentEntity;
+	diana->dependencies[d].component = dependentComponent;
+	diana->dependencies[d].next = c->dependents[entity];
+	c->dependents[entity] = d;
 
-		c->compute(diana, c->userData, entity, i, componentData);
+	return DL_ERROR_NONE;
+}
 
-		diana->computingComponentStack = ccs.previous;
-	}
-#endif
+static int _invalidate(struct diana *diana, unsigned int entity, unsigned int component) {
+	unsigned int top = 0;
+
+	if(entity >= diana->components[component].dependentsCapacity || diana->components[component].dependents[entity] == UINT_MAX) {
+		return DL_ERROR_NONE;
+	}
+
+	if(diana->invalidatingCapacity == 0) {
+		int err = _malloc(diana, sizeof(struct _dependency) * 16, (void **)&diana->invalidating);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		diana->invalidatingCapacity = 16;
+	}
+
+	diana->invalidating[top].entity = entity;
+	diana->invalidating[top++].component = component;
+
+	while(top) {
+		struct _component *c;
+		unsigned int d;
+
+		top--;
+		entity = diana->invalidating[top].entity;
+		c = diana->components + diana->invalidating[top].component;
+
+		if(entity >= c->dependentsCapacity) {
+			continue;
+		}
+
+		d = c->dependents[entity];
+		c->dependents[entity] = UINT_MAX;
+
+		while(d != UINT_MAX) {
+			struct _dependency dependency = diana->dependencies[d];
+			_sparseIntegerSet_insert(diana, &diana->freeDependencies, d);
+			d = dependency.next;
+
+			// already dirty means its own dependents were marked back then
+			if(!_setDirty(diana, dependency.entity, dependency.component)) {
+				continue;
+			}
+
+			if(top >= diana->invalidatingCapacity) {
+				unsigned int newCapacity = diana->invalidatingCapacity * 2;
+				int err = _realloc(diana, diana->invalidating, sizeof(struct _dependency) * diana->invalidatingCapacity, sizeof(struct _dependency) * newCapacity, (void **)&diana->invalidating);
+				if(err != DL_ERROR_NONE) {
+					return err;
+				}
+				diana->invalidatingCapacity = newCapacity;
+			}
+			diana->invalidating[top++] = dependency;
+		}
+	}
+
+	return DL_ERROR_NONE;
+}
+
+static void _compute(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i, void *componentData) {
+	struct _component *c = diana->components + component;
+	struct _computingComponentStack ccs;
+
+	ccs.previous = diana->computingComponentStack;
+	ccs.entity = entity;
+	ccs.component = component;
+	diana->computingComponentStack = &ccs;
+
+	_count(diana, _componentCounter(diana, c, 0), 1);
+	c->compute(diana, c->userData, entity, i, componentData);
+
+	diana->computingComponentStack = ccs.previous;
+}
+
+static void _dependencies_clear(struct diana *diana) {
+	struct _component *c;
+	unsigned int ci;
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		_free(diana, c->dependents);
+		c->dependents = NULL;
+		c->dependentsCapacity = 0;
+		_denseIntegerSet_clear(diana, &c->dirty);
+		c->dirtyCount = 0;
+	}
+	_sparseIntegerSet_clear(diana, &diana->freeDependencies);
+	diana->nextDependency = 0;
+}
+
+// follow diana_compact, remap is monotonic so heads can move down in place.
+// edges from deleted entities were dropped at delete time, edges to them are
+// unlinked here
+static int _dependencies_remap(struct diana *diana, const unsigned int *remap, unsigned int n, unsigned int live) {
+	struct _component *c;
+	unsigned int ci, entity;
+	int err;
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		unsigned int limit = c->dependentsCapacity < n ? c->dependentsCapacity : n;
+
+		for(entity = 0; entity < limit; entity++) {
+			unsigned int *link, head = c->dependents[entity];
+
+			c->dependents[entity] = UINT_MAX;
+			if(remap[entity] == UINT_MAX) {
+				continue;
+			}
+
+			c->dependents[remap[entity]] = head;
+			for(link = c->dependents + remap[entity]; *link != UINT_MAX;) {
+				struct _dependency *dependency = diana->dependencies + *link;
+				unsigned int to = dependency->entity < n ? remap[dependency->entity] : UINT_MAX;
+
+				if(to == UINT_MAX) {
+					_sparseIntegerSet_insert(diana, &diana->freeDependencies, *link);
+					*link = dependency->next;
+					continue;
+				}
+				dependency->entity = to;
+				link = &dependency->next;
+			}
+		}
+
+		// remapping the list first reads the old bits, remapping the bits
+		// after that keeps only what was dirty
+		_dirtyList_compact(diana, c);
+		for(entity = 0; entity < c->dirtyCount; entity++) {
+			c->dirtyList[entity] = c->dirtyList[entity] < n ? remap[c->dirtyList[entity]] : UINT_MAX;
+		}
+		err = _denseIntegerSet_remap(diana, &c->dirty, remap, n, live);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		_dirtyList_compact(diana, c);
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// recompute every dirty instance of the eager components, one component at
+// a time, until computing stops dirtying anything else
+static void _recomputeEager(struct diana *diana) {
+	struct _component *c;
+	unsigned int ci, entity, i;
+	int pending = 1;
+
+	while(pending) {
+		pending = 0;
+
+		FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+			if(!c->eager) {
+				continue;
+			}
+
+			while(c->dirtyCount) {
+				unsigned char *entityData;
+
+				entity = c->dirtyList[--c->dirtyCount];
+				entityData = _getEntityData(diana, entity);
+
+				if(!_bits_isSet(entityData, ci) || !_isDirty(diana, entity, c)) {
+					continue;
+				}
+				_clearDirty(diana, entity, c);
+
+				if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+					struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+					for(i = 0; i < bag->count; i++) {
+						_compute(diana, entity, ci, i, _component_slot(c, bag->indexes[i]));
+					}
+				} else if(c->flags & DL_COMPONENT_INDEXED_BIT) {
+					_compute(diana, entity, ci, 0, _component_slot(c, *(unsigned int *)(entityData + c->offset)));
+				} else {
+					_compute(diana, entity, ci, 0, entityData + c->offset);
+				}
+
+				pending = 1;
+			}
+		}
+	}
+}
+#endif
+
+static int _setComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i, const void * data) {
+	unsigned char *entityData = _getEntityData(diana, entity);
+	struct _component *c = diana->components + component;
+	void *componentData = NULL;
+	unsigned int err = DL_ERROR_NONE;
+	int defined;
+
+	if(diana->num_keyIndexes && data != NULL && _keys_taken(diana, entity, component, data)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_touch(diana, entity);
+	defined = _bits_set(entityData, component);
+
+	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+		struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+		unsigned int index;
+
+		if(i >= bag->count) {
+			err = _getAComponentIndex(diana, c, &index);
+			if(err != DL_ERROR_NONE) {
+				return err;
+			}
+
+			err = _realloc(diana, bag->indexes, sizeof(unsigned int) * bag->count, sizeof(unsigned int) * (bag->count + 1), (void **)&bag->indexes);
+			if(err != DL_ERROR_NONE) {
+				return err;
+			}
+			bag->indexes[i = bag->count++] = index;
+		}
+
+		componentData = _component_slot(c, bag->indexes[i]);
+	} else if(c->flags & DL_COMPONENT_INDEXED_BIT) {
+		unsigned int *index = (unsigned int *)(entityData + c->offset);
+
+		if(!defined) {
+			err = _getAComponentIndex(diana, c, index);
+			if(err != DL_ERROR_NONE) {
+				return err;
+			}
+		}
+
+		componentData = _component_slot(c, *index);
+	} else {
+		componentData = (void *)(entityData + c->offset);
+	}
+
+	if(data != NULL) {
+		memcpy(componentData, data, c->size);
+	}
+
+#if DL_COMPUTE
+	// a new computed component waits for its first compute, a written one
+	// is taken as is
+	if(c->compute) {
+		if(defined) {
+			_clearDirty(diana, entity, c);
+		} else {
+			_setDirty(diana, entity, component);
+		}
+	}
+	err = _invalidate(diana, entity, component);
+#endif
+
+	if(err == DL_ERROR_NONE) {
+		err = _markChanged(diana, entity, component);
+	}
+	if(err == DL_ERROR_NONE && !defined) {
+		err = _queueEvent(diana, c, DL_COMPONENT_EVENT_ADDED, entity);
+	}
+
+	return err;
+}
+
+static int _getComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i, void ** ptr) {
+	unsigned char *entityData = _getEntityData(diana, entity);
+	struct _component *c = diana->components + component;
+	void *componentData = NULL;
+	int err = DL_ERROR_NONE;
+
+#if DL_COMPUTE
+	unsigned int calculate = 0;
+#endif
+
+	if(!_bits_isSet(entityData, component)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	// the pointer can be written through, keep the entity as it was first
+	_capture(diana, entity);
+
+#if DL_COMPUTE
+	if(diana->computingComponentStack) {
+		err = _dependency_add(diana, entity, component, diana->computingComponentStack->entity, diana->computingComponentStack->component);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	if(c->compute && _isDirty(diana, entity, c)) {
+		calculate = 1;
+		_clearDirty(diana, entity, c);
+	}
+#endif
+
+	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+		struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+		if(i >= bag->count) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		componentData = _component_slot(c, bag->indexes[i]);
+	} else if(c->flags & DL_COMPONENT_INDEXED_BIT) {
+		unsigned int *index = (unsigned int *)(entityData + c->offset);
+		if(*index == UINT_MAX) {
+			return err;
+		}
+		componentData = _component_slot(c, *index);
+	} else {
+		componentData = (void *)(entityData + c->offset);
+	}
+
+#if DL_COMPUTE
+	if(calculate) {
+		_compute(diana, entity, component, i, componentData);
+	}
+#endif
 
 	*ptr = componentData;
 
 	return err;
 }
 
+// what follows once a component changed on an entity by going away, the
+// removed event and index updates only once its last instance is gone
+static int _componentRemoved(struct diana *diana, unsigned int entity, unsigned int component) {
+	unsigned char *entityData = _getEntityData(diana, entity);
+	struct _component *c = diana->components + component;
+	int err = DL_ERROR_NONE;
+
+#if DL_COMPUTE
+	if(c->compute && !_bits_isSet(entityData, component)) {
+		_clearDirty(diana, entity, c);
+	}
+	err = _invalidate(diana, entity, component);
+#endif
+
+	if(err == DL_ERROR_NONE && !_bits_isSet(entityData, component)) {
+		err = _queueEvent(diana, c, DL_COMPONENT_EVENT_REMOVED, entity);
+		if(err == DL_ERROR_NONE && diana->num_spatials) {
+			err = _spatial_changed(diana, entity, component);
+		}
+		if(err == DL_ERROR_NONE && diana->num_keyIndexes) {
+			err = _keys_changed(diana, entity, component);
+		}
+	}
+
+	return err;
+}
+
+// take a component off an entity as a whole, every instance of a multiple one
+// and its bag at once
+static int _removeComponent(struct diana *diana, unsigned int entity, unsigned int component) {
+	unsigned char *entityData = _getEntityData(diana, entity);
+	struct _component *c = diana->components + component;
+	unsigned int i;
+
+	if(!_bits_isSet(entityData, component)) {
+		return DL_ERROR_NONE;
+	}
+
+	_touch(diana, entity);
+	_bits_clear(entityData, component);
+
+	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+		struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+		for(i = 0; i < bag->count; i++) {
+			_sparseIntegerSet_insert(diana, &c->freeDataIndexes, bag->indexes[i]);
+		}
+		_count(diana, _componentCounter(diana, c, 2), bag->count);
+		_free(diana, bag->indexes);
+		bag->indexes = NULL;
+		bag->count = 0;
+	} else if(c->flags & DL_COMPONENT_INDEXED_BIT) {
+		unsigned int *index = (unsigned int *)(entityData + c->offset);
+		_sparseIntegerSet_insert(diana, &c->freeDataIndexes, *index);
+		_count(diana, _componentCounter(diana, c, 2), 1);
+		*index = 0;
+	}
+
+	return _componentRemoved(diana, entity, component);
+}
+
 static int _removeComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i) {
 	unsigned char *entityData = _getEntityData(diana, entity);
 	struct _component *c = diana->components + component;
+	struct _componentBag *bag;
+	int err;
+
+	if(!_bits_isSet(entityData, component)) {
+		return DL_ERROR_NONE;
+	}
+
+	// the component stays defined while instances are left
+	bag = (struct _componentBag *)(entityData + c->offset);
+	if(!(c->flags & DL_COMPONENT_MULTIPLE_BIT) || (i == 0 && bag->count == 1)) {
+		return _removeComponent(diana, entity, component);
+	}
+
+	if(i >= bag->count) {
+		return DL_ERROR_NONE;
+	}
+
+	_touch(diana, entity);
+
+	_sparseIntegerSet_insert(diana, &c->freeDataIndexes, bag->indexes[i]);
+	_count(diana, _componentCounter(diana, c, 2), 1);
+	memmove(bag->indexes + i, bag->indexes + i + 1, (bag->count - i - 1) * sizeof(unsigned int));
+	err = _realloc(diana, bag->indexes, sizeof(unsigned int) * bag->count, sizeof(unsigned int) * (bag->count - 1), (void **)&bag->indexes);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+	bag->count--;
+
+	return _componentRemoved(diana, entity, component);
+}
+
+// hand pool slots back in one go, the free set is grown once up front and
+// slots are known not to be in it already
+static int _component_releaseIndexes(struct diana *diana, struct _component *c, const unsigned int *indexes, unsigned int count) {
+	struct _sparseIntegerSet *is = &c->freeDataIndexes;
+	unsigned int i;
+
+	if(c->nextDataIndex > is->capacity) {
+		int err = _realloc(diana, is->dense, is->capacity * sizeof(unsigned int), c->nextDataIndex * sizeof(unsigned int), (void **)&is->dense);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		err = _realloc(diana, is->sparse, is->capacity * sizeof(unsigned int), c->nextDataIndex * sizeof(unsigned int), (void **)&is->sparse);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		is->capacity = c->nextDataIndex;
+	}
+
+	for(i = 0; i < count; i++) {
+		is->sparse[indexes[i]] = is->population;
+		is->dense[is->population++] = indexes[i];
+	}
+	_count(diana, _componentCounter(diana, c, 2), count);
+
+	return DL_ERROR_NONE;
+}
+
+// tear down every component of an entity, only looking at the bits that are
+// set instead of going through the public remove calls per component
+static int _removeAllComponents(struct diana *diana, unsigned int entity) {
+	unsigned char *entityData = _getEntityData(diana, entity);
+	unsigned int byte, bit, n = (diana->num_components + 7) >> 3;
 	int err = DL_ERROR_NONE;
 
-	if(!_bits_clear(entityData, component)) {
-		return err;
+	_touch(diana, entity);
+
+	for(byte = 0; byte < n; byte++) {
+		unsigned int bits = entityData[byte];
+
+		for(bit = byte << 3; bits; bits >>= 1, bit++) {
+			struct _component *c;
+
+			if(!(bits & 1)) {
+				continue;
+			}
+
+			c = diana->components + bit;
+#if DL_COMPUTE
+			if(c->compute) {
+				_clearDirty(diana, entity, c);
+			}
+			if(_invalidate(diana, entity, bit) != DL_ERROR_NONE) {
+				err = DL_ERROR_OUT_OF_MEMORY;
+			}
+#endif
+			if(_queueEvent(diana, c, DL_COMPONENT_EVENT_REMOVED, entity) != DL_ERROR_NONE) {
+				err = DL_ERROR_OUT_OF_MEMORY;
+			}
+			if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+				struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+				if(_component_releaseIndexes(diana, c, bag->indexes, bag->count) != DL_ERROR_NONE) {
+					err = DL_ERROR_OUT_OF_MEMORY;
+				}
+				_free(diana, bag->indexes);
+				bag->indexes = NULL;
+				bag->count = 0;
+			} else if(c->flags & DL_COMPONENT_INDEXED_BIT) {
+				unsigned int *index = (unsigned int *)(entityData + c->offset);
+				if(_component_releaseIndexes(diana, c, index, 1) != DL_ERROR_NONE) {
+					err = DL_ERROR_OUT_OF_MEMORY;
+				}
+				*index = 0;
+			}
+		}
+
+		entityData[byte] = 0;
+	}
+
+	return err;
+}
+
+// bags are the only per entity allocations, free them by walking just the
+// multiple component columns
+static void _freeBags(struct diana *diana) {
+	struct _component *c;
+	unsigned int ci, entity, n = diana->dataHeight > diana->staleHeight ? diana->dataHeight : diana->staleHeight;
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		if(!(c->flags & DL_COMPONENT_MULTIPLE_BIT)) {
+			continue;
+		}
+		for(entity = 0; entity < n; entity++) {
+			struct _componentBag *bag = (struct _componentBag *)(_getEntityData(diana, entity) + c->offset);
+			_free(diana, bag->indexes);
+			bag->indexes = NULL;
+			bag->count = 0;
+		}
+	}
+}
+
+// give rows left by diana_clear their bags back and zero them, they never
+// belong to the processing overflow
+static void _cleanRows(struct diana *diana, unsigned int begin, unsigned int end) {
+	struct _component *c;
+	unsigned int ci, entity;
+
+	// a world without components has no rows
+	if(begin >= end || diana->dataWidth == 0) {
+		return;
+	}
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		if(!(c->flags & DL_COMPONENT_MULTIPLE_BIT)) {
+			continue;
+		}
+		for(entity = begin; entity < end; entity++) {
+			_free(diana, ((struct _componentBag *)(_getEntityData(diana, entity) + c->offset))->indexes);
+		}
+	}
+
+	memset(_getEntityData(diana, begin), 0, diana->dataWidth * (end - begin));
+}
+
+// before the table is rewritten as a whole
+static void _cleanStaleRows(struct diana *diana) {
+	_cleanRows(diana, diana->dataHeight, diana->staleHeight);
+	diana->staleHeight = 0;
+}
+
+int diana_clone(struct diana *diana, unsigned int parentEntity, unsigned int * entity_ptr) {
+	unsigned int newEntity, ci, cbi, cbn;
+	unsigned char *parentEntityData;
+	int err = DL_ERROR_NONE;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && parentEntity >= diana->dataHeight) || (diana->processing && parentEntity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	err = _spawn(diana, &newEntity);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	parentEntityData = _getEntityData(diana, parentEntity);
+
+	for(ci = 0; ci < diana->num_components; ci++) {
+		if(!_bits_isSet(parentEntityData, ci)) {
+			continue;
+		}
+
+		err = diana_getComponentCount(diana, parentEntity, ci, &cbn);
+		if(err != DL_ERROR_NONE) {
+			goto error;
+		}
+
+		for(cbi = 0; cbi < cbn; cbi++) {
+			void *cd = NULL;
+			err = _getComponentI(diana, parentEntity, ci, cbi, &cd);
+			if(err == DL_ERROR_NONE) {
+				err = _setComponentI(diana, newEntity, ci, cbi, cd);
+			}
+			if(err != DL_ERROR_NONE) {
+				goto error;
+			}
+		}
+	}
+
+	_count(diana, DL_COUNTER_SLOT_CLONES, 1);
+	_record_call(diana, DL_RECORD_CLONE, 2, parentEntity, newEntity, 0);
+
+	*entity_ptr = newEntity;
+
+	return DL_ERROR_NONE;
+
+error:
+	// a clone that would share a key in a unique index, or ran out of
+	// memory, is released again and never handed out
+	_stripEntity(diana, newEntity);
+	_releaseEntityId(diana, newEntity);
+	return err;
+}
+
+// ============================================================================
+// prefab
+int diana_createPrefab(struct diana *diana, unsigned int entity, unsigned int * prefab_ptr) {
+	struct _prefab p;
+	struct _component *c;
+	unsigned char *entityData, *dst;
+	size_t dataSize = 0;
+	unsigned int ci, i, prefab;
+	int err = DL_ERROR_NONE;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	entityData = _getEntityData(diana, entity);
+
+	memset(&p, 0, sizeof(p));
+	p.used = 1;
+
+	err = _malloc(diana, diana->dataWidth, (void **)&p.row);
+	if(err != DL_ERROR_NONE) {
+		goto error;
+	}
+	memcpy(p.row, entityData, diana->dataWidth);
+
+	err = _malloc(diana, sizeof(unsigned int) * (diana->num_components + 1), (void **)&p.counts);
+	if(err != DL_ERROR_NONE) {
+		goto error;
+	}
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		if(!(c->flags & DL_COMPONENT_INDEXED_BIT)) {
+			continue;
+		}
+
+		// the row never owns pool slots, instances get their own on instantiate
+		memset(p.row + c->offset, 0, c->flags & DL_COMPONENT_MULTIPLE_BIT ? sizeof(struct _componentBag) : sizeof(unsigned int));
+
+		if(!_bits_isSet(entityData, ci)) {
+			continue;
+		}
+
+		if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+			p.counts[ci] = ((struct _componentBag *)(entityData + c->offset))->count;
+		} else {
+			p.counts[ci] = 1;
+		}
+		dataSize += c->size * p.counts[ci];
+	}
+
+	if(dataSize) {
+		err = _malloc(diana, dataSize, (void **)&p.data);
+		if(err != DL_ERROR_NONE) {
+			goto error;
+		}
+	}
+
+	dst = p.data;
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		for(i = 0; i < p.counts[ci]; i++) {
+			unsigned int index;
+			if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+				index = ((struct _componentBag *)(entityData + c->offset))->indexes[i];
+			} else {
+				index = *(unsigned int *)(entityData + c->offset);
+			}
+			memcpy(dst, _component_slot(c, index), c->size);
+			dst += c->size;
+		}
+	}
+
+	if(_sparseIntegerSet_isEmpty(diana, &diana->freePrefabIds)) {
+		err = _realloc(diana, diana->prefabs, sizeof(*diana->prefabs) * diana->num_prefabs, sizeof(*diana->prefabs) * (diana->num_prefabs + 1), (void **)&diana->prefabs);
+		if(err != DL_ERROR_NONE) {
+			goto error;
+		}
+		prefab = diana->num_prefabs++;
+	} else {
+		prefab = _sparseIntegerSet_pop(diana, &diana->freePrefabIds);
+	}
+	diana->prefabs[prefab] = p;
+
+	*prefab_ptr = prefab;
+
+	_record_call(diana, DL_RECORD_CREATE_PREFAB, 2, entity, prefab, 0);
+
+	return err;
+
+error:
+	_prefab_free(diana, &p);
+	return err;
+}
+
+static int _instantiate(struct diana *diana, struct _prefab *p, unsigned int entity) {
+	unsigned char *entityData = _getEntityData(diana, entity);
+	const unsigned char *src = p->data;
+	struct _component *c;
+	unsigned int ci, i;
+	int err = DL_ERROR_NONE;
+
+	// an instance whose key another entity holds in a unique index fails
+	// before anything is written, inline values are in the captured row
+	if(diana->num_keyIndexes) {
+		FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+			const unsigned char *value = p->counts[ci] ? src : p->row + c->offset;
+
+			if(_bits_isSet(p->row, ci) && _keys_taken(diana, entity, ci, value)) {
+				_releaseEntityId(diana, entity);
+				return DL_ERROR_INVALID_VALUE;
+			}
+			src += c->size * p->counts[ci];
+		}
+		src = p->data;
+	}
+
+	memcpy(entityData, p->row, diana->dataWidth);
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		struct _componentBag *bag = NULL;
+		unsigned int *indexes;
+
+		if(!p->counts[ci]) {
+			continue;
+		}
+
+		err = _component_reserve(diana, c, p->counts[ci]);
+		if(err != DL_ERROR_NONE) {
+			break;
+		}
+
+		if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+			bag = (struct _componentBag *)(entityData + c->offset);
+			err = _malloc(diana, sizeof(unsigned int) * p->counts[ci], (void **)&bag->indexes);
+			if(err != DL_ERROR_NONE) {
+				break;
+			}
+			bag->count = p->counts[ci];
+			indexes = bag->indexes;
+		} else {
+			indexes = (unsigned int *)(entityData + c->offset);
+		}
+
+		// can not fail, the slots were reserved above
+		for(i = 0; i < p->counts[ci]; i++) {
+			_getAComponentIndex(diana, c, indexes + i);
+			memcpy(_component_slot(c, indexes[i]), src, c->size);
+			src += c->size;
+		}
+	}
+
+	if(err != DL_ERROR_NONE) {
+		// drop the instances that were made, the entity goes back unused
+		for(; ci < diana->num_components; ci++) {
+			if(p->counts[ci]) {
+				_bits_clear(entityData, ci);
+			}
+		}
+		_stripEntity(diana, entity);
+		_releaseEntityId(diana, entity);
+		return err;
+	}
+
+	// a new instance counts as a change, computed ones wait for a compute
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		if(!_bits_isSet(entityData, ci)) {
+			continue;
+		}
+#if DL_COMPUTE
+		if(c->compute) {
+			_setDirty(diana, entity, ci);
+		}
+#endif
+		if(err == DL_ERROR_NONE) {
+			err = _markChanged(diana, entity, ci);
+		}
+		if(err == DL_ERROR_NONE) {
+			err = _queueEvent(diana, c, DL_COMPONENT_EVENT_ADDED, entity);
+		}
+	}
+
+	if(err != DL_ERROR_NONE) {
+		_stripEntity(diana, entity);
+		_releaseEntityId(diana, entity);
+	}
+
+	return err;
+}
+
+int diana_instantiate(struct diana *diana, unsigned int prefab, unsigned int * entity_ptr) {
+	unsigned int entity;
+	int err;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(prefab >= diana->num_prefabs || !diana->prefabs[prefab].used) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	err = _spawn(diana, &entity);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	// a failed instance is released again and never handed out
+	err = _instantiate(diana, diana->prefabs + prefab, entity);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	*entity_ptr = entity;
+
+	_record_call(diana, DL_RECORD_INSTANTIATE, 2, prefab, entity, 0);
+
+	return err;
+}
+
+int diana_instantiateN(struct diana *diana, unsigned int prefab, unsigned int count, unsigned int * entities_ptr) {
+	struct _prefab *p;
+	struct _component *c;
+	unsigned int ci, i;
+	int err;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(prefab >= diana->num_prefabs || !diana->prefabs[prefab].used) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	p = diana->prefabs + prefab;
+
+	// grow the table and every pool once for the whole batch
+	err = _reserveEntities(diana, count);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	FOREACH_ARRAY(c, ci, diana->components, diana->num_components) {
+		if(p->counts[ci]) {
+			err = _component_reserve(diana, c, p->counts[ci] * count);
+			if(err != DL_ERROR_NONE) {
+				return err;
+			}
+		}
+	}
+
+	for(i = 0; i < count; i++) {
+		err = _spawn(diana, entities_ptr + i);
+		if(err != DL_ERROR_NONE) {
+			break;
+		}
+
+		err = _instantiate(diana, p, entities_ptr[i]);
+		if(err != DL_ERROR_NONE) {
+			break;
+		}
+	}
+
+	// all or nothing, the instances made so far are released again
+	if(err != DL_ERROR_NONE) {
+		while(i--) {
+			_stripEntity(diana, entities_ptr[i]);
+			_releaseEntityId(diana, entities_ptr[i]);
+		}
+		return err;
+	}
+
+	_record_call(diana, DL_RECORD_INSTANTIATE_N, 2, prefab, count, 0);
+
+	return err;
+}
+
+int diana_freePrefab(struct diana *diana, unsigned int prefab) {
+	if(prefab >= diana->num_prefabs || !diana->prefabs[prefab].used) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_record_call(diana, DL_RECORD_FREE_PREFAB, 1, prefab, 0, 0);
+
+	_prefab_free(diana, diana->prefabs + prefab);
+	_sparseIntegerSet_insert(diana, &diana->freePrefabIds, prefab);
+
+	return DL_ERROR_NONE;
+}
+
+// single
+int diana_setComponent(struct diana *diana, unsigned int entity, unsigned int component, const void * data) {
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_record_call(diana, DL_RECORD_SET, 3, entity, component, 0);
+	_record_data(diana, component, data);
+
+	return _setComponentI(diana, entity, component, 0, data);
+}
+
+int diana_getComponent(struct diana *diana, unsigned int entity, unsigned int component, void ** ptr) {
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_record_call(diana, DL_RECORD_GET, 3, entity, component, 0);
+
+	return _getComponentI(diana, entity, component, 0, ptr);
+}
+
+// for writes made in place through the pointer diana_getComponent gave out
+int diana_markChanged(struct diana *diana, unsigned int entity, unsigned int component) {
+	int err;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components || !_bits_isSet(_getEntityData(diana, entity), component)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_record_call(diana, DL_RECORD_MARK_CHANGED, 2, entity, component, 0);
+
+	_touch(diana, entity);
+
+#if DL_COMPUTE
+	err = _invalidate(diana, entity, component);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+#endif
+
+	err = _markChanged(diana, entity, component);
+
+	return err;
+}
+
+#if DL_COMPUTE
+int diana_dirtyComponent(struct diana *diana, unsigned int entity, unsigned int component) {
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(diana->components[component].compute) {
+		_setDirty(diana, entity, component);
+	}
+
+	return _invalidate(diana, entity, component);
+}
+
+int diana_getDirtyCount(struct diana *diana, unsigned int component, unsigned int * count_ptr) {
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(component >= diana->num_components || diana->components[component].compute == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_dirtyList_compact(diana, diana->components + component);
+	*count_ptr = diana->components[component].dirtyCount;
+
+	return DL_ERROR_NONE;
+}
+
+// the list stays owned by diana and is only good until the next call that
+// sets, removes, dirties or computes a component
+int diana_getDirtyEntities(struct diana *diana, unsigned int component, const unsigned int ** entities_ptr, unsigned int * count_ptr) {
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(component >= diana->num_components || diana->components[component].compute == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_dirtyList_compact(diana, diana->components + component);
+	*entities_ptr = diana->components[component].dirtyList;
+	*count_ptr = diana->components[component].dirtyCount;
+
+	return DL_ERROR_NONE;
+}
+
+// mark every instance clean without computing it, for callers that brought
+// the values up to date themselves
+int diana_clearDirty(struct diana *diana, unsigned int component) {
+	struct _component *c;
+	unsigned int i;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(component >= diana->num_components || diana->components[component].compute == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	c = diana->components + component;
+	for(i = 0; i < c->dirtyCount; i++) {
+		_clearDirty(diana, c->dirtyList[i], c);
+	}
+	c->dirtyCount = 0;
+
+	return DL_ERROR_NONE;
+}
+#endif
+
+int diana_removeComponent(struct diana *diana, unsigned int entity, unsigned int component) {
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_record_call(diana, DL_RECORD_REMOVE, 3, entity, component, 0);
+
+	return _removeComponentI(diana, entity, component, 0);
+}
+
+// multiple
+int diana_getComponentCount(struct diana *diana, unsigned int entity, unsigned int component, unsigned int * count_ptr) {
+	unsigned char *entityData;
+	struct _component *c;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	entityData = _getEntityData(diana, entity);
+	c = diana->components + component;
+
+	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+		struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+		*count_ptr = bag->count;
+	} else {
+		*count_ptr = _bits_isSet(entityData, component);
+	}
+
+	return DL_ERROR_NONE;
+}
+
+int diana_appendComponent(struct diana *diana, unsigned int entity, unsigned int component, const void * data) {
+	struct _component *c;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	c = diana->components + component;
+
+	_record_call(diana, DL_RECORD_APPEND, 2, entity, component, 0);
+	_record_data(diana, component, data);
+
+	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+		unsigned int cc = 0;
+		diana_getComponentCount(diana, entity, component, &cc);
+		return _setComponentI(diana, entity, component, cc, data);
+	} else {
+		return _setComponentI(diana, entity, component, 0, data);
+	}
+}
+
+int diana_removeComponents(struct diana *diana, unsigned int entity, unsigned int component) {
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_record_call(diana, DL_RECORD_REMOVE_ALL, 2, entity, component, 0);
+
+	return _removeComponent(diana, entity, component);
+}
+
+// low level
+int diana_setComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i, const void * data) {
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_record_call(diana, DL_RECORD_SET, 3, entity, component, i);
+	_record_data(diana, component, data);
+
+	return _setComponentI(diana, entity, component, i, data);
+}
+
+int diana_getComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i, void ** ptr) {
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_record_call(diana, DL_RECORD_GET, 3, entity, component, i);
+
+	return _getComponentI(diana, entity, component, i, ptr);
+}
+
+int diana_removeComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i) {
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(component >= diana->num_components) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_record_call(diana, DL_RECORD_REMOVE, 3, entity, component, i);
+
+	return _removeComponentI(diana, entity, component, i);
+}
+
+// handle
+int diana_getHandle(struct diana *diana, unsigned int entity, diana_handle * handle_ptr) {
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(entity >= diana->nextEntityId || _sparseIntegerSet_contains(diana, &diana->freeEntityIds, entity)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	*handle_ptr = DL_HANDLE(entity, diana->generations[entity]);
+
+	return DL_ERROR_NONE;
+}
+
+int diana_isAlive(struct diana *diana, diana_handle handle) {
+	unsigned int entity = DL_HANDLE_ENTITY(handle);
+	return entity < diana->nextEntityId && diana->generations[entity] == DL_HANDLE_GENERATION(handle);
+}
+
+int diana_setComponentH(struct diana *diana, diana_handle handle, unsigned int component, const void * data) {
+	if(!diana_isAlive(diana, handle)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	return diana_setComponent(diana, DL_HANDLE_ENTITY(handle), component, data);
+}
+
+int diana_getComponentH(struct diana *diana, diana_handle handle, unsigned int component, void ** ptr) {
+	if(!diana_isAlive(diana, handle)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	return diana_getComponent(diana, DL_HANDLE_ENTITY(handle), component, ptr);
+}
+
+int diana_removeComponentH(struct diana *diana, diana_handle handle, unsigned int component) {
+	if(!diana_isAlive(diana, handle)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	return diana_removeComponent(diana, DL_HANDLE_ENTITY(handle), component);
+}
+
+// ============================================================================
+// SAVE / LOAD
+// a native endian binary image of the world. the schema goes first, names
+// and sizes of the components and names of the systems, and has to match the
+// world it is loaded into. rows and pools are written as they are in memory,
+// bags are the only thing that needs fixing up on the way back
+#define DL_SAVE_MAGIC   0x57414944
+#define DL_SAVE_VERSION 1
+
+// errors stick, once a call fails the rest do nothing
+struct _stream {
+	int (*write)(void *, const void *, size_t);
+	int (*read)(void *, void *, size_t);
+	void *userData;
+	int err;
+};
+
+static void _stream_write(struct _stream *stream, const void *data, size_t size) {
+	if(stream->err == DL_ERROR_NONE && size && stream->write(stream->userData, data, size)) {
+		stream->err = DL_ERROR_IO;
+	}
+}
+
+static void _stream_read(struct _stream *stream, void *data, size_t size) {
+	if(stream->err == DL_ERROR_NONE && size && stream->read(stream->userData, data, size)) {
+		stream->err = DL_ERROR_IO;
+	}
+}
+
+static void _stream_writeUInt(struct _stream *stream, unsigned int i) {
+	_stream_write(stream, &i, sizeof(i));
+}
+
+static unsigned int _stream_readUInt(struct _stream *stream) {
+	unsigned int i = 0;
+	_stream_read(stream, &i, sizeof(i));
+	return i;
+}
+
+static void _stream_writeString(struct _stream *stream, const char *string) {
+	unsigned int length = strlen(string);
+	_stream_writeUInt(stream, length);
+	_stream_write(stream, string, length);
+}
+
+// compare against what is expected instead of allocating the string
+static int _stream_matchString(struct _stream *stream, const char *string) {
+	unsigned int length = _stream_readUInt(stream), i;
+	int match = stream->err == DL_ERROR_NONE && length == strlen(string);
+
+	for(i = 0; match && i < length; i++) {
+		char c = 0;
+		_stream_read(stream, &c, 1);
+		match = stream->err == DL_ERROR_NONE && c == string[i];
+	}
+
+	return match;
+}
+
+// elements in dense order, so ids come back off the set in the same order
+static void _stream_writeSparseSet(struct _stream *stream, struct _sparseIntegerSet *is) {
+	_stream_writeUInt(stream, is->population);
+	_stream_write(stream, is->dense, sizeof(unsigned int) * is->population);
+}
+
+static void _stream_readSparseSet(struct diana *diana, struct _stream *stream, struct _sparseIntegerSet *is, unsigned int limit) {
+	unsigned int count = _stream_readUInt(stream), i;
+
+	for(i = 0; i < count && stream->err == DL_ERROR_NONE; i++) {
+		unsigned int e = _stream_readUInt(stream);
+		if(e >= limit) {
+			stream->err = DL_ERROR_INVALID_VALUE;
+			break;
+		}
+		_sparseIntegerSet_insert(diana, is, e);
+	}
+}
+
+// the first 'n' bits
+static void _stream_writeDenseSet(struct _stream *stream, struct _denseIntegerSet *is, unsigned int n) {
+	unsigned int byte;
+
+	for(byte = 0; byte < ((n + 7) >> 3); byte++) {
+		unsigned char bits = (byte << 3) < is->capacity ? is->bytes[byte] : 0;
+		if((byte + 1) << 3 > n) {
+			bits &= (1 << (n & 7)) - 1;
+		}
+		_stream_write(stream, &bits, 1);
+	}
+}
+
+static void _stream_readDenseSet(struct diana *diana, struct _stream *stream, struct _denseIntegerSet *is, unsigned int n) {
+	if(n > is->capacity) {
+		int err = _realloc(diana, is->bytes, (is->capacity + 7) >> 3, (n + 7) >> 3, (void **)&is->bytes);
+		if(err != DL_ERROR_NONE) {
+			stream->err = err;
+			return;
+		}
+		is->capacity = n;
+	}
+	_stream_read(stream, is->bytes, (n + 7) >> 3);
+}
+
+static void _stream_writeSchema(struct diana *diana, struct _stream *stream) {
+	struct _component *c;
+	struct _system *system;
+	unsigned int i;
+
+	_stream_writeUInt(stream, diana->num_components);
+	_stream_writeUInt(stream, diana->dataWidth);
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		_stream_writeString(stream, c->name);
+		_stream_writeUInt(stream, c->size);
+		_stream_writeUInt(stream, c->flags);
+	}
+
+	_stream_writeUInt(stream, diana->num_systems);
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		_stream_writeString(stream, system->name);
+	}
+}
+
+static int _stream_matchSchema(struct diana *diana, struct _stream *stream) {
+	struct _component *c;
+	struct _system *system;
+	unsigned int i;
+	int match;
+
+	match = _stream_readUInt(stream) == diana->num_components;
+	match = match && _stream_readUInt(stream) == diana->dataWidth;
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		match = match && _stream_matchString(stream, c->name);
+		match = match && _stream_readUInt(stream) == c->size;
+		match = match && _stream_readUInt(stream) == c->flags;
+	}
+	match = match && _stream_readUInt(stream) == diana->num_systems;
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		match = match && _stream_matchString(stream, system->name);
+	}
+
+	return match;
+}
+
+// nothing computed or changed is known about loaded rows
+static int _loadedEntity(struct diana *diana, unsigned int entity) {
+	unsigned char *entityData = _getEntityData(diana, entity);
+	struct _component *c;
+	unsigned int i;
+	int err;
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		if(!_bits_isSet(entityData, i)) {
+			continue;
+		}
+#if DL_COMPUTE
+		if(c->compute) {
+			_setDirty(diana, entity, i);
+		}
+#endif
+		err = _markChanged(diana, entity, i);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	return DL_ERROR_NONE;
+}
+
+static int _loaded(struct diana *diana) {
+	unsigned int entity;
+	int err;
+
+	_spatial_clear(diana);
+	_keys_clear(diana);
+	_hierarchy_clear(diana);
+	for(entity = 0; entity < diana->dataHeight; entity++) {
+		err = _loadedEntity(diana, entity);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	return DL_ERROR_NONE;
+}
+
+static void _save(struct diana *diana, struct _stream *stream) {
+	struct _component *c;
+	struct _system *system;
+	unsigned int i, entity;
+
+	_stream_writeUInt(stream, DL_SAVE_MAGIC);
+	_stream_writeUInt(stream, DL_SAVE_VERSION);
+	_stream_writeSchema(diana, stream);
+
+	_stream_writeUInt(stream, diana->nextEntityId);
+	_stream_writeUInt(stream, diana->dataHeight);
+	_stream_writeUInt(stream, diana->maxGeneration);
+	_stream_write(stream, diana->generations, sizeof(unsigned int) * diana->nextEntityId);
+
+	_stream_writeSparseSet(stream, &diana->freeEntityIds);
+	_stream_writeSparseSet(stream, &diana->added);
+	_stream_writeSparseSet(stream, &diana->enabled);
+	_stream_writeSparseSet(stream, &diana->disabled);
+	_stream_writeSparseSet(stream, &diana->deleted);
+
+	_stream_writeDenseSet(stream, &diana->active, diana->nextEntityId);
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		_stream_writeDenseSet(stream, &system->entities, diana->nextEntityId);
+	}
+
+	_stream_write(stream, diana->data, diana->dataWidth * diana->dataHeight);
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		unsigned int chunk;
+
+		if(!(c->flags & DL_COMPONENT_INDEXED_BIT)) {
+			continue;
+		}
+
+		_stream_writeUInt(stream, c->nextDataIndex);
+		_stream_writeSparseSet(stream, &c->freeDataIndexes);
+		for(chunk = 0; (chunk << DL_POOL_CHUNK_SHIFT) < c->nextDataIndex; chunk++) {
+			unsigned int slots = c->nextDataIndex - (chunk << DL_POOL_CHUNK_SHIFT);
+			_stream_write(stream, c->data[chunk], c->size * (slots < DL_POOL_CHUNK_SIZE ? slots : DL_POOL_CHUNK_SIZE));
+		}
+
+		if(!(c->flags & DL_COMPONENT_MULTIPLE_BIT)) {
+			continue;
+		}
+
+		for(entity = 0; entity < diana->dataHeight; entity++) {
+			unsigned char *entityData = _getEntityData(diana, entity);
+			struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+
+			if(!_bits_isSet(entityData, i)) {
+				continue;
+			}
+			_stream_writeUInt(stream, bag->count);
+			_stream_write(stream, bag->indexes, sizeof(unsigned int) * bag->count);
+		}
+	}
+}
+
+int diana_save(struct diana *diana, int (*write)(void *, const void *, size_t), void *userData) {
+	struct _stream stream = { write, NULL, userData, DL_ERROR_NONE };
+
+	if(!diana->initialized || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(write == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_save(diana, &stream);
+
+	// an open journal keeps going across snapshots, see JOURNAL
+	if(stream.err == DL_ERROR_NONE && diana->journalWrite == NULL) {
+		_resetTouched(diana);
+	}
+
+	return stream.err;
+}
+
+static int _load(struct diana *diana, struct _stream *stream) {
+	struct _component *c;
+	struct _system *system;
+	unsigned int i, entity, nextEntityId, dataHeight, maxGeneration;
+	int err;
+
+	nextEntityId = _stream_readUInt(stream);
+	dataHeight = _stream_readUInt(stream);
+	maxGeneration = _stream_readUInt(stream);
+	if(stream->err != DL_ERROR_NONE) {
+		return stream->err;
+	}
+	if(dataHeight != nextEntityId) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_cleanStaleRows(diana);
+
+	if(nextEntityId > diana->generationsCapacity) {
+		err = _realloc(diana, diana->generations, sizeof(unsigned int) * diana->generationsCapacity, sizeof(unsigned int) * nextEntityId, (void **)&diana->generations);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		diana->generationsCapacity = nextEntityId;
+	}
+	_stream_read(stream, diana->generations, sizeof(unsigned int) * nextEntityId);
+	if(maxGeneration > diana->maxGeneration) {
+		diana->maxGeneration = maxGeneration;
+	}
+
+	if(dataHeight > diana->dataHeightCapacity) {
+		err = _realloc(diana, diana->data, diana->dataWidth * diana->dataHeightCapacity, diana->dataWidth * dataHeight, (void **)&diana->data);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		diana->dataHeightCapacity = dataHeight;
+	}
+
+	_stream_readSparseSet(diana, stream, &diana->freeEntityIds, nextEntityId);
+	if(diana->entityRecycling == DL_ENTITY_RECYCLE_LOWEST) {
+		FOREACH_SPARSEINTSET(entity, i, &diana->freeEntityIds) {
+			_denseIntegerSet_insert(diana, &diana->freeEntityBits, entity);
+		}
+	}
+	_stream_readSparseSet(diana, stream, &diana->added, nextEntityId);
+	_stream_readSparseSet(diana, stream, &diana->enabled, nextEntityId);
+	_stream_readSparseSet(diana, stream, &diana->disabled, nextEntityId);
+	_stream_readSparseSet(diana, stream, &diana->deleted, nextEntityId);
+
+	_stream_readDenseSet(diana, stream, &diana->active, nextEntityId);
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		_stream_readDenseSet(diana, stream, &system->entities, nextEntityId);
+	}
+
+	_stream_read(stream, diana->data, diana->dataWidth * dataHeight);
+	if(stream->err != DL_ERROR_NONE) {
+		return stream->err;
+	}
+	diana->nextEntityId = nextEntityId;
+	diana->dataHeight = dataHeight;
+
+	// the bag pointers read in are meaningless, make them safe to free
+	// before any can fail
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		if(!(c->flags & DL_COMPONENT_MULTIPLE_BIT)) {
+			continue;
+		}
+		for(entity = 0; entity < dataHeight; entity++) {
+			memset(_getEntityData(diana, entity) + c->offset, 0, sizeof(struct _componentBag));
+		}
+	}
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		unsigned int nextDataIndex, chunk;
+
+		if(!(c->flags & DL_COMPONENT_INDEXED_BIT)) {
+			continue;
+		}
+
+		nextDataIndex = _stream_readUInt(stream);
+		if(stream->err != DL_ERROR_NONE) {
+			return stream->err;
+		}
+		err = _component_reserve(diana, c, nextDataIndex);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		c->nextDataIndex = nextDataIndex;
+		_stream_readSparseSet(diana, stream, &c->freeDataIndexes, nextDataIndex);
+		for(chunk = 0; (chunk << DL_POOL_CHUNK_SHIFT) < nextDataIndex; chunk++) {
+			unsigned int slots = nextDataIndex - (chunk << DL_POOL_CHUNK_SHIFT);
+			_stream_read(stream, c->data[chunk], c->size * (slots < DL_POOL_CHUNK_SIZE ? slots : DL_POOL_CHUNK_SIZE));
+		}
+
+		if(!(c->flags & DL_COMPONENT_MULTIPLE_BIT)) {
+			continue;
+		}
+
+		for(entity = 0; entity < dataHeight && stream->err == DL_ERROR_NONE; entity++) {
+			unsigned char *entityData = _getEntityData(diana, entity);
+			struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+			unsigned int count;
+
+			if(!_bits_isSet(entityData, i)) {
+				continue;
+			}
+			count = _stream_readUInt(stream);
+			if(count > nextDataIndex) {
+				return DL_ERROR_INVALID_VALUE;
+			}
+			err = _malloc(diana, sizeof(unsigned int) * count, (void **)&bag->indexes);
+			if(err != DL_ERROR_NONE) {
+				return err;
+			}
+			bag->count = count;
+			_stream_read(stream, bag->indexes, sizeof(unsigned int) * count);
+		}
+	}
+	if(stream->err != DL_ERROR_NONE) {
+		return stream->err;
+	}
+
+	return _loaded(diana);
+}
+
+// replaces everything in the world, no callbacks are run for the entities
+// that go or come
+int diana_load(struct diana *diana, int (*read)(void *, void *, size_t), void *userData) {
+	struct _stream stream = { NULL, read, userData, DL_ERROR_NONE };
+	int match;
+	int err;
+
+	if(!diana->initialized || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(read == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	// nothing is touched until the schema is known to match
+	match = _stream_readUInt(&stream) == DL_SAVE_MAGIC;
+	match = match && _stream_readUInt(&stream) == DL_SAVE_VERSION;
+	match = match && _stream_matchSchema(diana, &stream);
+	if(stream.err != DL_ERROR_NONE) {
+		return stream.err;
+	}
+	if(!match) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	err = diana_clear(diana);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	err = _load(diana, &stream);
+	if(err != DL_ERROR_NONE) {
+		diana_clear(diana);
+	} else {
+		_resetTouched(diana);
+		_undo_reset(diana);
+		diana->journalWrite = NULL;
+		_record_stop(diana);
+	}
+
+	return err;
+}
+
+// ============================================================================
+// IMAGES
+// an image is laid out to be used where it lies. a header read like a save
+// comes first, then each part on its own DL_IMAGE_ALIGN boundary, in order:
+// generations, active bits, each system's entity bits, rows, each indexed
+// component's slots in whole chunks, each multiple component's bag indexes.
+// in the image a bag holds the offset of its indexes instead of a pointer
+#define DL_IMAGE_MAGIC   0x474d4944
+#define DL_IMAGE_VERSION 1
+#define DL_IMAGE_ALIGN   4096
+
+struct _imageReader {
+	const unsigned char *image;
+	size_t size;
+	size_t pos;
+};
+
+static int _imageReader_read(void *userData, void *data, size_t size) {
+	struct _imageReader *reader = (struct _imageReader *)userData;
+	if(size > reader->size - reader->pos) {
+		return 1;
+	}
+	memcpy(data, reader->image + reader->pos, size);
+	reader->pos += size;
+	return 0;
+}
+
+static int _countBytes(void *userData, const void *data, size_t size) {
+	*(size_t *)userData += size;
+	return 0;
+}
+
+static size_t _image_align(size_t pos) {
+	return (pos + DL_IMAGE_ALIGN - 1) & ~(size_t)(DL_IMAGE_ALIGN - 1);
+}
+
+// where each part starts, 'offsets' has 3 + num_systems + 2 * num_components
+// entries: generations, active, the systems, rows, then a slab and an index
+// part per component, left 0 where a component has none. returns the size
+static size_t _image_layout(struct diana *diana, size_t pos, unsigned int n, const unsigned int *slots, const unsigned int *indexes, size_t *offsets) {
+	unsigned int S = diana->num_systems, C = diana->num_components, i;
+
+	offsets[0] = pos = _image_align(pos);
+	pos += sizeof(unsigned int) * n;
+	offsets[1] = pos = _image_align(pos);
+	pos += (n + 7) >> 3;
+	for(i = 0; i < S; i++) {
+		offsets[2 + i] = pos = _image_align(pos);
+		pos += (n + 7) >> 3;
+	}
+	offsets[2 + S] = pos = _image_align(pos);
+	pos += (size_t)diana->dataWidth * n;
+	for(i = 0; i < C; i++) {
+		offsets[3 + S + i] = 0;
+		if(slots[i]) {
+			offsets[3 + S + i] = pos = _image_align(pos);
+			pos += diana->components[i].size * slots[i];
+		}
+	}
+	for(i = 0; i < C; i++) {
+		offsets[3 + S + C + i] = 0;
+		if(indexes[i]) {
+			offsets[3 + S + C + i] = pos = _image_align(pos);
+			pos += sizeof(unsigned int) * indexes[i];
+		}
+	}
+
+	return pos;
+}
+
+static void _image_writeHeader(struct diana *diana, struct _stream *stream, const unsigned int *slots, const unsigned int *indexes) {
+	struct _component *c;
+	unsigned int i;
+
+	_stream_writeUInt(stream, DL_IMAGE_MAGIC);
+	_stream_writeUInt(stream, DL_IMAGE_VERSION);
+	_stream_writeSchema(diana, stream);
+
+	_stream_writeUInt(stream, diana->nextEntityId);
+	_stream_writeUInt(stream, diana->maxGeneration);
+	_stream_writeSparseSet(stream, &diana->freeEntityIds);
+	_stream_writeSparseSet(stream, &diana->added);
+	_stream_writeSparseSet(stream, &diana->enabled);
+	_stream_writeSparseSet(stream, &diana->disabled);
+	_stream_writeSparseSet(stream, &diana->deleted);
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		if(!(c->flags & DL_COMPONENT_INDEXED_BIT)) {
+			continue;
+		}
+		_stream_writeUInt(stream, c->nextDataIndex);
+		_stream_writeSparseSet(stream, &c->freeDataIndexes);
+		_stream_writeUInt(stream, slots[i]);
+		if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+			_stream_writeUInt(stream, indexes[i]);
+		}
+	}
+}
+
+static void _stream_pad(struct _stream *stream, size_t *pos, size_t to) {
+	static const unsigned char zeros[64];
+
+	while(*pos < to) {
+		size_t n = to - *pos < sizeof(zeros) ? to - *pos : sizeof(zeros);
+		_stream_write(stream, zeros, n);
+		*pos += n;
+	}
+}
+
+int diana_saveImage(struct diana *diana, int (*write)(void *, const void *, size_t), void *userData) {
+	struct _stream stream = { write, NULL, userData, DL_ERROR_NONE };
+	unsigned int S = diana->num_systems, C = diana->num_components, n = diana->nextEntityId;
+	unsigned int *slots = NULL, *indexes, i, entity;
+	size_t *offsets = NULL, pos = 0, *bagOffsets;
+	unsigned char *row = NULL;
+	struct _component *c;
+	struct _system *system;
+	int err;
+
+	if(!diana->initialized || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(write == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	err = _malloc(diana, sizeof(unsigned int) * 2 * (C + 1), (void **)&slots);
+	if(err == DL_ERROR_NONE) {
+		err = _malloc(diana, sizeof(size_t) * (3 + S + 3 * C), (void **)&offsets);
+	}
+	if(err == DL_ERROR_NONE) {
+		err = _malloc(diana, diana->dataWidth, (void **)&row);
+	}
+	if(err != DL_ERROR_NONE) {
+		_free(diana, slots);
+		_free(diana, offsets);
+		return err;
+	}
+	indexes = slots + C + 1;
+	bagOffsets = offsets + 3 + S + 2 * C;
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		if(c->flags & DL_COMPONENT_INDEXED_BIT) {
+			slots[i] = ((c->nextDataIndex + DL_POOL_CHUNK_SIZE - 1) >> DL_POOL_CHUNK_SHIFT) << DL_POOL_CHUNK_SHIFT;
+		}
+		if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+			for(entity = 0; entity < n; entity++) {
+				unsigned char *entityData = _getEntityData(diana, entity);
+				if(_bits_isSet(entityData, i)) {
+					indexes[i] += ((struct _componentBag *)(entityData + c->offset))->count;
+				}
+			}
+		}
+	}
+
+	{
+		struct _stream counter = { _countBytes, NULL, &pos, DL_ERROR_NONE };
+		_image_writeHeader(diana, &counter, slots, indexes);
+	}
+	_image_layout(diana, pos, n, slots, indexes, offsets);
+	_image_writeHeader(diana, &stream, slots, indexes);
+
+	_stream_pad(&stream, &pos, offsets[0]);
+	_stream_write(&stream, diana->generations, sizeof(unsigned int) * n);
+	pos += sizeof(unsigned int) * n;
+
+	_stream_pad(&stream, &pos, offsets[1]);
+	_stream_writeDenseSet(&stream, &diana->active, n);
+	pos += (n + 7) >> 3;
+
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		_stream_pad(&stream, &pos, offsets[2 + i]);
+		_stream_writeDenseSet(&stream, &system->entities, n);
+		pos += (n + 7) >> 3;
+	}
+
+	// rows go out one at a time with bag pointers swapped for offsets
+	_stream_pad(&stream, &pos, offsets[2 + S]);
+	for(i = 0; i < C; i++) {
+		bagOffsets[i] = offsets[3 + S + C + i];
+	}
+	for(entity = 0; entity < n; entity++) {
+		memcpy(row, _getEntityData(diana, entity), diana->dataWidth);
+		FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+			struct _componentBag *bag = (struct _componentBag *)(row + c->offset);
+			if(!(c->flags & DL_COMPONENT_MULTIPLE_BIT)) {
+				continue;
+			}
+			if(_bits_isSet(row, i)) {
+				bag->indexes = (unsigned int *)bagOffsets[i];
+				bagOffsets[i] += sizeof(unsigned int) * bag->count;
+			} else {
+				bag->indexes = NULL;
+			}
+		}
+		_stream_write(&stream, row, diana->dataWidth);
+	}
+	pos += (size_t)diana->dataWidth * n;
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		unsigned int chunk;
+
+		if(!slots[i]) {
+			continue;
+		}
+		_stream_pad(&stream, &pos, offsets[3 + S + i]);
+		for(chunk = 0; (chunk << DL_POOL_CHUNK_SHIFT) < c->nextDataIndex; chunk++) {
+			unsigned int used = c->nextDataIndex - (chunk << DL_POOL_CHUNK_SHIFT);
+			used = used < DL_POOL_CHUNK_SIZE ? used : DL_POOL_CHUNK_SIZE;
+			_stream_write(&stream, c->data[chunk], c->size * used);
+			pos += c->size * used;
+		}
+		// unused slots of the last chunk
+		_stream_pad(&stream, &pos, offsets[3 + S + i] + c->size * slots[i]);
+	}
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		if(!indexes[i]) {
+			continue;
+		}
+		_stream_pad(&stream, &pos, offsets[3 + S + C + i]);
+		for(entity = 0; entity < n; entity++) {
+			unsigned char *entityData = _getEntityData(diana, entity);
+			struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+			if(_bits_isSet(entityData, i)) {
+				_stream_write(&stream, bag->indexes, sizeof(unsigned int) * bag->count);
+				pos += sizeof(unsigned int) * bag->count;
+			}
+		}
+	}
+
+	_free(diana, row);
+	_free(diana, offsets);
+	_free(diana, slots);
+
+	if(stream.err == DL_ERROR_NONE && diana->journalWrite == NULL) {
+		_resetTouched(diana);
+	}
+
+	return stream.err;
+}
+
+static int _loadImage(struct diana *diana, struct _imageReader *reader) {
+	struct _stream stream = { NULL, _imageReader_read, reader, DL_ERROR_NONE };
+	unsigned int S = diana->num_systems, C = diana->num_components, n, maxGeneration;
+	unsigned int *slots = NULL, *indexes, i, entity;
+	size_t *offsets = NULL;
+	struct _component *c;
+	struct _system *system;
+	int err;
+
+	_cleanStaleRows(diana);
+
+	n = _stream_readUInt(&stream);
+	maxGeneration = _stream_readUInt(&stream);
+	_stream_readSparseSet(diana, &stream, &diana->freeEntityIds, n);
+	if(diana->entityRecycling == DL_ENTITY_RECYCLE_LOWEST) {
+		FOREACH_SPARSEINTSET(entity, i, &diana->freeEntityIds) {
+			_denseIntegerSet_insert(diana, &diana->freeEntityBits, entity);
+		}
+	}
+	_stream_readSparseSet(diana, &stream, &diana->added, n);
+	_stream_readSparseSet(diana, &stream, &diana->enabled, n);
+	_stream_readSparseSet(diana, &stream, &diana->disabled, n);
+	_stream_readSparseSet(diana, &stream, &diana->deleted, n);
+
+	err = _malloc(diana, sizeof(unsigned int) * 2 * (C + 1), (void **)&slots);
+	if(err == DL_ERROR_NONE) {
+		err = _malloc(diana, sizeof(size_t) * (3 + S + 2 * C), (void **)&offsets);
+	}
+	if(err != DL_ERROR_NONE) {
+		_free(diana, slots);
+		return err;
+	}
+	indexes = slots + C + 1;
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		if(!(c->flags & DL_COMPONENT_INDEXED_BIT)) {
+			continue;
+		}
+		c->nextDataIndex = _stream_readUInt(&stream);
+		_stream_readSparseSet(diana, &stream, &c->freeDataIndexes, c->nextDataIndex);
+		slots[i] = _stream_readUInt(&stream);
+		if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+			indexes[i] = _stream_readUInt(&stream);
+		}
+		if(slots[i] < c->nextDataIndex || (slots[i] & (DL_POOL_CHUNK_SIZE - 1))) {
+			stream.err = DL_ERROR_INVALID_VALUE;
+		}
+	}
+
+	err = stream.err;
+	if(err == DL_ERROR_NONE && _image_layout(diana, reader->pos, n, slots, indexes, offsets) > reader->size) {
+		err = DL_ERROR_INVALID_VALUE;
+	}
+	if(err != DL_ERROR_NONE) {
+		_free(diana, offsets);
+		_free(diana, slots);
+		return err;
+	}
+
+	// from here the world points into the image
+	diana->image = (unsigned char *)reader->image;
+	diana->imageSize = reader->size;
+
+	_free(diana, diana->generations);
+	diana->generations = (unsigned int *)(diana->image + offsets[0]);
+	diana->generationsCapacity = n;
+	if(maxGeneration > diana->maxGeneration) {
+		diana->maxGeneration = maxGeneration;
+	}
+
+	_free(diana, diana->active.bytes);
+	diana->active.bytes = diana->image + offsets[1];
+	diana->active.capacity = n;
+
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		_free(diana, system->entities.bytes);
+		system->entities.bytes = diana->image + offsets[2 + i];
+		system->entities.capacity = n;
+	}
+
+	_free(diana, diana->data);
+	diana->data = diana->image + offsets[2 + S];
+	diana->dataHeightCapacity = n;
+	diana->dataHeight = n;
+	diana->nextEntityId = n;
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		unsigned int chunk, numDataChunks = slots[i] >> DL_POOL_CHUNK_SHIFT;
+
+		if(!(c->flags & DL_COMPONENT_INDEXED_BIT)) {
+			continue;
+		}
+
+		for(chunk = 0; chunk < c->numDataChunks; chunk++) {
+			_free(diana, c->data[chunk]);
+		}
+		c->numDataChunks = 0;
+		err = _realloc(diana, c->data, 0, sizeof(void *) * numDataChunks, (void **)&c->data);
+		if(err != DL_ERROR_NONE) {
+			break;
+		}
+		for(chunk = 0; chunk < numDataChunks; chunk++) {
+			c->data[chunk] = diana->image + offsets[3 + S + i] + ((c->size * chunk) << DL_POOL_CHUNK_SHIFT);
+		}
+		c->numDataChunks = numDataChunks;
+	}
+
+	// point bags back at their indexes, rows that have none stay untouched
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		size_t begin = offsets[3 + S + C + i], end = begin + sizeof(unsigned int) * indexes[i];
+
+		if(err != DL_ERROR_NONE || !(c->flags & DL_COMPONENT_MULTIPLE_BIT)) {
+			continue;
+		}
+
+		for(entity = 0; entity < n; entity++) {
+			unsigned char *entityData = _getEntityData(diana, entity);
+			struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+			size_t offset = (size_t)bag->indexes;
+
+			if(!_bits_isSet(entityData, i)) {
+				continue;
+			}
+			if(offset < begin || offset > end || bag->count > (end - offset) / sizeof(unsigned int)) {
+				err = DL_ERROR_INVALID_VALUE;
+				break;
+			}
+			bag->indexes = (unsigned int *)(diana->image + offset);
+		}
+	}
+
+	_free(diana, offsets);
+	_free(diana, slots);
+
+	if(err != DL_ERROR_NONE) {
+		// some bags may still hold offsets, none of them own memory yet
+		FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+			if(!(c->flags & DL_COMPONENT_MULTIPLE_BIT)) {
+				continue;
+			}
+			for(entity = 0; entity < n; entity++) {
+				memset(_getEntityData(diana, entity) + c->offset, 0, sizeof(struct _componentBag));
+			}
+		}
+		return err;
+	}
+
+	return _loaded(diana);
+}
+
+// start the world from an image made by diana_saveImage without copying it.
+// the image is borrowed until diana_free and is written to where the world
+// changes, so map it private and writable to get copy on write pages
+int diana_loadImage(struct diana *diana, void *image, size_t size) {
+	struct _imageReader reader = { (const unsigned char *)image, size, 0 };
+	struct _stream stream = { NULL, _imageReader_read, &reader, DL_ERROR_NONE };
+	int match;
+	int err;
+
+	if(!diana->initialized || diana->processing || diana->image != NULL) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(image == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	match = _stream_readUInt(&stream) == DL_IMAGE_MAGIC;
+	match = match && _stream_readUInt(&stream) == DL_IMAGE_VERSION;
+	match = match && _stream_matchSchema(diana, &stream);
+	if(!match || stream.err != DL_ERROR_NONE) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	err = diana_clear(diana);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	err = _loadImage(diana, &reader);
+	if(err != DL_ERROR_NONE) {
+		diana_clear(diana);
+	} else {
+		_resetTouched(diana);
+		_undo_reset(diana);
+		diana->journalWrite = NULL;
+		_record_stop(diana);
+	}
+
+	return err;
+}
+
+// ============================================================================
+// DELTAS
+// the entities touched since the last snapshot, each written whole: its
+// generation, state, subscriptions and component values. pool indexes are
+// not written, applying a delta puts values wherever the target has room
+#define DL_DELTA_MAGIC   0x4c454444
+#define DL_DELTA_VERSION 1
+
+#define DL_DELTA_FREE   1
+#define DL_DELTA_ACTIVE 2
+
+static void _delta_writeHeader(struct diana *diana, struct _stream *stream) {
+	_stream_writeUInt(stream, diana->nextEntityId);
+	_stream_writeUInt(stream, diana->maxGeneration);
+	_stream_writeSparseSet(stream, &diana->freeEntityIds);
+	_stream_writeSparseSet(stream, &diana->added);
+	_stream_writeSparseSet(stream, &diana->enabled);
+	_stream_writeSparseSet(stream, &diana->disabled);
+	_stream_writeSparseSet(stream, &diana->deleted);
+}
+
+static void _delta_writeEntity(struct diana *diana, struct _stream *stream, unsigned int entity) {
+	unsigned char *entityData = _getEntityData(diana, entity);
+	unsigned char flags = 0, bits;
+	struct _component *c;
+	struct _system *system;
+	unsigned int i;
+
+	if(_sparseIntegerSet_contains(diana, &diana->freeEntityIds, entity)) {
+		flags |= DL_DELTA_FREE;
+	}
+	if(_denseIntegerSet_contains(diana, &diana->active, entity)) {
+		flags |= DL_DELTA_ACTIVE;
+	}
+
+	_stream_writeUInt(stream, entity);
+	_stream_writeUInt(stream, diana->generations[entity]);
+	_stream_write(stream, &flags, 1);
+
+	bits = 0;
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		if(_denseIntegerSet_contains(diana, &system->entities, entity)) {
+			bits |= 1 << (i & 7);
+		}
+		if((i & 7) == 7 || i + 1 == diana->num_systems) {
+			_stream_write(stream, &bits, 1);
+			bits = 0;
+		}
+	}
+
+	_stream_write(stream, entityData, (diana->num_components + 7) >> 3);
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		if(!_bits_isSet(entityData, i)) {
+			continue;
+		}
+
+		if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+			struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+			unsigned int k;
+
+			_stream_writeUInt(stream, bag->count);
+			for(k = 0; k < bag->count; k++) {
+				_stream_write(stream, _component_slot(c, bag->indexes[k]), c->size);
+			}
+		} else if(c->flags & DL_COMPONENT_INDEXED_BIT) {
+			_stream_write(stream, _component_slot(c, *(unsigned int *)(entityData + c->offset)), c->size);
+		} else {
+			_stream_write(stream, entityData + c->offset, c->size);
+		}
+	}
+}
+
+// write what changed since the last diana_save, diana_saveImage, diana_load,
+// diana_loadImage or diana_saveDelta and start the next delta from here
+// everything touched since the last reset, what _applyDelta reads
+static void _delta_writeBody(struct diana *diana, struct _stream *stream) {
+	unsigned int i, count = 0;
+
+	for(i = 0; i < diana->touchedCount; i++) {
+		count += diana->touchedList[i] < diana->nextEntityId;
+	}
+
+	_delta_writeHeader(diana, stream);
+
+	_stream_writeUInt(stream, count);
+	for(i = 0; i < diana->touchedCount; i++) {
+		if(diana->touchedList[i] < diana->nextEntityId) {
+			_delta_writeEntity(diana, stream, diana->touchedList[i]);
+		}
+	}
+}
+
+// the journal owns the touched entities while it is open
+int diana_saveDelta(struct diana *diana, int (*write)(void *, const void *, size_t), void *userData) {
+	struct _stream stream = { write, NULL, userData, DL_ERROR_NONE };
+
+	if(!diana->initialized || diana->processing || !diana->tracking || diana->journalWrite != NULL) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(write == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_stream_writeUInt(&stream, DL_DELTA_MAGIC);
+	_stream_writeUInt(&stream, DL_DELTA_VERSION);
+	_stream_writeSchema(diana, &stream);
+	_delta_writeBody(diana, &stream);
+
+	if(stream.err == DL_ERROR_NONE) {
+		_resetTouched(diana);
+	}
+
+	return stream.err;
+}
+
+// drop an entity's components without telling anyone, its state is about to
+// be replaced as a whole
+static void _stripEntity(struct diana *diana, unsigned int entity) {
+	unsigned char *entityData = _getEntityData(diana, entity);
+	struct _component *c;
+	unsigned int i;
+
+	_spatial_remove(diana, entity);
+	_keys_remove(diana, entity);
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		if(!_bits_isSet(entityData, i)) {
+			continue;
+		}
+
+#if DL_COMPUTE
+		if(c->compute) {
+			_clearDirty(diana, entity, c);
+		}
+		_invalidate(diana, entity, i);
+#endif
+
+		if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+			struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+			_component_releaseIndexes(diana, c, bag->indexes, bag->count);
+			_free(diana, bag->indexes);
+			bag->indexes = NULL;
+			bag->count = 0;
+		} else if(c->flags & DL_COMPONENT_INDEXED_BIT) {
+			unsigned int *index = (unsigned int *)(entityData + c->offset);
+			_component_releaseIndexes(diana, c, index, 1);
+			*index = 0;
+		}
+		_bits_clear(entityData, i);
+	}
+}
+
+static int _delta_readEntity(struct diana *diana, struct _stream *stream, unsigned int n) {
+	unsigned int entity, generation, i;
+	unsigned char flags = 0, bits = 0, *entityData, *mask = NULL;
+	struct _component *c;
+	struct _system *system;
+	int err;
+
+	entity = _stream_readUInt(stream);
+	generation = _stream_readUInt(stream);
+	_stream_read(stream, &flags, 1);
+	if(stream->err != DL_ERROR_NONE) {
+		return stream->err;
+	}
+	if(entity >= n) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_touch(diana, entity);
+
+	diana->generations[entity] = generation;
+	if(generation > diana->maxGeneration) {
+		diana->maxGeneration = generation;
+	}
+
+	if(flags & DL_DELTA_ACTIVE) {
+		_denseIntegerSet_insert(diana, &diana->active, entity);
+	} else {
+		_denseIntegerSet_delete(diana, &diana->active, entity);
+	}
+
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		if((i & 7) == 0) {
+			_stream_read(stream, &bits, 1);
+		}
+		if(bits & (1 << (i & 7))) {
+			_denseIntegerSet_insert(diana, &system->entities, entity);
+		} else {
+			_denseIntegerSet_delete(diana, &system->entities, entity);
+		}
+	}
+
+	_stripEntity(diana, entity);
+
+	entityData = _getEntityData(diana, entity);
+	err = _malloc(diana, (diana->num_components + 7) >> 3, (void **)&mask);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+	_stream_read(stream, mask, (diana->num_components + 7) >> 3);
+
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		if(stream->err != DL_ERROR_NONE || !_bits_isSet(mask, i)) {
+			continue;
+		}
+
+		if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+			struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
+			unsigned int count = _stream_readUInt(stream), k;
+
+			if(stream->err != DL_ERROR_NONE) {
+				continue;
+			}
+			err = count ? _component_reserve(diana, c, count) : DL_ERROR_INVALID_VALUE;
+			if(err == DL_ERROR_NONE) {
+				err = _malloc(diana, sizeof(unsigned int) * count, (void **)&bag->indexes);
+			}
+			if(err != DL_ERROR_NONE) {
+				stream->err = err;
+				continue;
+			}
+			_bits_set(entityData, i);
+			for(k = 0; k < count; k++) {
+				_getAComponentIndex(diana, c, bag->indexes + k);
+				bag->count++;
+				_stream_read(stream, _component_slot(c, bag->indexes[k]), c->size);
+			}
+		} else if(c->flags & DL_COMPONENT_INDEXED_BIT) {
+			unsigned int *index = (unsigned int *)(entityData + c->offset);
+
+			err = _getAComponentIndex(diana, c, index);
+			if(err != DL_ERROR_NONE) {
+				stream->err = err;
+				continue;
+			}
+			_bits_set(entityData, i);
+			_stream_read(stream, _component_slot(c, *index), c->size);
+		} else {
+			_bits_set(entityData, i);
+			_stream_read(stream, entityData + c->offset, c->size);
+		}
+	}
+	_free(diana, mask);
+
+	if(stream->err != DL_ERROR_NONE) {
+		return stream->err;
+	}
+
+	return _loadedEntity(diana, entity);
+}
+
+// the world wide part of a delta. 'exact' takes the generation counter as
+// it was instead of never letting it go back, rewinding wants that
+static int _delta_readHeader(struct diana *diana, struct _stream *stream, int exact, unsigned int *n_ptr) {
+	struct _system *system;
+	unsigned int n, maxGeneration, entity, i;
+	int err;
+
+	n = _stream_readUInt(stream);
+	maxGeneration = _stream_readUInt(stream);
+	if(stream->err != DL_ERROR_NONE) {
+		return stream->err;
+	}
+
+	_cleanStaleRows(diana);
+
+	if(n > diana->dataHeightCapacity) {
+		err = _realloc(diana, diana->data, diana->dataWidth * diana->dataHeightCapacity, diana->dataWidth * n, (void **)&diana->data);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		diana->dataHeightCapacity = n;
+	}
+	if(n > diana->generationsCapacity) {
+		err = _realloc(diana, diana->generations, sizeof(unsigned int) * diana->generationsCapacity, sizeof(unsigned int) * n, (void **)&diana->generations);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		diana->generationsCapacity = n;
+	}
+	if(exact || maxGeneration > diana->maxGeneration) {
+		diana->maxGeneration = maxGeneration;
+	}
+
+	// entities past the new end are gone
+	for(entity = n; entity < diana->dataHeight; entity++) {
+		_stripEntity(diana, entity);
+		_hierarchy_detach(diana, entity);
+		_denseIntegerSet_delete(diana, &diana->active, entity);
+		FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+			_denseIntegerSet_delete(diana, &system->entities, entity);
+		}
+	}
+	diana->dataHeight = n;
+	diana->nextEntityId = n;
+
+	_sparseIntegerSet_clear(diana, &diana->freeEntityIds);
+	_denseIntegerSet_clear(diana, &diana->freeEntityBits);
+	diana->freeEntityHint = 0;
+	_stream_readSparseSet(diana, stream, &diana->freeEntityIds, n);
+	if(diana->entityRecycling == DL_ENTITY_RECYCLE_LOWEST) {
+		FOREACH_SPARSEINTSET(entity, i, &diana->freeEntityIds) {
+			_denseIntegerSet_insert(diana, &diana->freeEntityBits, entity);
+		}
+	}
+	// entities handed out since are free again, and leave the hierarchy
+	if(diana->relations != NULL) {
+		FOREACH_SPARSEINTSET(entity, i, &diana->freeEntityIds) {
+			_hierarchy_detach(diana, entity);
+		}
+	}
+	_sparseIntegerSet_clear(diana, &diana->added);
+	_sparseIntegerSet_clear(diana, &diana->enabled);
+	_sparseIntegerSet_clear(diana, &diana->disabled);
+	_sparseIntegerSet_clear(diana, &diana->deleted);
+	_stream_readSparseSet(diana, stream, &diana->added, n);
+	_stream_readSparseSet(diana, stream, &diana->enabled, n);
+	_stream_readSparseSet(diana, stream, &diana->disabled, n);
+	_stream_readSparseSet(diana, stream, &diana->deleted, n);
+
+	*n_ptr = n;
+
+	return stream->err;
+}
+
+static int _applyDelta(struct diana *diana, struct _stream *stream) {
+	unsigned int n, count, i;
+	int err;
+
+	err = _delta_readHeader(diana, stream, 0, &n);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	count = _stream_readUInt(stream);
+	if(stream->err != DL_ERROR_NONE) {
+		return stream->err;
+	}
+
+	for(i = 0; i < count; i++) {
+		err = _delta_readEntity(diana, stream, n);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// patch the world to match the one that wrote the delta, it has to be at
+// the snapshot the delta was made against. no callbacks are run, and a
+// delta that fails half way leaves the world empty
+int diana_applyDelta(struct diana *diana, int (*read)(void *, void *, size_t), void *userData) {
+	struct _stream stream = { NULL, read, userData, DL_ERROR_NONE };
+	int match;
+	int err;
+
+	if(!diana->initialized || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(read == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	match = _stream_readUInt(&stream) == DL_DELTA_MAGIC;
+	match = match && _stream_readUInt(&stream) == DL_DELTA_VERSION;
+	match = match && _stream_matchSchema(diana, &stream);
+	if(stream.err != DL_ERROR_NONE) {
+		return stream.err;
+	}
+	if(!match) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	err = _applyDelta(diana, &stream);
+	if(err != DL_ERROR_NONE) {
+		diana_clear(diana);
+	} else {
+		_resetTouched(diana);
+		_undo_reset(diana);
+		diana->journalWrite = NULL;
+		_record_stop(diana);
+	}
+
+	return err;
+}
+
+// ============================================================================
+// UNDO
+// an undo log holds a header like a delta's and every entity changed since
+// the log started, as it was when first touched. rollback frames and forks
+// are both undo logs. timers and parent links are not stored in the rows, so
+// every change to them is logged with what it overwrote, and put back newest
+// first
+struct _undoWriter {
+	struct diana *diana;
+	struct _undoLog *log;
+};
+
+static int _undo_write(void *userData, const void *data, size_t size) {
+	struct _undoWriter *writer = (struct _undoWriter *)userData;
+	struct _undoLog *log = writer->log;
+
+	if(log->size + size > log->capacity) {
+		size_t newCapacity = (log->size + size) * 1.5;
+		if(_realloc(writer->diana, log->data, log->capacity, newCapacity, (void **)&log->data) != DL_ERROR_NONE) {
+			return 1;
+		}
+		log->capacity = newCapacity;
+	}
+	memcpy(log->data + log->size, data, size);
+	log->size += size;
+
+	return 0;
+}
+
+static int _undo_begin(struct diana *diana, struct _undoLog *log, struct _undoCaptures *captures) {
+	struct _undoWriter writer = { diana, log };
+	struct _stream stream = { _undo_write, NULL, &writer, DL_ERROR_NONE };
+	unsigned int i;
+
+	for(i = 0; i < captures->count; i++) {
+		_denseIntegerSet_delete(diana, &captures->set, captures->list[i]);
+	}
+	captures->count = 0;
+
+	log->size = 0;
+	log->nextEntityId = diana->nextEntityId;
+	log->num_writes = 0;
+	log->timerNow = diana->timerNow;
+	log->timerDelta = diana->timerDelta;
+	log->nextTimer = diana->nextTimer;
+	log->freeTimers = diana->freeTimers;
+
+	_delta_writeHeader(diana, &stream);
+
+	return stream.err == DL_ERROR_NONE ? DL_ERROR_NONE : DL_ERROR_OUT_OF_MEMORY;
+}
+
+// entities that came after the log started are dropped by its header
+static int _undo_capture(struct diana *diana, struct _undoLog *log, struct _undoCaptures *captures, unsigned int entity) {
+	struct _undoWriter writer = { diana, log };
+	struct _stream stream = { _undo_write, NULL, &writer, DL_ERROR_NONE };
+
+	if(entity >= log->nextEntityId || _denseIntegerSet_insert(diana, &captures->set, entity)) {
+		return DL_ERROR_NONE;
+	}
+
+	if(captures->count >= captures->capacity) {
+		unsigned int newCapacity = (captures->count + 1) * 1.5;
+		if(_realloc(diana, captures->list, sizeof(unsigned int) * captures->capacity, sizeof(unsigned int) * newCapacity, (void **)&captures->list) != DL_ERROR_NONE) {
+			return DL_ERROR_OUT_OF_MEMORY;
+		}
+		captures->capacity = newCapacity;
+	}
+	captures->list[captures->count++] = entity;
+
+	_delta_writeEntity(diana, &stream, entity);
+
+	return stream.err == DL_ERROR_NONE ? DL_ERROR_NONE : DL_ERROR_OUT_OF_MEMORY;
+}
+
+static int _undo_save(struct diana *diana, struct _undoLog *log, unsigned int kind, unsigned int index, const void *old, size_t size) {
+	struct _undoWrite *w;
+
+	if(log->num_writes >= log->writesCapacity) {
+		unsigned int newCapacity = (log->num_writes + 1) * 1.5;
+		if(_realloc(diana, log->writes, sizeof(struct _undoWrite) * log->writesCapacity, sizeof(struct _undoWrite) * newCapacity, (void **)&log->writes) != DL_ERROR_NONE) {
+			return DL_ERROR_OUT_OF_MEMORY;
+		}
+		log->writesCapacity = newCapacity;
+	}
+
+	w = log->writes + log->num_writes++;
+	w->kind = kind;
+	w->index = index;
+	memcpy(&w->old, old, size);
+
+	return DL_ERROR_NONE;
+}
+
+// the writes are put back before the entities, so the side tables are as
+// they were when the entities are
+static void _undo_unwrite(struct diana *diana, struct _undoLog *log) {
+	struct _undoWrite *w;
+	unsigned int i = log->num_writes;
+
+	while(i--) {
+		w = log->writes + i;
+		switch(w->kind) {
+		case DL_UNDO_TIMER:
+			diana->timers[w->index] = w->old.timer;
+			break;
+		case DL_UNDO_WHEEL:
+			diana->timerWheel[w->index] = w->old.head;
+			break;
+		case DL_UNDO_ENTITY_TIMERS:
+			diana->entityTimers[w->index] = w->old.head;
+			break;
+		case DL_UNDO_RELATION:
+			diana->relations[w->index] = w->old.relation;
+			diana->hierarchyDirty = 1;
+			break;
+		}
+	}
+
+	diana->timerNow = log->timerNow;
+	diana->timerDelta = log->timerDelta;
+	diana->nextTimer = log->nextTimer;
+	diana->freeTimers = log->freeTimers;
+}
+
+// the entity ids, generations and free ids come back exactly, so running the
+// same frames again hands out the same entities. no callbacks are run
+static int _undo_apply(struct diana *diana, struct _undoLog *log) {
+	struct _imageReader reader = { log->data, log->size, 0 };
+	struct _stream stream = { NULL, _imageReader_read, &reader, DL_ERROR_NONE };
+	unsigned int n;
+	int err;
+
+	diana->undoing = 1;
+	_undo_unwrite(diana, log);
+	err = _delta_readHeader(diana, &stream, 1, &n);
+	while(err == DL_ERROR_NONE && reader.pos < reader.size) {
+		err = _delta_readEntity(diana, &stream, n);
+	}
+	diana->undoing = 0;
+
+	return err;
+}
+
+static void _capture(struct diana *diana, unsigned int entity) {
+	if(diana->undoing) {
+		return;
+	}
+
+	// a frame that lost an entity can not be gone back to, nor can any before it
+	if(diana->rollbackCount && _undo_capture(diana, diana->rollback + diana->rollbackFrame, &diana->rollbackCaptures, entity) != DL_ERROR_NONE) {
+		diana->rollbackCount = 0;
+	}
+
+	if(diana->forked && diana->forkErr == DL_ERROR_NONE) {
+		diana->forkErr = _undo_capture(diana, &diana->fork, &diana->forkCaptures, entity);
+	}
+}
+
+// 'size' bytes at 'old' are about to be overwritten
+static void _captureWrite(struct diana *diana, unsigned int kind, unsigned int index, const void *old, size_t size) {
+	if(diana->undoing) {
+		return;
+	}
+
+	if(diana->rollbackCount && _undo_save(diana, diana->rollback + diana->rollbackFrame, kind, index, old, size) != DL_ERROR_NONE) {
+		diana->rollbackCount = 0;
+	}
+
+	if(diana->forked && diana->forkErr == DL_ERROR_NONE) {
+		diana->forkErr = _undo_save(diana, &diana->fork, kind, index, old, size);
+	}
+}
+
+static void _undoCaptures_free(struct diana *diana, struct _undoCaptures *captures) {
+	_denseIntegerSet_free(diana, &captures->set);
+	_free(diana, captures->list);
+}
+
+// ============================================================================
+// ROLLBACK
+// new frames start with diana_process and after a rewind. rollbackCount at 0
+// also stops capturing until the next frame
+static int _rollback_begin(struct diana *diana) {
+	int err;
+
+	diana->rollbackFrame = (diana->rollbackFrame + 1) % diana->rollbackFrames;
+
+	err = _undo_begin(diana, diana->rollback + diana->rollbackFrame, &diana->rollbackCaptures);
+	if(err != DL_ERROR_NONE) {
+		diana->rollbackCount = 0;
+		return err;
+	}
+
+	if(diana->rollbackCount < diana->rollbackFrames) {
+		diana->rollbackCount++;
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// the world changed as a whole, there is nothing to go back to
+static void _undo_reset(struct diana *diana) {
+	if(diana->rollbackFrames && diana->rollback != NULL) {
+		diana->rollbackCount = 0;
+		_rollback_begin(diana);
+	}
+
+	diana->forked = 0;
+}
+
+static void _undo_free(struct diana *diana) {
+	unsigned int i;
+
+	if(diana->rollback != NULL) {
+		for(i = 0; i < diana->rollbackFrames; i++) {
+			_free(diana, diana->rollback[i].data);
+			_free(diana, diana->rollback[i].writes);
+		}
+	}
+	_free(diana, diana->rollback);
+	_undoCaptures_free(diana, &diana->rollbackCaptures);
+	_free(diana, diana->fork.data);
+	_free(diana, diana->fork.writes);
+	_undoCaptures_free(diana, &diana->forkCaptures);
+}
+
+// put the world back to how it was when the frame 'frames' frames ago
+// started, newest frame first so the oldest state is the one left
+int diana_rewind(struct diana *diana, unsigned int frames) {
+	unsigned int k;
+	int err = DL_ERROR_NONE;
+
+	if(!diana->initialized || diana->processing || diana->forked || !diana->rollbackFrames) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(frames == 0 || frames > diana->rollbackCount) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_record_call(diana, DL_RECORD_REWIND, 1, frames, 0, 0);
+
+	for(k = 0; k < frames && err == DL_ERROR_NONE; k++) {
+		err = _undo_apply(diana, diana->rollback + diana->rollbackFrame);
+		diana->rollbackFrame = (diana->rollbackFrame + diana->rollbackFrames - 1) % diana->rollbackFrames;
+		diana->rollbackCount--;
+	}
+
+	if(err != DL_ERROR_NONE) {
+		diana_clear(diana);
+		return err;
+	}
+
+	return _rollback_begin(diana);
+}
+
+// ============================================================================
+// FORK
+// a fork runs in the world itself: everything it changes is kept as it was
+// before, the first time it is touched, so starting one costs the same for
+// any world and throwing it away costs what it changed
+int diana_fork(struct diana *diana) {
+	int err;
+
+	if(!diana->initialized || diana->processing || diana->forked) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	_record_call(diana, DL_RECORD_FORK, 0, 0, 0, 0);
+
+	err = _undo_begin(diana, &diana->fork, &diana->forkCaptures);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	diana->forked = 1;
+	diana->forkErr = DL_ERROR_NONE;
+
+	return DL_ERROR_NONE;
+}
+
+// go back to where diana_fork was called. frames run in the fork can not be
+// rewound after
+int diana_discardFork(struct diana *diana) {
+	int err;
+
+	if(!diana->forked || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	_record_call(diana, DL_RECORD_DISCARD_FORK, 0, 0, 0, 0);
+
+	// the fork lost an entity, the world stays as the fork left it
+	if(diana->forkErr != DL_ERROR_NONE) {
+		diana->forked = 0;
+		return diana->forkErr;
+	}
+
+	err = _undo_apply(diana, &diana->fork);
+	if(err != DL_ERROR_NONE) {
+		diana_clear(diana);
+		return err;
+	}
+
+	_undo_reset(diana);
+
+	return DL_ERROR_NONE;
+}
+
+// keep what the fork did as the world
+int diana_keepFork(struct diana *diana) {
+	if(!diana->forked || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	_record_call(diana, DL_RECORD_KEEP_FORK, 0, 0, 0, 0);
+
+	diana->forked = 0;
+
+	return DL_ERROR_NONE;
+}
+
+// ============================================================================
+// JOURNAL
+// a schema, then one record per commit: its payload size, a checksum and a
+// delta body. each record holds whole entities as they are at the commit, so
+// records can be applied over any snapshot taken before their commit
+#define DL_JOURNAL_MAGIC   0x4c4e524a
+#define DL_JOURNAL_VERSION 1
+
+static int _journal_buffer(void *userData, const void *data, size_t size) {
+	struct diana *diana = (struct diana *)userData;
+
+	if(diana->journalSize + size > diana->journalCapacity) {
+		size_t newCapacity = (diana->journalSize + size) * 1.5;
+		if(_realloc(diana, diana->journalData, diana->journalCapacity, newCapacity, (void **)&diana->journalData) != DL_ERROR_NONE) {
+			return 1;
+		}
+		diana->journalCapacity = newCapacity;
+	}
+	memcpy(diana->journalData + diana->journalSize, data, size);
+	diana->journalSize += size;
+
+	return 0;
+}
+
+// FNV-1a, enough to tell a torn record from a whole one
+static unsigned int _journal_checksum(const unsigned char *data, size_t size) {
+	unsigned int hash = 2166136261u;
+	size_t i;
+
+	for(i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+// one write for everything since the last commit. a failed write closes the
+// journal, what it holds is no longer whole
+static int _journal_commit(struct diana *diana) {
+	struct _stream stream = { _journal_buffer, NULL, diana, DL_ERROR_NONE };
+	unsigned int size, checksum;
+
+	diana->journalSize = 0;
+	_stream_writeUInt(&stream, 0);
+	_stream_writeUInt(&stream, 0);
+	_delta_writeBody(diana, &stream);
+	if(stream.err != DL_ERROR_NONE) {
+		return DL_ERROR_OUT_OF_MEMORY;
+	}
+
+	size = diana->journalSize - sizeof(unsigned int) * 2;
+	checksum = _journal_checksum(diana->journalData + sizeof(unsigned int) * 2, size);
+	memcpy(diana->journalData, &size, sizeof(unsigned int));
+	memcpy(diana->journalData + sizeof(unsigned int), &checksum, sizeof(unsigned int));
+
+	if(diana->journalWrite(diana->journalUserData, diana->journalData, diana->journalSize) != 0) {
+		diana->journalWrite = NULL;
+		return DL_ERROR_IO;
+	}
+
+	_resetTouched(diana);
+
+	return DL_ERROR_NONE;
+}
+
+// start journaling the world from how it is now, a NULL write closes the
+// journal. nothing is written between commits
+int diana_journal(struct diana *diana, int (*write)(void *, const void *, size_t), void *userData) {
+	struct _stream stream = { _journal_buffer, NULL, diana, DL_ERROR_NONE };
+
+	if(!diana->initialized || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	diana->journalWrite = NULL;
+	if(write == NULL) {
+		return DL_ERROR_NONE;
+	}
+
+	diana->journalSize = 0;
+	_stream_writeUInt(&stream, DL_JOURNAL_MAGIC);
+	_stream_writeUInt(&stream, DL_JOURNAL_VERSION);
+	_stream_writeSchema(diana, &stream);
+	if(stream.err != DL_ERROR_NONE) {
+		return DL_ERROR_OUT_OF_MEMORY;
+	}
+
+	if(write(userData, diana->journalData, diana->journalSize) != 0) {
+		return DL_ERROR_IO;
+	}
+
+	_resetTouched(diana);
+	diana->journalWrite = write;
+	diana->journalUserData = userData;
+
+	return DL_ERROR_NONE;
+}
+
+int diana_commitJournal(struct diana *diana) {
+	if(diana->journalWrite == NULL || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	return _journal_commit(diana);
+}
+
+// apply every whole record in the journal. a record that can not be read in
+// full, or does not match its checksum, is taken as where a crash cut the
+// journal off and ends the replay
+int diana_replayJournal(struct diana *diana, int (*read)(void *, void *, size_t), void *userData) {
+	struct _stream stream = { NULL, read, userData, DL_ERROR_NONE };
+	unsigned int size, checksum;
+	int match, err = DL_ERROR_NONE;
+
+	if(!diana->initialized || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(read == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	match = _stream_readUInt(&stream) == DL_JOURNAL_MAGIC;
+	match = match && _stream_readUInt(&stream) == DL_JOURNAL_VERSION;
+	match = match && _stream_matchSchema(diana, &stream);
+	if(stream.err != DL_ERROR_NONE) {
+		return stream.err;
+	}
+	if(!match) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	diana->journalWrite = NULL;
+
+	for(;;) {
+		struct _imageReader reader;
+		struct _stream record = { NULL, _imageReader_read, &reader, DL_ERROR_NONE };
+
+		size = _stream_readUInt(&stream);
+		checksum = _stream_readUInt(&stream);
+		if(stream.err != DL_ERROR_NONE) {
+			break;
+		}
+
+		if(size > diana->journalCapacity) {
+			err = _realloc(diana, diana->journalData, diana->journalCapacity, size, (void **)&diana->journalData);
+			if(err != DL_ERROR_NONE) {
+				break;
+			}
+			diana->journalCapacity = size;
+		}
+		_stream_read(&stream, diana->journalData, size);
+		if(stream.err != DL_ERROR_NONE || _journal_checksum(diana->journalData, size) != checksum) {
+			break;
+		}
+
+		reader.image = diana->journalData;
+		reader.size = size;
+		reader.pos = 0;
+		err = _applyDelta(diana, &record);
+		if(err != DL_ERROR_NONE) {
+			break;
+		}
+	}
+
+	if(err != DL_ERROR_NONE) {
+		diana_clear(diana);
+		return err;
+	}
+
+	_resetTouched(diana);
+	_undo_reset(diana);
+	_record_stop(diana);
+
+	return DL_ERROR_NONE;
+}
+
+// ============================================================================
+// PROFILE
+// each scope keeps its last DL_PROFILE_WINDOW samples, in whatever units the
+// clock counts. with no clock every hook is a single test
+static void _trace_scope(struct diana *diana, unsigned int window, unsigned long long start, unsigned long long end);
+
+static unsigned long long _profile_clock(struct diana *diana) {
+	return diana->profile != NULL ? diana->profileClock(diana->profileUserData) : 0;
+}
+
+static void _profile_sample(struct _profileWindow *window, unsigned long long sample) {
+	window->samples[window->next] = sample;
+	window->next = (window->next + 1) % DL_PROFILE_WINDOW;
+	if(window->count < DL_PROFILE_WINDOW) {
+		window->count++;
+	}
+}
+
+// the time since 'start' goes to the window, and 'start' moves to now so
+// back to back scopes can share it
+static void _profile_record(struct diana *diana, unsigned int window, unsigned long long *start) {
+	unsigned long long now;
+
+	if(diana->profile == NULL) {
+		return;
+	}
+
+	now = diana->profileClock(diana->profileUserData);
+	_profile_sample(diana->profile + window, now - *start);
+	if(diana->traceFrames) {
+		_trace_scope(diana, window, *start, now);
+	}
+	*start = now;
+}
+
+static void _profile_manager(struct diana *diana, unsigned int manager, unsigned long long start) {
+	unsigned long long time;
+
+	if(diana->profile != NULL) {
+		time = diana->profileClock(diana->profileUserData) - start;
+		diana->profileManagers[manager] += time;
+		diana->traceManagers[manager] += time;
+	}
+}
+
+static int _trace_flush(struct diana *diana, int last);
+
+// managers get one sample a frame, the sum of all their callbacks
+static int _profile_endFrame(struct diana *diana) {
+	struct _profileWindow *managers;
+	unsigned int i;
+
+	if(diana->profile == NULL) {
+		return DL_ERROR_NONE;
+	}
+
+	managers = diana->profile + DL_PROFILE_WINDOW_SYSTEMS + diana->num_systems * 3;
+	for(i = 0; i < diana->num_managers; i++) {
+		_profile_sample(managers + i, diana->profileManagers[i]);
+		diana->profileManagers[i] = 0;
+	}
+
+	if(diana->traceFrames) {
+		diana->traceFrames--;
+		return _trace_flush(diana, diana->traceFrames == 0);
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// start profiling with 'clock', any monotonic counter, a NULL clock stops it.
+// samples from before are dropped either way
+int diana_profile(struct diana *diana, unsigned long long (*clock)(void *), void *userData) {
+	unsigned int windows = DL_PROFILE_WINDOW_SYSTEMS + diana->num_systems * 3 + diana->num_managers;
+	struct _profileWindow *profile = NULL;
+	unsigned long long *managers = NULL;
+	int err;
+
+	if(!diana->initialized || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	// a trace needs the clock, end it properly
+	if(diana->traceFrames) {
+		_trace_flush(diana, 1);
+	}
+
+	if(clock != NULL) {
+		err = _malloc(diana, sizeof(struct _profileWindow) * windows, (void **)&profile);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		// the frame sums and the trace's pass sums
+		err = _malloc(diana, sizeof(unsigned long long) * (diana->num_managers + 1) * 2, (void **)&managers);
+		if(err != DL_ERROR_NONE) {
+			_free(diana, profile);
+			return err;
+		}
+		memset(profile, 0, sizeof(struct _profileWindow) * windows);
+		memset(managers, 0, sizeof(unsigned long long) * (diana->num_managers + 1) * 2);
+	}
+
+	_free(diana, diana->profile);
+	_free(diana, diana->profileManagers);
+	diana->profile = profile;
+	diana->profileManagers = managers;
+	diana->traceManagers = managers != NULL ? managers + diana->num_managers + 1 : NULL;
+	diana->profileClock = clock;
+	diana->profileUserData = userData;
+
+	return DL_ERROR_NONE;
+}
+
+// the median, 99th percentile and largest of the scope's last samples, all 0
+// before there are any
+int diana_getProfile(struct diana *diana, unsigned int scope, unsigned int index, unsigned long long *p50_ptr, unsigned long long *p99_ptr, unsigned long long *max_ptr) {
+	unsigned long long sorted[DL_PROFILE_WINDOW];
+	struct _profileWindow *window;
+	unsigned int i, j;
+
+	if(diana->profile == NULL) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	switch(scope) {
+	case DL_PROFILE_FRAME:
+	case DL_PROFILE_FIX_DATA:
+	case DL_PROFILE_COMPUTE:
+	case DL_PROFILE_GROW:
+	case DL_PROFILE_TIMERS:
+		if(index != 0) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		window = diana->profile + (scope == DL_PROFILE_FRAME ? DL_PROFILE_WINDOW_FRAME : scope == DL_PROFILE_FIX_DATA ? DL_PROFILE_WINDOW_FIX_DATA : scope == DL_PROFILE_COMPUTE ? DL_PROFILE_WINDOW_COMPUTE : scope == DL_PROFILE_GROW ? DL_PROFILE_WINDOW_GROW : DL_PROFILE_WINDOW_TIMERS);
+		break;
+	case DL_PROFILE_SIGNAL:
+		if(index > DL_ENTITY_DELETED) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		window = diana->profile + DL_PROFILE_WINDOW_SIGNAL + index;
+		break;
+	case DL_PROFILE_STARTING:
+	case DL_PROFILE_PROCESS:
+	case DL_PROFILE_ENDING:
+		if(index >= diana->num_systems) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		window = diana->profile + DL_PROFILE_WINDOW_SYSTEMS + index * 3 + (scope - DL_PROFILE_STARTING);
+		break;
+	case DL_PROFILE_MANAGER:
+		if(index >= diana->num_managers) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		window = diana->profile + DL_PROFILE_WINDOW_SYSTEMS + diana->num_systems * 3 + index;
+		break;
+	default:
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(window->count == 0) {
+		*p50_ptr = *p99_ptr = *max_ptr = 0;
+		return DL_ERROR_NONE;
+	}
+
+	// insertion sort, the window is small
+	for(i = 0; i < window->count; i++) {
+		unsigned long long sample = window->samples[i];
+		for(j = i; j > 0 && sorted[j - 1] > sample; j--) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = sample;
+	}
+
+	// nearest rank
+	*p50_ptr = sorted[(window->count * 50 + 99) / 100 - 1];
+	*p99_ptr = sorted[(window->count * 99 + 99) / 100 - 1];
+	*max_ptr = sorted[window->count - 1];
+
+	return DL_ERROR_NONE;
+}
+
+// ============================================================================
+// TRACE
+// Chrome trace event JSON, one complete event per profiled scope. the clock
+// is taken as nanoseconds and the events written at the end of each frame.
+// Diana runs on one thread, so every event is on the same track
+static void _trace_append(struct diana *diana, const char *data, size_t size) {
+	if(diana->traceErr != DL_ERROR_NONE) {
+		return;
+	}
+
+	if(diana->traceSize + size > diana->traceCapacity) {
+		size_t newCapacity = (diana->traceSize + size) * 1.5;
+		diana->traceErr = _realloc(diana, diana->traceData, diana->traceCapacity, newCapacity, (void **)&diana->traceData);
+		if(diana->traceErr != DL_ERROR_NONE) {
+			return;
+		}
+		diana->traceCapacity = newCapacity;
+	}
+	memcpy(diana->traceData + diana->traceSize, data, size);
+	diana->traceSize += size;
+}
+
+static void _trace_text(struct diana *diana, const char *text) {
+	_trace_append(diana, text, strlen(text));
+}
+
+static void _trace_string(struct diana *diana, const char *string) {
+	static const char hex[] = "0123456789abcdef";
+	char escaped[6] = { '\\', 'u', '0', '0', 0, 0 };
+
+	_trace_text(diana, "\"");
+	for(; *string; string++) {
+		unsigned char c = *string;
+		if(c == '"' || c == '\\') {
+			escaped[4] = c;
+			_trace_append(diana, escaped, 1);
+			_trace_append(diana, escaped + 4, 1);
+		} else if(c < 0x20) {
+			escaped[4] = hex[c >> 4];
+			escaped[5] = hex[c & 15];
+			_trace_append(diana, escaped, 6);
+		} else {
+			_trace_append(diana, string, 1);
+		}
+	}
+	_trace_text(diana, "\"");
+}
+
+// nanoseconds as the microseconds trace events count in
+static void _trace_time(struct diana *diana, unsigned long long ns) {
+	char digits[32];
+	unsigned int n = sizeof(digits);
+
+	digits[--n] = '0' + ns % 10; ns /= 10;
+	digits[--n] = '0' + ns % 10; ns /= 10;
+	digits[--n] = '0' + ns % 10; ns /= 10;
+	digits[--n] = '.';
+	do {
+		digits[--n] = '0' + ns % 10;
+		ns /= 10;
+	} while(ns);
+
+	_trace_append(diana, digits + n, sizeof(digits) - n);
+}
+
+static void _trace_event(struct diana *diana, const char *name, const char *category, unsigned long long start, unsigned long long duration) {
+	if(diana->traceEvents++) {
+		_trace_text(diana, ",\n");
+	}
+	_trace_text(diana, "{\"name\":");
+	_trace_string(diana, name);
+	_trace_text(diana, ",\"cat\":");
+	_trace_string(diana, category);
+	_trace_text(diana, ",\"ph\":\"X\",\"ts\":");
+	_trace_time(diana, start - diana->traceOrigin);
+	_trace_text(diana, ",\"dur\":");
+	_trace_time(diana, duration);
+	_trace_text(diana, ",\"pid\":0,\"tid\":0}");
+}
+
+static void _trace_scope(struct diana *diana, unsigned int window, unsigned long long start, unsigned long long end) {
+	static const char *signals[] = { "added", "enabled", "disabled", "deleted" };
+	static const char *phases[] = { "starting", "process", "ending" };
+	unsigned int i;
+
+	switch(window) {
+	case DL_PROFILE_WINDOW_FRAME:
+		_trace_event(diana, "diana_process", "frame", start, end - start);
+		return;
+	case DL_PROFILE_WINDOW_FIX_DATA:
+		_trace_event(diana, "fixData", "diana", start, end - start);
+		return;
+	case DL_PROFILE_WINDOW_COMPUTE:
+		_trace_event(diana, "recompute", "diana", start, end - start);
+		return;
+	case DL_PROFILE_WINDOW_GROW:
+		_trace_event(diana, "grow", "diana", start, end - start);
+		return;
+	case DL_PROFILE_WINDOW_TIMERS:
+		_trace_event(diana, "timers", "diana", start, end - start);
+		return;
+	}
+
+	if(window >= DL_PROFILE_WINDOW_SYSTEMS) {
+		i = window - DL_PROFILE_WINDOW_SYSTEMS;
+		_trace_event(diana, diana->systems[i / 3].name, phases[i % 3], start, end - start);
+		return;
+	}
+
+	_trace_event(diana, signals[window - DL_PROFILE_WINDOW_SIGNAL], "signal", start, end - start);
+
+	// a manager's callbacks in the pass are spread over the entities, they
+	// show as one event each, laid end to end from the start of the pass
+	for(i = 0; i < diana->num_managers; i++) {
+		if(diana->traceManagers[i]) {
+			_trace_event(diana, diana->managers[i].name, "manager", start, diana->traceManagers[i]);
+			start += diana->traceManagers[i];
+			diana->traceManagers[i] = 0;
+		}
+	}
+}
+
+// write what the frame added, and the end of the JSON after the last frame
+static int _trace_flush(struct diana *diana, int last) {
+	int err;
+
+	if(last) {
+		_trace_text(diana, "\n],\"displayTimeUnit\":\"ns\"}\n");
+		diana->traceFrames = 0;
+	}
+
+	err = diana->traceErr;
+	if(err == DL_ERROR_NONE && diana->traceWrite(diana->traceUserData, diana->traceData, diana->traceSize) != 0) {
+		err = DL_ERROR_IO;
+	}
+	diana->traceSize = 0;
+
+	if(err != DL_ERROR_NONE) {
+		diana->traceFrames = 0;
+	}
+
+	return err;
+}
+
+// record the next 'frames' frames, using the profile clock. 0 frames ends a
+// trace early
+int diana_trace(struct diana *diana, unsigned int frames, int (*write)(void *, const void *, size_t), void *userData) {
+	unsigned int i;
+
+	if(diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(frames == 0) {
+		return diana->traceFrames ? _trace_flush(diana, 1) : DL_ERROR_NONE;
+	}
+
+	if(diana->profile == NULL || diana->traceFrames) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(write == NULL) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	for(i = 0; i < diana->num_managers; i++) {
+		diana->traceManagers[i] = 0;
+	}
+
+	diana->traceFrames = frames;
+	diana->traceWrite = write;
+	diana->traceUserData = userData;
+	diana->traceOrigin = diana->profileClock(diana->profileUserData);
+	diana->traceErr = DL_ERROR_NONE;
+	diana->traceSize = 0;
+	diana->traceEvents = 0;
+	_trace_text(diana, "{\"traceEvents\":[\n");
+
+	return DL_ERROR_NONE;
+}
+
+// ============================================================================
+// MEMORY
+// what the world holds, added up from its own bookkeeping. bytes inside a
+// loaded image count as reserved the same as allocated ones
+static size_t _sparseIntegerSet_bytes(struct _sparseIntegerSet *is) {
+	return sizeof(unsigned int) * 2 * is->capacity;
+}
+
+static size_t _denseIntegerSet_bytes(struct _denseIntegerSet *is) {
+	return (is->capacity + 7) >> 3;
+}
+
+static size_t _undoCaptures_bytes(struct _undoCaptures *captures) {
+	return _denseIntegerSet_bytes(&captures->set) + sizeof(unsigned int) * captures->capacity;
+}
+
+// the bytes a component takes in every row
+static size_t _component_rowBytes(struct _component *c) {
+	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
+		return sizeof(struct _componentBag);
+	}
+	if(c->flags & DL_COMPONENT_INDEXED_BIT) {
+		return sizeof(unsigned int);
+	}
+	return c->size;
+}
+
+static int _isLive(struct diana *diana, unsigned int entity) {
+	return entity < diana->dataHeight && !_sparseIntegerSet_contains(diana, &diana->freeEntityIds, entity);
+}
+
+static void _memory(struct diana *diana, unsigned int kind, unsigned int index, size_t *used, size_t *reserved) {
+	struct _component *c;
+	struct _system *system;
+	unsigned int entity, i, j, count;
+
+	*used = *reserved = 0;
+
+	switch(kind) {
+	case DL_MEMORY_ENTITIES:
+		*used = (size_t)diana->dataWidth * diana->dataHeight + sizeof(unsigned int) * diana->dataHeight;
+		*reserved = (size_t)diana->dataWidth * diana->dataHeightCapacity + sizeof(unsigned int) * diana->generationsCapacity;
+		*reserved += _sparseIntegerSet_bytes(&diana->freeEntityIds) + _denseIntegerSet_bytes(&diana->freeEntityBits);
+		return;
+
+	case DL_MEMORY_POOL:
+	case DL_MEMORY_POOL_SLOTS:
+		c = diana->components + index;
+		count = c->nextDataIndex - c->freeDataIndexes.population;
+		if(kind == DL_MEMORY_POOL_SLOTS) {
+			*used = count;
+			*reserved = (size_t)c->numDataChunks * DL_POOL_CHUNK_SIZE;
+			return;
+		}
+		*used = c->size * count;
+		*reserved = c->size * c->numDataChunks * DL_POOL_CHUNK_SIZE + sizeof(void *) * c->numDataChunks + _sparseIntegerSet_bytes(&c->freeDataIndexes);
+		return;
+
+	case DL_MEMORY_BAGS:
+		c = diana->components + index;
+		if(!(c->flags & DL_COMPONENT_MULTIPLE_BIT)) {
+			return;
+		}
+		for(entity = 0; entity < diana->dataHeight; entity++) {
+			struct _componentBag *bag = (struct _componentBag *)((unsigned char *)_getEntityData(diana, entity) + c->offset);
+			*used += sizeof(unsigned int) * bag->count;
+		}
+		*reserved = *used;
+		return;
+
+	case DL_MEMORY_SYSTEM:
+		system = diana->systems + index;
+		*reserved = _denseIntegerSet_bytes(&system->entities) + _sparseIntegerSet_bytes(&system->watch) + _sparseIntegerSet_bytes(&system->exclude) + _sparseIntegerSet_bytes(&system->changed);
+		*reserved += sizeof(unsigned int) * system->changedEntitiesCapacity + sizeof(struct _eventSubscription) * system->num_eventSubscriptions;
+		*used = *reserved;
+		return;
+
+	case DL_MEMORY_SIGNALS:
+		*used = sizeof(unsigned int) * 2 * (diana->added.population + diana->enabled.population + diana->disabled.population + diana->deleted.population);
+		*reserved = _sparseIntegerSet_bytes(&diana->added) + _sparseIntegerSet_bytes(&diana->enabled) + _sparseIntegerSet_bytes(&diana->disabled) + _sparseIntegerSet_bytes(&diana->deleted) + _denseIntegerSet_bytes(&diana->active);
+		*used += _denseIntegerSet_bytes(&diana->active);
+		return;
+
+	case DL_MEMORY_WASTED:
+		for(entity = 0; entity < diana->dataHeight; entity++) {
+			unsigned char *entityData;
+			if(!_isLive(diana, entity)) {
+				continue;
+			}
+			entityData = _getEntityData(diana, entity);
+			FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+				*reserved += _component_rowBytes(c);
+				if(!_bits_isSet(entityData, i)) {
+					*used += _component_rowBytes(c);
+				}
+			}
+		}
+		return;
+
+	case DL_MEMORY_OTHER:
+		FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+#if DL_COMPUTE
+			*reserved += sizeof(unsigned int) * c->dependentsCapacity + _denseIntegerSet_bytes(&c->dirty) + sizeof(unsigned int) * c->dirtyCapacity;
+#endif
+			*reserved += sizeof(unsigned long long) * c->changeTicksCapacity + sizeof(struct _change) * c->changeLogCapacity;
+			*reserved += sizeof(unsigned int) * (c->events[DL_COMPONENT_EVENT_ADDED].capacity + c->events[DL_COMPONENT_EVENT_REMOVED].capacity);
+		}
+#if DL_COMPUTE
+		*reserved += sizeof(struct _dependency) * (diana->dependenciesCapacity + diana->invalidatingCapacity) + _sparseIntegerSet_bytes(&diana->freeDependencies);
+#endif
+		for(i = 0; i < diana->num_prefabs; i++) {
+			if(diana->prefabs[i].used) {
+				*reserved += diana->dataWidth;
+			}
+		}
+		*reserved += _denseIntegerSet_bytes(&diana->touched) + sizeof(unsigned int) * diana->touchedCapacity;
+		for(i = 0; diana->rollback != NULL && i < diana->rollbackFrames; i++) {
+			*reserved += diana->rollback[i].capacity + sizeof(struct _undoWrite) * diana->rollback[i].writesCapacity;
+		}
+		*reserved += _undoCaptures_bytes(&diana->rollbackCaptures) + diana->fork.capacity + sizeof(struct _undoWrite) * diana->fork.writesCapacity + _undoCaptures_bytes(&diana->forkCaptures);
+		*reserved += diana->journalCapacity + diana->traceCapacity + diana->recordCapacity;
+		if(diana->timerWheel != NULL) {
+			*reserved += sizeof(unsigned int) * (DL_TIMER_LEVELS * DL_TIMER_SLOTS + diana->entityTimersCapacity) + sizeof(struct _timer) * diana->timersCapacity;
+		}
+		for(i = 0; i < diana->num_spatials; i++) {
+			struct _spatial *sp = diana->spatials + i;
+			*reserved += sizeof(struct _spatial) + sizeof(unsigned int) * (sp->num_buckets * 2 + sp->resultsCapacity) + sizeof(struct _spatialEntry) * sp->entriesCapacity;
+		}
+		for(i = 0; i < diana->num_keyIndexes; i++) {
+			struct _keyIndex *ki = diana->keyIndexes + i;
+			*reserved += sizeof(struct _keyIndex) + sizeof(unsigned int) * (ki->num_buckets + ki->resultsCapacity) + sizeof(struct _spatialEntry) * ki->entriesCapacity;
+		}
+		*reserved += sizeof(struct _relation) * diana->relationsCapacity + sizeof(unsigned int) * (diana->hierarchyCapacity * 2 + diana->childrenCapacity);
+		if(diana->profile != NULL) {
+			j = DL_PROFILE_WINDOW_SYSTEMS + diana->num_systems * 3 + diana->num_managers;
+			*reserved += sizeof(struct _profileWindow) * j + sizeof(unsigned long long) * (diana->num_managers + 1) * 2;
+		}
+		*used = *reserved;
+		return;
+	}
+}
+
+// bytes in use and held for one part of the world, see DL_MEMORY_
+int diana_getMemoryStats(struct diana *diana, unsigned int kind, unsigned int index, size_t *used_ptr, size_t *reserved_ptr) {
+	size_t used, reserved;
+	unsigned int i;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	switch(kind) {
+	case DL_MEMORY_TOTAL:
+		if(index != 0) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		*used_ptr = *reserved_ptr = 0;
+		for(kind = DL_MEMORY_ENTITIES; kind <= DL_MEMORY_OTHER; kind++) {
+			unsigned int n = kind == DL_MEMORY_POOL || kind == DL_MEMORY_BAGS ? diana->num_components : kind == DL_MEMORY_SYSTEM ? diana->num_systems : 1;
+			if(kind == DL_MEMORY_POOL_SLOTS || kind == DL_MEMORY_WASTED) {
+				continue;
+			}
+			for(i = 0; i < n; i++) {
+				_memory(diana, kind, i, &used, &reserved);
+				*used_ptr += used;
+				*reserved_ptr += reserved;
+			}
+		}
+		return DL_ERROR_NONE;
+	case DL_MEMORY_POOL:
+	case DL_MEMORY_POOL_SLOTS:
+	case DL_MEMORY_BAGS:
+		if(index >= diana->num_components) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		break;
+	case DL_MEMORY_SYSTEM:
+		if(index >= diana->num_systems) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		break;
+	case DL_MEMORY_ENTITIES:
+	case DL_MEMORY_SIGNALS:
+	case DL_MEMORY_WASTED:
+	case DL_MEMORY_OTHER:
+		if(index != 0) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		break;
+	default:
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_memory(diana, kind, index, used_ptr, reserved_ptr);
+
+	return DL_ERROR_NONE;
+}
+
+// ============================================================================
+// COUNTERS
+// plain additions on the paths they count. a frame is everything from the
+// end of one diana_process to the end of the next
+static void _count(struct diana *diana, unsigned int counter, unsigned long long n) {
+	if(diana->counters != NULL) {
+		diana->counters[counter] += n;
+	}
+}
+
+static unsigned int _systemCounter(struct diana *diana, struct _system *system, unsigned int which) {
+	return DL_COUNTER_SLOT_SYSTEMS + (system - diana->systems) * 2 + which;
+}
+
+static unsigned int _componentCounter(struct diana *diana, struct _component *c, unsigned int which) {
+	return DL_COUNTER_SLOT_SYSTEMS + diana->num_systems * 2 + (c - diana->components) * 3 + which;
+}
+
+static void _countGrowth(struct diana *diana, size_t bytes) {
+	_count(diana, DL_COUNTER_SLOT_GROWS, 1);
+	_count(diana, DL_COUNTER_SLOT_GROW_BYTES, bytes);
+}
+
+static void _counters_endFrame(struct diana *diana) {
+	unsigned int i;
+
+	for(i = 0; i < diana->num_counters; i++) {
+		diana->countersFrame[i] = diana->counters[i] - diana->countersMark[i];
+		diana->countersMark[i] = diana->counters[i];
+	}
+}
+
+// a counter's total since initializing and what the last frame added to it
+int diana_getCounter(struct diana *diana, unsigned int counter, unsigned int index, unsigned long long *total_ptr, unsigned long long *frame_ptr) {
+	unsigned int slot;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	switch(counter) {
+	case DL_COUNTER_SPAWNS:
+	case DL_COUNTER_CLONES:
+	case DL_COUNTER_DELETES:
+	case DL_COUNTER_GROWS:
+	case DL_COUNTER_GROW_BYTES:
+	case DL_COUNTER_TIMERS:
+		if(index != 0) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		slot = counter == DL_COUNTER_SPAWNS ? DL_COUNTER_SLOT_SPAWNS : counter == DL_COUNTER_CLONES ? DL_COUNTER_SLOT_CLONES : counter == DL_COUNTER_DELETES ? DL_COUNTER_SLOT_DELETES : counter == DL_COUNTER_GROWS ? DL_COUNTER_SLOT_GROWS : counter == DL_COUNTER_GROW_BYTES ? DL_COUNTER_SLOT_GROW_BYTES : DL_COUNTER_SLOT_TIMERS;
+		break;
+	case DL_COUNTER_SIGNALS:
+		if(index > DL_ENTITY_DELETED) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		slot = DL_COUNTER_SLOT_SIGNALS + index;
+		break;
+	case DL_COUNTER_SUBSCRIBED:
+	case DL_COUNTER_UNSUBSCRIBED:
+		if(index >= diana->num_systems) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		slot = _systemCounter(diana, diana->systems + index, counter - DL_COUNTER_SUBSCRIBED);
+		break;
+	case DL_COUNTER_RECOMPUTES:
+	case DL_COUNTER_POOL_ALLOCS:
+	case DL_COUNTER_POOL_FREES:
+		if(index >= diana->num_components) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		slot = _componentCounter(diana, diana->components + index, counter - DL_COUNTER_RECOMPUTES);
+		break;
+	default:
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	*total_ptr = diana->counters[slot];
+	*frame_ptr = diana->countersFrame[slot];
+
+	return DL_ERROR_NONE;
+}
+
+// ============================================================================
+// RECORD
+// a description of the world, a snapshot of it, then one record per call made
+// on it in the order they were made: an op byte followed by its arguments as
+// variable length integers, and the component data for writes. calls made
+// while diana_process runs have DL_RECORD_PROCESSING set. a replay has to
+// make the same calls on a world made from the description, see
+// tests/replay.c
+
+// the callbacks a system or manager has, as bits in the order they are passed
+// to diana_createSystem and diana_createManager
+#define DL_RECORD_CALLBACK(F, BIT) ((F) != NULL ? (BIT) : 0)
+
+// a failure to buffer stops the recording at the next flush
+static int _record_append(struct diana *diana, const void *data, size_t size) {
+	if(diana->recordSize + size > diana->recordCapacity) {
+		size_t newCapacity = (diana->recordSize + size) * 1.5;
+		int err = _realloc(diana, diana->recordData, diana->recordCapacity, newCapacity, (void **)&diana->recordData);
+		if(err != DL_ERROR_NONE) {
+			diana->recordErr = err;
+			return err;
+		}
+		diana->recordCapacity = newCapacity;
+	}
+	memcpy(diana->recordData + diana->recordSize, data, size);
+	diana->recordSize += size;
+
+	return DL_ERROR_NONE;
+}
+
+static int _record_buffer(void *userData, const void *data, size_t size) {
+	return _record_append((struct diana *)userData, data, size) != DL_ERROR_NONE;
+}
+
+// seven bits at a time, low first, the top bit set on all but the last byte
+static void _record_uint(struct diana *diana, unsigned int i) {
+	unsigned char bytes[5];
+	unsigned int n = 0;
+
+	if(diana->recordWrite == NULL) {
+		return;
+	}
+
+	while(i >= 0x80) {
+		bytes[n++] = (unsigned char)(i | 0x80);
+		i >>= 7;
+	}
+	bytes[n++] = (unsigned char)i;
+
+	_record_append(diana, bytes, n);
+}
+
+static void _record_call(struct diana *diana, unsigned int op, unsigned int count, unsigned int a, unsigned int b, unsigned int c) {
+	unsigned char byte;
+
+	if(diana->recordWrite == NULL) {
+		return;
+	}
+
+	byte = (unsigned char)(op | (diana->processing ? DL_RECORD_PROCESSING : 0));
+	_record_append(diana, &byte, 1);
+	if(count > 0) {
+		_record_uint(diana, a);
+	}
+	if(count > 1) {
+		_record_uint(diana, b);
+	}
+	if(count > 2) {
+		_record_uint(diana, c);
+	}
+}
+
+// a byte telling if there is data, then the data
+static void _record_data(struct diana *diana, unsigned int component, const void *data) {
+	unsigned char present = data != NULL;
+
+	if(diana->recordWrite == NULL) {
+		return;
+	}
+
+	_record_append(diana, &present, 1);
+	if(present) {
+		_record_append(diana, data, diana->components[component].size);
+	}
+}
+
+static void _record_float(struct diana *diana, float f) {
+	if(diana->recordWrite != NULL) {
+		_record_append(diana, &f, sizeof(f));
+	}
+}
+
+// one write for everything since the last one. a failed write, or a call that
+// could not be buffered, stops the recording, what it holds is no longer whole
+static int _record_flush(struct diana *diana) {
+	int err = diana->recordErr;
+
+	if(err == DL_ERROR_NONE && diana->recordSize && diana->recordWrite(diana->recordUserData, diana->recordData, diana->recordSize) != 0) {
+		err = DL_ERROR_IO;
+	}
+	diana->recordSize = 0;
+
+	if(err != DL_ERROR_NONE) {
+		diana->recordWrite = NULL;
+		diana->recordErr = DL_ERROR_NONE;
+	}
+
+	return err;
+}
+
+static int _record_stop(struct diana *diana) {
+	int err = DL_ERROR_NONE;
+
+	if(diana->recordWrite != NULL) {
+		err = _record_flush(diana);
+		diana->recordWrite = NULL;
+	}
+
+	return err;
+}
+
+static void _record_describe(struct diana *diana, struct _stream *stream) {
+	struct _component *c;
+	struct _system *system;
+	struct _manager *manager;
+	struct _spatial *sp;
+	struct _keyIndex *ki;
+	unsigned int i, k;
+
+	_stream_writeUInt(stream, diana->entityRecycling);
+	_stream_writeUInt(stream, diana->rollbackFrames);
+	_stream_writeUInt(stream, diana->timerFired != NULL);
+	_stream_write(stream, &diana->timerInterval, sizeof(diana->timerInterval));
+
+	_stream_writeUInt(stream, diana->num_components);
+	FOREACH_ARRAY(c, i, diana->components, diana->num_components) {
+		_stream_writeString(stream, c->name);
+		_stream_writeUInt(stream, c->size);
+		_stream_writeUInt(stream, c->flags);
+	}
+
+	_stream_writeUInt(stream, diana->num_systems);
+	FOREACH_ARRAY(system, i, diana->systems, diana->num_systems) {
+		_stream_writeString(stream, system->name);
+		_stream_writeUInt(stream, system->flags);
+		_stream_writeUInt(stream, system->rateFrames);
+		_stream_write(stream, &system->rateInterval, sizeof(system->rateInterval));
+		_stream_writeUInt(stream, DL_RECORD_CALLBACK(system->starting, 1) | DL_RECORD_CALLBACK(system->ending, 2) | DL_RECORD_CALLBACK(system->subscribed, 4) | DL_RECORD_CALLBACK(system->unsubscribed, 8));
+		_stream_writeSparseSet(stream, &system->watch);
+		_stream_writeSparseSet(stream, &system->exclude);
+		_stream_writeSparseSet(stream, &system->changed);
+		_stream_writeUInt(stream, system->num_eventSubscriptions);
+		for(k = 0; k < system->num_eventSubscriptions; k++) {
+			_stream_writeUInt(stream, system->eventSubscriptions[k].component);
+			_stream_writeUInt(stream, system->eventSubscriptions[k].event);
+		}
+	}
+
+	_stream_writeUInt(stream, diana->num_managers);
+	FOREACH_ARRAY(manager, i, diana->managers, diana->num_managers) {
+		_stream_writeString(stream, manager->name);
+		_stream_writeUInt(stream, manager->flags);
+		_stream_writeUInt(stream, DL_RECORD_CALLBACK(manager->added, 1) | DL_RECORD_CALLBACK(manager->enabled, 2) | DL_RECORD_CALLBACK(manager->disabled, 4) | DL_RECORD_CALLBACK(manager->deleted, 8));
+	}
+
+	_stream_writeUInt(stream, diana->num_spatials);
+	FOREACH_ARRAY(sp, i, diana->spatials, diana->num_spatials) {
+		_stream_writeUInt(stream, sp->component);
+		_stream_writeUInt(stream, sp->dimensions);
+		for(k = 0; k < sp->dimensions; k++) {
+			_stream_writeUInt(stream, sp->offsets[k]);
+		}
+		_stream_write(stream, &sp->cellSize, sizeof(sp->cellSize));
+	}
+
+	_stream_writeUInt(stream, diana->num_keyIndexes);
+	FOREACH_ARRAY(ki, i, diana->keyIndexes, diana->num_keyIndexes) {
+		_stream_writeUInt(stream, ki->component);
+		_stream_writeUInt(stream, ki->offset);
+		_stream_writeUInt(stream, ki->size);
+		_stream_writeUInt(stream, ki->flags);
+	}
+}
+
+// start recording the calls made on the world from how it is now, a NULL
+// write stops it. the world is written whole first, then the calls once per
+// diana_process
+int diana_record(struct diana *diana, int (*write)(void *, const void *, size_t), void *userData) {
+	struct _stream stream = { _record_buffer, NULL, diana, DL_ERROR_NONE };
+	int err;
+
+	if(!diana->initialized || diana->processing) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	err = _record_stop(diana);
+	if(write == NULL) {
+		return err;
+	}
+
+	diana->recordSize = 0;
+	_stream_writeUInt(&stream, DL_RECORD_MAGIC);
+	_stream_writeUInt(&stream, DL_RECORD_VERSION);
+	_record_describe(diana, &stream);
+	_save(diana, &stream);
+	if(stream.err != DL_ERROR_NONE) {
+		diana->recordErr = DL_ERROR_NONE;
+		return DL_ERROR_OUT_OF_MEMORY;
+	}
+
+	if(write(userData, diana->recordData, diana->recordSize) != 0) {
+		return DL_ERROR_IO;
+	}
+
+	diana->recordSize = 0;
+	diana->recordWrite = write;
+	diana->recordUserData = userData;
+
+	return DL_ERROR_NONE;
+}
+
+// ============================================================================
+// TIMERS
+// a hierarchical timer wheel, DL_TIMER_LEVELS levels of DL_TIMER_SLOTS slots
+// each. a timer sits on the lowest level where its due tick and the current
+// one only differ in that level's bits, so level 0 holds the timers of the
+// current run of DL_TIMER_SLOTS ticks. each time a level's slot comes round
+// its timers move down, and each tick fires one slot of level 0. timers past
+// the top level wrap around on it and are looked at again on each turn.
+// everything a change overwrites is kept first, for the undo logs
+static void _timer_keep(struct diana *diana, unsigned int timer) {
+	_captureWrite(diana, DL_UNDO_TIMER, timer, diana->timers + timer, sizeof(struct _timer));
+}
+
+static void _timer_keepSlot(struct diana *diana, unsigned int slot) {
+	_captureWrite(diana, DL_UNDO_WHEEL, slot, diana->timerWheel + slot, sizeof(unsigned int));
+}
+
+static void _timer_keepEntity(struct diana *diana, unsigned int entity) {
+	_captureWrite(diana, DL_UNDO_ENTITY_TIMERS, entity, diana->entityTimers + entity, sizeof(unsigned int));
+}
+
+static void _timer_link(struct diana *diana, unsigned int timer) {
+	struct _timer *t = diana->timers + timer;
+	unsigned long long differ = t->due ^ diana->timerNow;
+	unsigned int level = 0;
+
+	while(level < DL_TIMER_LEVELS - 1 && (differ >> (DL_TIMER_SLOT_BITS * (level + 1))) != 0) {
+		level++;
+	}
+
+	_timer_keep(diana, timer);
+	t->slot = level * DL_TIMER_SLOTS + (unsigned int)((t->due >> (DL_TIMER_SLOT_BITS * level)) & (DL_TIMER_SLOTS - 1));
+	t->prev = 0;
+	t->next = diana->timerWheel[t->slot];
+	if(t->next) {
+		_timer_keep(diana, t->next);
+		diana->timers[t->next].prev = timer;
+	}
+	_timer_keepSlot(diana, t->slot);
+	diana->timerWheel[t->slot] = timer;
+}
+
+// out of its slot and its entity's list, and onto the free list
+static void _timer_release(struct diana *diana, unsigned int timer) {
+	struct _timer *t = diana->timers + timer;
+
+	if(t->prev) {
+		_timer_keep(diana, t->prev);
+		diana->timers[t->prev].next = t->next;
+	} else {
+		_timer_keepSlot(diana, t->slot);
+		diana->timerWheel[t->slot] = t->next;
+	}
+	if(t->next) {
+		_timer_keep(diana, t->next);
+		diana->timers[t->next].prev = t->prev;
+	}
+
+	if(t->entityPrev) {
+		_timer_keep(diana, t->entityPrev);
+		diana->timers[t->entityPrev].entityNext = t->entityNext;
+	} else {
+		_timer_keepEntity(diana, t->entity);
+		diana->entityTimers[t->entity] = t->entityNext;
+	}
+	if(t->entityNext) {
+		_timer_keep(diana, t->entityNext);
+		diana->timers[t->entityNext].entityPrev = t->entityPrev;
+	}
+
+	_timer_keep(diana, timer);
+	t->generation++;
+	t->slot = UINT_MAX;
+	t->next = diana->freeTimers;
+	diana->freeTimers = timer;
+}
+
+static void _timers_cancelEntity(struct diana *diana, unsigned int entity) {
+	while(entity < diana->entityTimersCapacity && diana->entityTimers[entity]) {
+		_timer_release(diana, diana->entityTimers[entity]);
+	}
+}
+
+static void _timers_tick(struct diana *diana) {
+	unsigned long long now = ++diana->timerNow;
+	unsigned int level, top = 0, timer, next;
+
+	// the levels that came round, from the top so what moves down from one
+	// is moved on by the next
+	while(top < DL_TIMER_LEVELS - 1 && (now & ((1ull << (DL_TIMER_SLOT_BITS * (top + 1))) - 1)) == 0) {
+		top++;
+	}
+	for(level = top; level > 0; level--) {
+		unsigned int slot = level * DL_TIMER_SLOTS + (unsigned int)((now >> (DL_TIMER_SLOT_BITS * level)) & (DL_TIMER_SLOTS - 1));
+		timer = diana->timerWheel[slot];
+		_timer_keepSlot(diana, slot);
+		diana->timerWheel[slot] = 0;
+		for(; timer; timer = next) {
+			next = diana->timers[timer].next;
+			_timer_link(diana, timer);
+		}
+	}
+
+	// a timer is free again before its callback, which can schedule more or
+	// cancel others due now
+	while((timer = diana->timerWheel[now & (DL_TIMER_SLOTS - 1)]) != 0) {
+		unsigned int entity = diana->timers[timer].entity, payload = diana->timers[timer].payload;
+		_timer_release(diana, timer);
+		_count(diana, DL_COUNTER_SLOT_TIMERS, 1);
+		diana->timerFired(diana, diana->timerUserData, entity, payload);
+	}
+}
+
+// one tick per diana_process, or one per 'interval' of delta
+static void _timers_advance(struct diana *diana, float delta) {
+	unsigned long long start = _profile_clock(diana);
+
+	if(diana->timerInterval > 0) {
+		diana->timerDelta += delta;
+		while(diana->timerDelta >= diana->timerInterval) {
+			diana->timerDelta -= diana->timerInterval;
+			_timers_tick(diana);
+		}
+	} else {
+		_timers_tick(diana);
+	}
+
+	_profile_record(diana, DL_PROFILE_WINDOW_TIMERS, &start);
+}
+
+// the ids of the dropped timers stay invalid when their numbers are reused
+static void _timers_clear(struct diana *diana) {
+	unsigned int timer;
+
+	if(diana->timerWheel == NULL) {
+		return;
+	}
+
+	for(timer = 1; timer < diana->nextTimer; timer++) {
+		if(diana->timers[timer].slot != UINT_MAX) {
+			diana->timers[timer].generation++;
+		}
+	}
+	memset(diana->timerWheel, 0, sizeof(unsigned int) * DL_TIMER_LEVELS * DL_TIMER_SLOTS);
+	memset(diana->entityTimers, 0, sizeof(unsigned int) * diana->entityTimersCapacity);
+	diana->nextTimer = 1;
+	diana->freeTimers = 0;
+}
+
+// entities only move down and keep their order, so the lists can move in
+// place front to back
+static void _timers_remap(struct diana *diana, const unsigned int *remap, unsigned int n) {
+	unsigned int entity, timer;
+
+	for(entity = 0; entity < n && entity < diana->entityTimersCapacity; entity++) {
+		timer = diana->entityTimers[entity];
+		if(!timer || remap[entity] == entity) {
+			continue;
+		}
+		diana->entityTimers[entity] = 0;
+		diana->entityTimers[remap[entity]] = timer;
+		for(; timer; timer = diana->timers[timer].entityNext) {
+			diana->timers[timer].entity = remap[entity];
+		}
+	}
+}
+
+// 'fired' is called for each timer as it comes due, during diana_process
+// right after the deleted entities are gone. a tick is one diana_process, or
+// 'interval' of delta when it is above 0
+int diana_timers(struct diana *diana, float interval, void (*fired)(struct diana *, void *, unsigned int entity, unsigned int payload), void *userData) {
+	int err;
+
+	if(diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(fired == NULL || !(interval >= 0)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(diana->timerWheel == NULL) {
+		err = _malloc(diana, sizeof(unsigned int) * DL_TIMER_LEVELS * DL_TIMER_SLOTS, (void **)&diana->timerWheel);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		diana->nextTimer = 1;
+	}
+
+	diana->timerFired = fired;
+	diana->timerUserData = userData;
+	diana->timerInterval = interval;
+
+	return DL_ERROR_NONE;
+}
+
+// fire 'ticks' ticks from now, at least one. the timer goes away when it
+// fires, is canceled or its entity is deleted
+int diana_scheduleTimer(struct diana *diana, unsigned int entity, unsigned int payload, unsigned int ticks, unsigned int * timer_ptr) {
+	struct _timer *t;
+	unsigned int timer;
+	int err;
+
+	if(!diana->initialized || diana->timerFired == NULL) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(_sparseIntegerSet_contains(diana, &diana->freeEntityIds, entity)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	if(entity >= diana->entityTimersCapacity) {
+		unsigned int newCapacity = (entity + 1) * 1.5;
+		err = _realloc(diana, diana->entityTimers, sizeof(unsigned int) * diana->entityTimersCapacity, sizeof(unsigned int) * newCapacity, (void **)&diana->entityTimers);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		diana->entityTimersCapacity = newCapacity;
+	}
+
+	if(diana->freeTimers) {
+		timer = diana->freeTimers;
+		diana->freeTimers = diana->timers[timer].next;
+	} else {
+		if(diana->nextTimer > DL_TIMER_INDEX_MASK) {
+			return DL_ERROR_OUT_OF_MEMORY;
+		}
+		if(diana->nextTimer >= diana->timersCapacity) {
+			unsigned int newCapacity = (diana->nextTimer + 1) * 1.5;
+			err = _realloc(diana, diana->timers, sizeof(struct _timer) * diana->timersCapacity, sizeof(struct _timer) * newCapacity, (void **)&diana->timers);
+			if(err != DL_ERROR_NONE) {
+				return err;
+			}
+			diana->timersCapacity = newCapacity;
+		}
+		timer = diana->nextTimer++;
+	}
+
+	t = diana->timers + timer;
+	_timer_keep(diana, timer);
+	t->entity = entity;
+	t->payload = payload;
+	t->due = diana->timerNow + (ticks ? ticks : 1);
+	_timer_link(diana, timer);
+
+	t->entityPrev = 0;
+	t->entityNext = diana->entityTimers[entity];
+	if(t->entityNext) {
+		_timer_keep(diana, t->entityNext);
+		diana->timers[t->entityNext].entityPrev = timer;
+	}
+	_timer_keepEntity(diana, entity);
+	diana->entityTimers[entity] = timer;
+
+	timer |= t->generation << DL_TIMER_INDEX_BITS;
+
+	_record_call(diana, DL_RECORD_SCHEDULE_TIMER, 3, entity, payload, ticks);
+	_record_uint(diana, timer);
+
+	*timer_ptr = timer;
+
+	return DL_ERROR_NONE;
+}
+
+// an id whose timer fired or was canceled stays invalid when its number is
+// reused, until the generation wraps around
+int diana_cancelTimer(struct diana *diana, unsigned int timer) {
+	unsigned int index = timer & DL_TIMER_INDEX_MASK;
+
+	if(!diana->initialized || diana->timerFired == NULL) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(index == 0 || index >= diana->nextTimer || diana->timers[index].slot == UINT_MAX || timer >> DL_TIMER_INDEX_BITS != (diana->timers[index].generation & (UINT_MAX >> DL_TIMER_INDEX_BITS))) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	_record_call(diana, DL_RECORD_CANCEL_TIMER, 1, timer, 0, 0);
+
+	_timer_release(diana, index);
+
+	return DL_ERROR_NONE;
+}
+
+// ============================================================================
+// SPATIAL
+// entities hash into buckets by the cell they are in. a query visits the
+// buckets of the cells it covers, each once, and tests every entity in them
+// against the exact shape, so entities of other cells sharing a bucket are
+// only a cost, never a wrong answer
+#define DL_SPATIAL_MIN_BUCKETS 64
+#define DL_SPATIAL_MAX_CELL    (1 << 30)
+
+// the cell along one axis, far and not a number positions are kept at the
+// edge so they still land somewhere
+static int _spatial_cell(struct _spatial *sp, float f) {
+	float scaled = f * sp->inverseCellSize;
+	int cell;
+
+	if(!(scaled > -DL_SPATIAL_MAX_CELL)) {
+		return scaled != scaled ? 0 : -DL_SPATIAL_MAX_CELL;
+	}
+	if(scaled >= DL_SPATIAL_MAX_CELL) {
+		return DL_SPATIAL_MAX_CELL;
+	}
+
+	cell = (int)scaled;
+	return cell - (scaled < (float)cell);
+}
+
+static unsigned int _spatial_hash(struct _spatial *sp, const int *cell) {
+	unsigned int h = (unsigned int)cell[0] * 73856093u ^ (unsigned int)cell[1] * 19349663u ^ (unsigned int)cell[2] * 83492791u;
+	return (h ^ (h >> 16)) & (sp->num_buckets - 1);
+}
+
+static void _spatial_position(struct diana *diana, struct _spatial *sp, unsigned int entity, float *position) {
+	unsigned char *data = _getEntityData(diana, entity) + diana->components[sp->component].offset;
+	unsigned int d;
+
+	position[2] = 0;
+	for(d = 0; d < sp->dimensions; d++) {
+		memcpy(position + d, data + sp->offsets[d], sizeof(float));
+	}
+}
+
+static unsigned int _spatial_bucket(struct diana *diana, struct _spatial *sp, unsigned int entity) {
+	float position[3];
+	int cell[3] = { 0, 0, 0 };
+	unsigned int d;
+
+	_spatial_position(diana, sp, entity, position);
+	for(d = 0; d < sp->dimensions; d++) {
+		cell[d] = _spatial_cell(sp, position[d]);
+	}
+
+	return _spatial_hash(sp, cell);
+}
+
+static void _spatial_link(struct _spatial *sp, unsigned int entity, unsigned int bucket) {
+	struct _spatialEntry *e = sp->entries + entity;
+
+	e->bucket = bucket + 1;
+	e->prev = 0;
+	e->next = sp->buckets[bucket];
+	if(e->next) {
+		sp->entries[e->next - 1].prev = entity + 1;
+	}
+	sp->buckets[bucket] = entity + 1;
+}
+
+static void _spatial_unlink(struct _spatial *sp, unsigned int entity) {
+	struct _spatialEntry *e = sp->entries + entity;
+
+	if(e->prev) {
+		sp->entries[e->prev - 1].next = e->next;
+	} else {
+		sp->buckets[e->bucket - 1] = e->next;
+	}
+	if(e->next) {
+		sp->entries[e->next - 1].prev = e->prev;
+	}
+	e->bucket = 0;
+}
+
+// keep about one bucket per entity, going twice as wide when it runs out
+static int _spatial_grow(struct diana *diana, struct _spatial *sp) {
+	unsigned int *buckets, *stamps, entity, n = sp->num_buckets * 2;
+	int err;
+
+	err = _malloc(diana, sizeof(unsigned int) * n, (void **)&buckets);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+	err = _malloc(diana, sizeof(unsigned int) * n, (void **)&stamps);
+	if(err != DL_ERROR_NONE) {
+		_free(diana, buckets);
+		return err;
+	}
+
+	_free(diana, sp->buckets);
+	_free(diana, sp->stamps);
+	sp->buckets = buckets;
+	sp->stamps = stamps;
+	sp->num_buckets = n;
+	sp->stamp = 0;
+
+	for(entity = 0; entity < sp->entriesCapacity; entity++) {
+		if(sp->entries[entity].bucket) {
+			_spatial_link(sp, entity, _spatial_bucket(diana, sp, entity));
+		}
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// in the index while enabled and holding the component, in the bucket of
+// where it is now
+static int _spatial_update(struct diana *diana, struct _spatial *sp, unsigned int entity) {
+	unsigned int bucket;
+	int err;
+
+	if(!_denseIntegerSet_contains(diana, &diana->active, entity) || !_bits_isSet(_getEntityData(diana, entity), sp->component)) {
+		if(entity < sp->entriesCapacity && sp->entries[entity].bucket) {
+			_spatial_unlink(sp, entity);
+			sp->count--;
+		}
+		return DL_ERROR_NONE;
+	}
+
+	if(entity >= sp->entriesCapacity) {
+		unsigned int newCapacity = (entity + 1) * 1.5;
+		err = _realloc(diana, sp->entries, sizeof(struct _spatialEntry) * sp->entriesCapacity, sizeof(struct _spatialEntry) * newCapacity, (void **)&sp->entries);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		sp->entriesCapacity = newCapacity;
+	}
+
+	bucket = _spatial_bucket(diana, sp, entity);
+	if(sp->entries[entity].bucket == bucket + 1) {
+		return DL_ERROR_NONE;
+	}
+
+	if(sp->entries[entity].bucket) {
+		_spatial_unlink(sp, entity);
+	} else if(++sp->count > sp->num_buckets) {
+		err = _spatial_grow(diana, sp);
+		if(err != DL_ERROR_NONE) {
+			sp->count--;
+			return err;
+		}
+		bucket = _spatial_bucket(diana, sp, entity);
+	}
+	_spatial_link(sp, entity, bucket);
+
+	return DL_ERROR_NONE;
+}
+
+static int _spatial_changed(struct diana *diana, unsigned int entity, unsigned int component) {
+	struct _spatial *sp;
+	unsigned int i;
+	int err;
+
+	FOREACH_ARRAY(sp, i, diana->spatials, diana->num_spatials) {
+		if(sp->component != component) {
+			continue;
+		}
+		err = _spatial_update(diana, sp, entity);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	return DL_ERROR_NONE;
+}
+
+static int _spatial_sync(struct diana *diana, unsigned int entity) {
+	struct _spatial *sp;
+	unsigned int i;
+	int err;
+
+	FOREACH_ARRAY(sp, i, diana->spatials, diana->num_spatials) {
+		err = _spatial_update(diana, sp, entity);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	return DL_ERROR_NONE;
+}
+
+static void _spatial_remove(struct diana *diana, unsigned int entity) {
+	struct _spatial *sp;
+	unsigned int i;
+
+	FOREACH_ARRAY(sp, i, diana->spatials, diana->num_spatials) {
+		if(entity < sp->entriesCapacity && sp->entries[entity].bucket) {
+			_spatial_unlink(sp, entity);
+			sp->count--;
+		}
+	}
+}
+
+static void _spatial_clear(struct diana *diana) {
+	struct _spatial *sp;
+	unsigned int i;
+
+	FOREACH_ARRAY(sp, i, diana->spatials, diana->num_spatials) {
+		memset(sp->buckets, 0, sizeof(unsigned int) * sp->num_buckets);
+		memset(sp->entries, 0, sizeof(struct _spatialEntry) * sp->entriesCapacity);
+		sp->count = 0;
+	}
+}
+
+// entities only move down and keep their place in space, so each one moves
+// within its bucket into a slot that is already empty
+static void _spatial_remap(struct diana *diana, const unsigned int *remap, unsigned int n) {
+	struct _spatial *sp;
+	unsigned int i, entity, bucket;
+
+	FOREACH_ARRAY(sp, i, diana->spatials, diana->num_spatials) {
+		for(entity = 0; entity < n && entity < sp->entriesCapacity; entity++) {
+			if(!sp->entries[entity].bucket || remap[entity] == entity) {
+				continue;
+			}
+			bucket = sp->entries[entity].bucket - 1;
+			_spatial_unlink(sp, entity);
+			_spatial_link(sp, remap[entity], bucket);
+		}
+	}
+}
+
+static int _spatial_result(struct diana *diana, struct _spatial *sp, unsigned int *count, unsigned int entity) {
+	if(*count >= sp->resultsCapacity) {
+		unsigned int newCapacity = (*count + 1) * 1.5;
+		int err = _realloc(diana, sp->results, sizeof(unsigned int) * sp->resultsCapacity, sizeof(unsigned int) * newCapacity, (void **)&sp->results);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		sp->resultsCapacity = newCapacity;
+	}
+	sp->results[(*count)++] = entity;
+
+	return DL_ERROR_NONE;
+}
+
+// the entities in one bucket inside the box, and within 'radius' of 'center'
+// when it is given
+static int _spatial_visit(struct diana *diana, struct _spatial *sp, unsigned int bucket, const float *min, const float *max, const float *center, float radius, unsigned int *count) {
+	float position[3], distance;
+	unsigned int entity, d;
+	int err, inside;
+
+	for(entity = sp->buckets[bucket]; entity; entity = sp->entries[entity - 1].next) {
+		_spatial_position(diana, sp, entity - 1, position);
+		inside = 1;
+		distance = 0;
+		for(d = 0; d < sp->dimensions; d++) {
+			inside &= position[d] >= min[d] && position[d] <= max[d];
+			if(center != NULL) {
+				distance += (position[d] - center[d]) * (position[d] - center[d]);
+			}
+		}
+		if(!inside || (center != NULL && !(distance <= radius * radius))) {
+			continue;
+		}
+		err = _spatial_result(diana, sp, count, entity - 1);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// each bucket is visited once, marked with the query's stamp. a box covering
+// more cells than there are buckets goes through the buckets instead
+static int _spatial_query(struct diana *diana, unsigned int index, const float *min, const float *max, const float *center, float radius, unsigned int ** entities_ptr, unsigned int * count_ptr) {
+	struct _spatial *sp;
+	int lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 }, cell[3];
+	unsigned long long cells = 1;
+	unsigned int d, bucket, count = 0;
+	int err = DL_ERROR_NONE;
+
+	if(!diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(index >= diana->num_spatials) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	sp = diana->spatials + index;
+	for(d = 0; d < sp->dimensions; d++) {
+		if(!(min[d] <= max[d])) {
+			*entities_ptr = sp->results;
+			*count_ptr = 0;
+			return DL_ERROR_NONE;
+		}
+		lo[d] = _spatial_cell(sp, min[d]);
+		hi[d] = _spatial_cell(sp, max[d]);
+		cells *= (unsigned long long)((long long)hi[d] - lo[d] + 1);
+	}
+
+	if(cells >= sp->num_buckets) {
+		for(bucket = 0; bucket < sp->num_buckets && err == DL_ERROR_NONE; bucket++) {
+			err = _spatial_visit(diana, sp, bucket, min, max, center, radius, &count);
+		}
+	} else {
+		if(++sp->stamp == 0) {
+			memset(sp->stamps, 0, sizeof(unsigned int) * sp->num_buckets);
+			sp->stamp = 1;
+		}
+		for(cell[2] = lo[2]; cell[2] <= hi[2] && err == DL_ERROR_NONE; cell[2]++) {
+			for(cell[1] = lo[1]; cell[1] <= hi[1] && err == DL_ERROR_NONE; cell[1]++) {
+				for(cell[0] = lo[0]; cell[0] <= hi[0] && err == DL_ERROR_NONE; cell[0]++) {
+					bucket = _spatial_hash(sp, cell);
+					if(sp->stamps[bucket] == sp->stamp) {
+						continue;
+					}
+					sp->stamps[bucket] = sp->stamp;
+					err = _spatial_visit(diana, sp, bucket, min, max, center, radius, &count);
+				}
+			}
+		}
+	}
+
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	*entities_ptr = sp->results;
+	*count_ptr = count;
+
+	return DL_ERROR_NONE;
+}
+
+// keep the enabled entities that have 'component' in a grid of 'cellSize'
+// cells, by the 2 or 3 floats at 'offsets' in the component
+int diana_createSpatialIndex(struct diana *diana, unsigned int component, unsigned int dimensions, const size_t *offsets, float cellSize, unsigned int * index_ptr) {
+	struct _spatial sp;
+	struct _component *c;
+	unsigned int d;
+	int err;
+
+	if(diana->initialized) {
+		return DL_ERROR_INVALID_OPERATION;
+	}
+
+	if(component >= diana->num_components || dimensions < 2 || dimensions > 3 || offsets == NULL || !(cellSize > 0)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	c = diana->components + component;
+	if(c->flags & (DL_COMPONENT_MULTIPLE_BIT | DL_COMPONENT_INDEXED_BIT)) {
+		return DL_ERROR_INVALID_VALUE;
+	}
+
+	memset(&sp, 0, sizeof(sp));
+	for(d = 0; d < dimensions; d++) {
+		if(offsets[d] + sizeof(float) > c->size) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+		sp.offsets[d] = offsets[d];
+	}
+	sp.component = component;
+	sp.dimensions = dimensions;
+	sp.cellSize = cellSize;
+	sp.inverseCellSize = 1 / cellSize;
+	sp.num_buckets = DL_SPATIAL_MIN_BUCKETS;
+
+	err = _malloc(diana, sizeof(unsigned int) * sp.num_buckets, (void **)&sp.buckets);
+	if(err == DL_ERROR_NONE) {
+		err = _malloc(diana, sizeof(unsigned int) * sp.num_buckets, (void **)&sp.stamps);
+	}
+	if(err == DL_ERROR_NONE) {
+		err = _realloc(diana, diana->spatials, sizeof(*diana->spatials) * diana->num_spatials, sizeof(*diana->spatials) * (diana->num_spatials + 1), (void **)&diana->spatials);
+	}
+	if(err != DL_ERROR_NONE) {
+		_free(diana, sp.buckets);
+		_free(diana, sp.stamps);
+		return err;
+	}
+	diana->spatials[diana->num_spatials++] = sp;
+
+	*index_ptr = diana->num_spatials - 1;
+
+	return DL_ERROR_NONE;
+}
+
+// the entities with every axis between 'min' and 'max', inclusive. the span
+// is good until the next query on the same index
+int diana_queryBox(struct diana *diana, unsigned int index, const float *min, const float *max, unsigned int ** entities_ptr, unsigned int * count_ptr) {
+	return _spatial_query(diana, index, min, max, NULL, 0, entities_ptr, count_ptr);
+}
+
+// the entities within 'radius' of 'center'
+int diana_queryRadius(struct diana *diana, unsigned int index, const float *center, float radius, unsigned int ** entities_ptr, unsigned int * count_ptr) {
+	float min[3], max[3];
+	unsigned int d;
+
+	if(index < diana->num_spatials) {
+		for(d = 0; d < diana->spatials[index].dimensions; d++) {
+			min[d] = center[d] - radius;
+			max[d] = center[d] + radius;
+		}
+	}
+
+	return _spatial_query(diana, index, min, max, center, radius, entities_ptr, count_ptr);
+}
+
+// ============================================================================
+// KEYS
+// an entity is in a key index while it has the component, in the bucket of
+// its key's hash. the keys stay in the component, a lookup compares them in
+// place
+#define DL_KEYS_MIN_BUCKETS 64
+
+static const unsigned char *_keys_data(struct diana *diana, struct _keyIndex *ki, unsigned int entity) {
+	unsigned char *entityData = _getEntityData(diana, entity);
+	struct _component *c = diana->components + ki->component;
+	unsigned int index;
+
+	if(c->flags & DL_COMPONENT_INDEXED_BIT) {
+		memcpy(&index, entityData + c->offset, sizeof(index));
+		return (unsigned char *)_component_slot(c, index) + ki->offset;
+	}
+
+	return entityData + c->offset + ki->offset;
+}
+
+// FNV-1a
+static unsigned int _keys_hash(struct _keyIndex *ki, const unsigned char *key) {
+	unsigned int h = 2166136261u;
+	size_t i;
+
+	for(i = 0; i < ki->size; i++) {
+		h = (h ^ key[i]) * 16777619u;
+	}
+
+	return (h ^ (h >> 16)) & (ki->num_buckets - 1);
+}
+
+static void _keys_link(struct _keyIndex *ki, unsigned int entity, unsigned int bucket) {
+	struct _spatialEntry *e = ki->entries + entity;
+
+	e->bucket = bucket + 1;
+	e->prev = 0;
+	e->next = ki->buckets[bucket];
+	if(e->next) {
+		ki->entries[e->next - 1].prev = entity + 1;
+	}
+	ki->buckets[bucket] = entity + 1;
+}
+
+static void _keys_unlink(struct _keyIndex *ki, unsigned int entity) {
+	struct _spatialEntry *e = ki->entries + entity;
+
+	if(e->prev) {
+		ki->entries[e->prev - 1].next = e->next;
+	} else {
+		ki->buckets[e->bucket - 1] = e->next;
+	}
+	if(e->next) {
+		ki->entries[e->next - 1].prev = e->prev;
+	}
+	e->bucket = 0;
+	ki->count--;
+}
+
+// the first entity other than 'entity' in the index with 'key'
+static unsigned int _keys_find(struct diana *diana, struct _keyIndex *ki, const unsigned char *key, unsigned int entity) {
+	unsigned int other;
+
+	for(other = ki->buckets[_keys_hash(ki, key)]; other; other = ki->entries[other - 1].next) {
+		if(other - 1 != entity && memcmp(_keys_data(diana, ki, other - 1), key, ki->size) == 0) {
+			return other;
+		}
+	}
+
+	return 0;
+}
+
+// twice the buckets once there are more entities than buckets
+static int _keys_grow(struct diana *diana, struct _keyIndex *ki) {
+	unsigned int *buckets, entity;
+	int err;
+
+	err = _malloc(diana, sizeof(unsigned int) * ki->num_buckets * 2, (void **)&buckets);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	_free(diana, ki->buckets);
+	ki->buckets = buckets;
+	ki->num_buckets *= 2;
+
+	for(entity = 0; entity < ki->entriesCapacity; entity++) {
+		if(ki->entries[entity].bucket) {
+			_keys_link(ki, entity, _keys_hash(ki, _keys_data(diana, ki, entity)));
+		}
+	}
+
+	return DL_ERROR_NONE;
+}
+
+// would writing 'data' give the entity a key another entity holds in a
+// unique index
+static int _keys_taken(struct diana *diana, unsigned int entity, unsigned int component, const void *data) {
+	struct _keyIndex *ki;
+	unsigned int i;
+
+	FOREACH_ARRAY(ki, i, diana->keyIndexes, diana->num_keyIndexes) {
+		if(ki->component == component && !(ki->flags & DL_KEY_INDEX_MULTIPLE) && _keys_find(diana, ki, (const unsigned char *)data + ki->offset, entity)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// in while the entity has the component. uniqueness is kept by
+// diana_setComponent, restores put entities back one at a time and can pass
+// through a key held twice
+static int _keys_update(struct diana *diana, struct _keyIndex *ki, unsigned int entity) {
+	const unsigned char *key;
+	unsigned int bucket;
+	int err;
+
+	if(entity < ki->entriesCapacity && ki->entries[entity].bucket) {
+		_keys_unlink(ki, entity);
+	}
+
+	if(!_bits_isSet(_getEntityData(diana, entity), ki->component)) {
+		return DL_ERROR_NONE;
 	}
 
-	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
-		struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
-		if(i >= bag->count) {
+	key = _keys_data(diana, ki, entity);
+
+	if(entity >= ki->entriesCapacity) {
+		unsigned int newCapacity = (entity + 1) * 1.5;
+		err = _realloc(diana, ki->entries, sizeof(struct _spatialEntry) * ki->entriesCapacity, sizeof(struct _spatialEntry) * newCapacity, (void **)&ki->entries);
+		if(err != DL_ERROR_NONE) {
 			return err;
 		}
-		_sparseIntegerSet_insert(diana, &c->freeDataIndexes, bag->indexes[i]);
-		memcpy(bag->indexes + i, bag->indexes + i + 1, bag->count - i * sizeof(unsigned int));
-		err = _realloc(diana, bag->indexes, sizeof(unsigned int) * bag->count, sizeof(unsigned int) * (bag->count - 1), (void **)&bag->indexes);
+		ki->entriesCapacity = newCapacity;
+	}
+
+	if(ki->count >= ki->num_buckets) {
+		err = _keys_grow(diana, ki);
 		if(err != DL_ERROR_NONE) {
 			return err;
 		}
-		bag->count--;
-		return err;
 	}
 
-	if(c->flags & DL_COMPONENT_INDEXED_BIT) {
-		unsigned int *index = (unsigned int *)(entityData + c->offset);
-		_sparseIntegerSet_insert(diana, &c->freeDataIndexes, *index);
-		*index = 0;
-	}
+	bucket = _keys_hash(ki, key);
+	_keys_link(ki, entity, bucket);
+	ki->count++;
 
-	return err;
+	return DL_ERROR_NONE;
 }
 
-int diana_clone(struct diana *diana, unsigned int parentEntity, unsigned int * entity_ptr) {
-	unsigned int newEntity, ci, cbi, cbn;
-	struct _component *c;
-	unsigned char *parentEntityData;
-	int err = DL_ERROR_NONE;
-
-	if(!diana->initialized) {
-		return DL_ERROR_INVALID_OPERATION;
-	}
+static int _keys_changed(struct diana *diana, unsigned int entity, unsigned int component) {
+	struct _keyIndex *ki;
+	unsigned int i;
+	int err;
 
-	if((!diana->processing && parentEntity >= diana->dataHeight) || (diana->processing && parentEntity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
-		return DL_ERROR_INVALID_VALUE;
+	FOREACH_ARRAY(ki, i, diana->keyIndexes, diana->num_keyIndexes) {
+		if(ki->component != component) {
+			continue;
+		}
+		err = _keys_update(diana, ki, entity);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
 	}
 
-	err = diana_spawn(diana, &newEntity);
-	if(err != DL_ERROR_NONE) {
-		return err;
-	}
+	return DL_ERROR_NONE;
+}
 
-	parentEntityData = _getEntityData(diana, parentEntity);
+static void _keys_remove(struct diana *diana, unsigned int entity) {
+	struct _keyIndex *ki;
+	unsigned int i;
 
-	for(ci = 0; ci < diana->num_components; ci++) {
-		if(!_bits_isSet(parentEntityData, ci)) {
-			continue;
+	FOREACH_ARRAY(ki, i, diana->keyIndexes, diana->num_keyIndexes) {
+		if(entity < ki->entriesCapacity && ki->entries[entity].bucket) {
+			_keys_unlink(ki, entity);
 		}
+	}
+}
 
-		c = diana->components + ci;
+static void _keys_clear(struct diana *diana) {
+	struct _keyIndex *ki;
+	unsigned int i;
 
-		err = diana_getComponentCount(diana, parentEntity, ci, &cbn);
-		if(err != DL_ERROR_NONE) {
-			return err;
-		}
+	FOREACH_ARRAY(ki, i, diana->keyIndexes, diana->num_keyIndexes) {
+		memset(ki->buckets, 0, sizeof(unsigned int) * ki->num_buckets);
+		memset(ki->entries, 0, sizeof(struct _spatialEntry) * ki->entriesCapacity);
+		ki->count = 0;
+	}
+}
 
-		for(cbi = 0; cbi < cbn; cbi++) {
-			void *cd = NULL;
-		  err = _getComponentI(diana, parentEntity, ci, cbi, &cd);
-			if(err != DL_ERROR_NONE) {
-				return err;
+// keys move with their rows, so entities keep their buckets, see
+// _spatial_remap
+static void _keys_remap(struct diana *diana, const unsigned int *remap, unsigned int n) {
+	struct _keyIndex *ki;
+	unsigned int i, entity, bucket;
+
+	FOREACH_ARRAY(ki, i, diana->keyIndexes, diana->num_keyIndexes) {
+		for(entity = 0; entity < n && entity < ki->entriesCapacity; entity++) {
+			if(!ki->entries[entity].bucket || remap[entity] == entity) {
+				continue;
 			}
-			_setComponentI(diana, newEntity, ci, cbi, cd);
+			bucket = ki->entries[entity].bucket - 1;
+			_keys_unlink(ki, entity);
+			_keys_link(ki, remap[entity], bucket);
+			ki->count++;
 		}
 	}
-
-	*entity_ptr = newEntity;
-
-	return err;
 }
 
-// single
-int diana_setComponent(struct diana *diana, unsigned int entity, unsigned int component, const void * data) {
-	if(!diana->initialized) {
+// index the entities that have 'component' by the 'size' bytes at 'offset'
+// in it. DL_KEY_INDEX_UNIQUE keeps one entity per key
+int diana_createKeyIndex(struct diana *diana, unsigned int component, size_t offset, size_t size, unsigned int flags, unsigned int * index_ptr) {
+	struct _keyIndex ki;
+	struct _component *c;
+	int err;
+
+	if(diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
 	}
 
-	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+	if(component >= diana->num_components || size == 0 || flags > DL_KEY_INDEX_MULTIPLE) {
 		return DL_ERROR_INVALID_VALUE;
 	}
 
-	if(component >= diana->num_components) {
+	c = diana->components + component;
+	if(c->flags & DL_COMPONENT_MULTIPLE_BIT || offset + size > c->size) {
 		return DL_ERROR_INVALID_VALUE;
 	}
 
-	return _setComponentI(diana, entity, component, 0, data);
+	memset(&ki, 0, sizeof(ki));
+	ki.component = component;
+	ki.offset = offset;
+	ki.size = size;
+	ki.flags = flags;
+	ki.num_buckets = DL_KEYS_MIN_BUCKETS;
+
+	err = _malloc(diana, sizeof(unsigned int) * ki.num_buckets, (void **)&ki.buckets);
+	if(err == DL_ERROR_NONE) {
+		err = _realloc(diana, diana->keyIndexes, sizeof(*diana->keyIndexes) * diana->num_keyIndexes, sizeof(*diana->keyIndexes) * (diana->num_keyIndexes + 1), (void **)&diana->keyIndexes);
+	}
+	if(err != DL_ERROR_NONE) {
+		_free(diana, ki.buckets);
+		return err;
+	}
+	diana->keyIndexes[diana->num_keyIndexes++] = ki;
+
+	*index_ptr = diana->num_keyIndexes - 1;
+
+	return DL_ERROR_NONE;
 }
 
-int diana_getComponent(struct diana *diana, unsigned int entity, unsigned int component, void ** ptr) {
+// the entity with 'key', or one of them in a multiple index
+int diana_lookup(struct diana *diana, unsigned int index, const void *key, unsigned int * entity_ptr) {
+	unsigned int entity;
+
 	if(!diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
 	}
 
-	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+	if(index >= diana->num_keyIndexes || key == NULL) {
 		return DL_ERROR_INVALID_VALUE;
 	}
 
-	if(component >= diana->num_components) {
+	entity = _keys_find(diana, diana->keyIndexes + index, key, UINT_MAX);
+	if(!entity) {
 		return DL_ERROR_INVALID_VALUE;
 	}
 
-	return _getComponentI(diana, entity, component, 0, ptr);
+	*entity_ptr = entity - 1;
+
+	return DL_ERROR_NONE;
 }
 
-#if DL_COMPUTE
-int diana_dirtyComponent(struct diana *diana, unsigned int entity, unsigned int component) {
-	struct _component *c;
-	unsigned char *entityData;
-	unsigned int i, ci;
+// every entity with 'key'. the span is good until the next diana_lookupAll
+// on the same index
+int diana_lookupAll(struct diana *diana, unsigned int index, const void *key, unsigned int ** entities_ptr, unsigned int * count_ptr) {
+	struct _keyIndex *ki;
+	unsigned int entity, count = 0;
 
 	if(!diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
 	}
 
-	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+	if(index >= diana->num_keyIndexes || key == NULL) {
 		return DL_ERROR_INVALID_VALUE;
 	}
 
-	if(component >= diana->num_components) {
-		return DL_ERROR_INVALID_VALUE;
+	ki = diana->keyIndexes + index;
+	for(entity = ki->buckets[_keys_hash(ki, key)]; entity; entity = ki->entries[entity - 1].next) {
+		if(memcmp(_keys_data(diana, ki, entity - 1), key, ki->size) != 0) {
+			continue;
+		}
+		if(count >= ki->resultsCapacity) {
+			unsigned int newCapacity = (count + 1) * 1.5;
+			int err = _realloc(diana, ki->results, sizeof(unsigned int) * ki->resultsCapacity, sizeof(unsigned int) * newCapacity, (void **)&ki->results);
+			if(err != DL_ERROR_NONE) {
+				return err;
+			}
+			ki->resultsCapacity = newCapacity;
+		}
+		ki->results[count++] = entity - 1;
 	}
 
-	entityData = _getEntityData(diana, entity);
-	c = diana->components + component;
+	*entities_ptr = ki->results;
+	*count_ptr = count;
+
+	return DL_ERROR_NONE;
+}
+
+// ============================================================================
+// HIERARCHY
+// parent links and child lists per entity. the breadth first order is made
+// again only when it is asked for after a change
+static int _hierarchy_reserve(struct diana *diana, unsigned int entity) {
+	unsigned int newCapacity;
+	int err;
+
+	if(entity < diana->relationsCapacity) {
+		return DL_ERROR_NONE;
+	}
 
-	FOREACH_SPARSEINTSET(ci, i, &c->componentsToDirty) {
-		struct _component *c2 = diana->components + ci;
-		entityData[c2->offset - 1] = 1;
+	newCapacity = (entity + 1) * 1.5;
+	err = _realloc(diana, diana->relations, sizeof(struct _relation) * diana->relationsCapacity, sizeof(struct _relation) * newCapacity, (void **)&diana->relations);
+	if(err != DL_ERROR_NONE) {
+		return err;
 	}
+	diana->relationsCapacity = newCapacity;
 
 	return DL_ERROR_NONE;
 }
-#endif
 
-int diana_removeComponent(struct diana *diana, unsigned int entity, unsigned int component) {
-	if(!diana->initialized) {
-		return DL_ERROR_INVALID_OPERATION;
+// everything a change overwrites is kept first, for the undo logs
+static void _hierarchy_keep(struct diana *diana, unsigned int entity) {
+	_captureWrite(diana, DL_UNDO_RELATION, entity, diana->relations + entity, sizeof(struct _relation));
+}
+
+static unsigned int _hierarchy_parent(struct diana *diana, unsigned int entity) {
+	return entity < diana->relationsCapacity ? diana->relations[entity].parent : 0;
+}
+
+// out of its parent's child list
+static void _hierarchy_unlink(struct diana *diana, unsigned int entity) {
+	struct _relation *r = diana->relations + entity, *parent;
+
+	if(!r->parent) {
+		return;
 	}
 
-	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
-		return DL_ERROR_INVALID_VALUE;
+	parent = diana->relations + r->parent - 1;
+	if(r->prev) {
+		_hierarchy_keep(diana, r->prev - 1);
+		diana->relations[r->prev - 1].next = r->next;
+	} else {
+		_hierarchy_keep(diana, r->parent - 1);
+		parent->firstChild = r->next;
 	}
+	if(r->next) {
+		_hierarchy_keep(diana, r->next - 1);
+		diana->relations[r->next - 1].prev = r->prev;
+	} else {
+		_hierarchy_keep(diana, r->parent - 1);
+		parent->lastChild = r->prev;
+	}
+	_hierarchy_keep(diana, entity);
+	r->parent = r->next = r->prev = 0;
+	diana->hierarchyDirty = 1;
+}
 
-	if(component >= diana->num_components) {
-		return DL_ERROR_INVALID_VALUE;
+// off its parent, and its children off it
+static void _hierarchy_detach(struct diana *diana, unsigned int entity) {
+	if(entity >= diana->relationsCapacity) {
+		return;
 	}
 
-	return _removeComponentI(diana, entity, component, 0);
+	_hierarchy_unlink(diana, entity);
+	while(diana->relations[entity].firstChild) {
+		_hierarchy_unlink(diana, diana->relations[entity].firstChild - 1);
+	}
 }
 
-// multiple
-int diana_getComponentCount(struct diana *diana, unsigned int entity, unsigned int component, unsigned int * count_ptr) {
-	unsigned char *entityData;
-	struct _component *c;
+// everything under a deleted entity is deleted with it. walks down through
+// the child lists and back up through the parents, without a stack
+static void _hierarchy_signalDeleted(struct diana *diana, unsigned int entity) {
+	unsigned int at;
 
-	if(!diana->initialized) {
-		return DL_ERROR_INVALID_OPERATION;
+	if(entity >= diana->relationsCapacity || !diana->relations[entity].firstChild) {
+		return;
 	}
 
-	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
-		return DL_ERROR_INVALID_VALUE;
+	at = diana->relations[entity].firstChild - 1;
+	while(at != entity) {
+		_sparseIntegerSet_delete(diana, &diana->added, at);
+		_sparseIntegerSet_delete(diana, &diana->enabled, at);
+		_sparseIntegerSet_insert(diana, &diana->disabled, at);
+		_sparseIntegerSet_insert(diana, &diana->deleted, at);
+
+		if(diana->relations[at].firstChild) {
+			at = diana->relations[at].firstChild - 1;
+			continue;
+		}
+		while(at != entity && !diana->relations[at].next) {
+			at = diana->relations[at].parent - 1;
+		}
+		if(at != entity) {
+			at = diana->relations[at].next - 1;
+		}
 	}
+}
 
-	if(component >= diana->num_components) {
-		return DL_ERROR_INVALID_VALUE;
+// children given their parent after it was signaled are caught here, and
+// are gone later in the same pass
+static void _hierarchy_deleted(struct diana *diana, unsigned int entity) {
+	unsigned int child;
+
+	if(entity >= diana->relationsCapacity) {
+		return;
 	}
 
-	entityData = _getEntityData(diana, entity);
-	c = diana->components + component;
+	for(child = diana->relations[entity].firstChild; child; child = diana->relations[child - 1].next) {
+		_sparseIntegerSet_insert(diana, &diana->deleted, child - 1);
+	}
+	_hierarchy_detach(diana, entity);
+}
 
-	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
-		struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
-		*count_ptr = bag->count;
-	} else {
-		*count_ptr = _bits_isSet(entityData, component);
+static void _hierarchy_clear(struct diana *diana) {
+	if(diana->relations != NULL) {
+		memset(diana->relations, 0, sizeof(struct _relation) * diana->relationsCapacity);
+	}
+	diana->hierarchyDirty = 1;
+}
+
+// deleted entities left the hierarchy, so every link is to a live entity.
+// links are moved first, then rows move down into slots already moved out of
+static void _hierarchy_remap(struct diana *diana, const unsigned int *remap, unsigned int n) {
+	struct _relation *r;
+	unsigned int entity;
+
+	for(entity = 0; entity < n && entity < diana->relationsCapacity; entity++) {
+		r = diana->relations + entity;
+		r->parent = r->parent ? remap[r->parent - 1] + 1 : 0;
+		r->firstChild = r->firstChild ? remap[r->firstChild - 1] + 1 : 0;
+		r->lastChild = r->lastChild ? remap[r->lastChild - 1] + 1 : 0;
+		r->next = r->next ? remap[r->next - 1] + 1 : 0;
+		r->prev = r->prev ? remap[r->prev - 1] + 1 : 0;
+	}
+	for(entity = 0; entity < n && entity < diana->relationsCapacity; entity++) {
+		if(remap[entity] != UINT_MAX && remap[entity] != entity) {
+			diana->relations[remap[entity]] = diana->relations[entity];
+			memset(diana->relations + entity, 0, sizeof(struct _relation));
+		}
+	}
+	diana->hierarchyDirty = 1;
+}
+
+// roots in id order, then each level in turn. a parent is always before its
+// children
+static int _hierarchy_build(struct diana *diana) {
+	unsigned int entity, i, child, count = 0;
+	int err;
+
+	if(diana->relationsCapacity > diana->hierarchyCapacity) {
+		err = _realloc(diana, diana->hierarchyOrder, sizeof(unsigned int) * diana->hierarchyCapacity, sizeof(unsigned int) * diana->relationsCapacity, (void **)&diana->hierarchyOrder);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		err = _realloc(diana, diana->hierarchyParents, sizeof(unsigned int) * diana->hierarchyCapacity, sizeof(unsigned int) * diana->relationsCapacity, (void **)&diana->hierarchyParents);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
+		diana->hierarchyCapacity = diana->relationsCapacity;
+	}
+
+	for(entity = 0; entity < diana->relationsCapacity; entity++) {
+		if(!diana->relations[entity].parent && diana->relations[entity].firstChild) {
+			diana->hierarchyParents[count] = UINT_MAX;
+			diana->hierarchyOrder[count++] = entity;
+		}
+	}
+	for(i = 0; i < count; i++) {
+		for(child = diana->relations[diana->hierarchyOrder[i]].firstChild; child; child = diana->relations[child - 1].next) {
+			diana->hierarchyParents[count] = i;
+			diana->hierarchyOrder[count++] = child - 1;
+		}
 	}
 
+	diana->hierarchyCount = count;
+	diana->hierarchyDirty = 0;
+
 	return DL_ERROR_NONE;
 }
 
-int diana_appendComponent(struct diana *diana, unsigned int entity, unsigned int component, const void * data) {
-	unsigned char *entityData;
-	struct _component *c;
+// the entity goes last among its parent's children. a parent can not be the
+// entity or under it
+int diana_setParent(struct diana *diana, unsigned int entity, unsigned int parent) {
+	struct _relation *r, *p;
+	unsigned int at;
+	int err;
 
 	if(!diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
 	}
 
-	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+	if((!diana->processing && (entity >= diana->dataHeight || parent >= diana->dataHeight)) || (diana->processing && (entity >= diana->dataHeightCapacity + diana->processingDataHeight || parent >= diana->dataHeightCapacity + diana->processingDataHeight))) {
 		return DL_ERROR_INVALID_VALUE;
 	}
 
-	if(component >= diana->num_components) {
+	if(_sparseIntegerSet_contains(diana, &diana->freeEntityIds, entity) || _sparseIntegerSet_contains(diana, &diana->freeEntityIds, parent)) {
 		return DL_ERROR_INVALID_VALUE;
 	}
 
-	entityData = _getEntityData(diana, entity);
-	c = diana->components + component;
+	for(at = parent + 1; at; at = _hierarchy_parent(diana, at - 1)) {
+		if(at - 1 == entity) {
+			return DL_ERROR_INVALID_VALUE;
+		}
+	}
 
-	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
-		unsigned int cc = 0;
-		diana_getComponentCount(diana, entity, component, &cc);
-		return _setComponentI(diana, entity, component, cc, data);
+	err = _hierarchy_reserve(diana, entity > parent ? entity : parent);
+	if(err != DL_ERROR_NONE) {
+		return err;
+	}
+
+	_record_call(diana, DL_RECORD_SET_PARENT, 2, entity, parent, 0);
+
+	r = diana->relations + entity;
+	if(r->parent == parent + 1) {
+		return DL_ERROR_NONE;
+	}
+	_hierarchy_unlink(diana, entity);
+
+	p = diana->relations + parent;
+	_hierarchy_keep(diana, entity);
+	_hierarchy_keep(diana, parent);
+	r->parent = parent + 1;
+	r->prev = p->lastChild;
+	if(p->lastChild) {
+		_hierarchy_keep(diana, p->lastChild - 1);
+		diana->relations[p->lastChild - 1].next = entity + 1;
 	} else {
-		return _setComponentI(diana, entity, component, 0, data);
+		p->firstChild = entity + 1;
 	}
-}
+	p->lastChild = entity + 1;
+	diana->hierarchyDirty = 1;
 
-int diana_removeComponents(struct diana *diana, unsigned int entity, unsigned int component) {
-	unsigned char *entityData;
-	struct _component *c;
-	unsigned int i;
+	return DL_ERROR_NONE;
+}
 
+int diana_removeParent(struct diana *diana, unsigned int entity) {
 	if(!diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
 	}
@@ -1320,74 +7766,82 @@ int diana_removeComponents(struct diana *diana, unsigned int entity, unsigned in
 		return DL_ERROR_INVALID_VALUE;
 	}
 
-	if(component >= diana->num_components) {
+	if(_sparseIntegerSet_contains(diana, &diana->freeEntityIds, entity)) {
 		return DL_ERROR_INVALID_VALUE;
 	}
 
-	entityData = _getEntityData(diana, entity);
-	c = diana->components + component;
+	_record_call(diana, DL_RECORD_REMOVE_PARENT, 1, entity, 0, 0);
 
-	if(c->flags & DL_COMPONENT_MULTIPLE_BIT) {
-		struct _componentBag *bag = (struct _componentBag *)(entityData + c->offset);
-		if(bag->count) {
-			for(i = 0; i < bag->count; i++) {
-				_sparseIntegerSet_insert(diana, &c->freeDataIndexes, bag->indexes[i]);
-			}
-			bag->count = 0;
-			diana->free(bag->indexes);
-			bag->indexes = NULL;
-		}
-		return DL_ERROR_NONE;
-	} else {
-		return _removeComponentI(diana, entity, component, 0);
+	if(entity < diana->relationsCapacity) {
+		_hierarchy_unlink(diana, entity);
 	}
+
+	return DL_ERROR_NONE;
 }
 
-// low level
-int diana_setComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i, const void * data) {
+int diana_getParent(struct diana *diana, unsigned int entity, unsigned int * parent_ptr) {
+	unsigned int parent;
+
 	if(!diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
 	}
 
-	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
+	parent = _hierarchy_parent(diana, entity);
+	if(!parent) {
 		return DL_ERROR_INVALID_VALUE;
 	}
 
-	if(component >= diana->num_components) {
-		return DL_ERROR_INVALID_VALUE;
-	}
+	*parent_ptr = parent - 1;
 
-	return _setComponentI(diana, entity, component, i, data);
+	return DL_ERROR_NONE;
 }
 
-int diana_getComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i, void ** ptr) {
+// the span is good until the next diana_getChildren
+int diana_getChildren(struct diana *diana, unsigned int entity, unsigned int ** children_ptr, unsigned int * count_ptr) {
+	unsigned int child, count = 0;
+
 	if(!diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
 	}
 
-	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
-		return DL_ERROR_INVALID_VALUE;
+	for(child = entity < diana->relationsCapacity ? diana->relations[entity].firstChild : 0; child; child = diana->relations[child - 1].next) {
+		if(count >= diana->childrenCapacity) {
+			unsigned int newCapacity = (count + 1) * 1.5;
+			int err = _realloc(diana, diana->children, sizeof(unsigned int) * diana->childrenCapacity, sizeof(unsigned int) * newCapacity, (void **)&diana->children);
+			if(err != DL_ERROR_NONE) {
+				return err;
+			}
+			diana->childrenCapacity = newCapacity;
+		}
+		diana->children[count++] = child - 1;
 	}
 
-	if(component >= diana->num_components) {
-		return DL_ERROR_INVALID_VALUE;
-	}
+	*children_ptr = diana->children;
+	*count_ptr = count;
 
-	return _getComponentI(diana, entity, component, i, ptr);
+	return DL_ERROR_NONE;
 }
 
-int diana_removeComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i) {
+// every entity with a parent or a child, breadth first. parents_ptr gets
+// where each entity's parent is in the same span, UINT_MAX for the roots.
+// the spans are good until the hierarchy changes
+int diana_getHierarchy(struct diana *diana, unsigned int ** entities_ptr, unsigned int ** parents_ptr, unsigned int * count_ptr) {
+	int err;
+
 	if(!diana->initialized) {
 		return DL_ERROR_INVALID_OPERATION;
 	}
 
-	if((!diana->processing && entity >= diana->dataHeight) || (diana->processing && entity >= diana->dataHeightCapacity + diana->processingDataHeight)) {
-		return DL_ERROR_INVALID_VALUE;
+	if(diana->hierarchyDirty) {
+		err = _hierarchy_build(diana);
+		if(err != DL_ERROR_NONE) {
+			return err;
+		}
 	}
 
-	if(component >= diana->num_components) {
-		return DL_ERROR_INVALID_VALUE;
-	}
+	*entities_ptr = diana->hierarchyOrder;
+	*parents_ptr = diana->hierarchyParents;
+	*count_ptr = diana->hierarchyCount;
 
-	return _removeComponentI(diana, entity, component, i);
+	return DL_ERROR_NONE;
 }
@@ -21,7 +21,8 @@ enum {
 	DL_ERROR_OUT_OF_MEMORY,
 	DL_ERROR_INVALID_VALUE,
 	DL_ERROR_INVALID_OPERATION,
-	DL_ERROR_FULL_COMPONENT
+	DL_ERROR_FULL_COMPONENT,
+	DL_ERROR_IO
 };
 
 // component flags
@@ -43,6 +44,18 @@ enum {
 // manager flags
 #define DL_MANAGER_FLAG_NORMAL  0
 
+// component events
+#define DL_COMPONENT_EVENT_ADDED   1
+#define DL_COMPONENT_EVENT_REMOVED 2
+
+// key index flags
+#define DL_KEY_INDEX_UNIQUE   0
+#define DL_KEY_INDEX_MULTIPLE 1
+
+// entity id recycling
+#define DL_ENTITY_RECYCLE_LIFO   0
+#define DL_ENTITY_RECYCLE_LOWEST 1
+
 // entity signal
 enum {
 	DL_ENTITY_ADDED,
@@ -51,6 +64,57 @@ enum {
 	DL_ENTITY_DELETED
 };
 
+// profile scopes, see diana_getProfile
+enum {
+	DL_PROFILE_FRAME,     // all of diana_process
+	DL_PROFILE_SIGNAL,    // one signal pass, the index is its DL_ENTITY_ signal
+	DL_PROFILE_FIX_DATA,  // merging entities spawned while processing
+	DL_PROFILE_STARTING,  // a system's starting, the index is the system
+	DL_PROFILE_PROCESS,   // a system's process calls
+	DL_PROFILE_ENDING,    // a system's ending
+	DL_PROFILE_MANAGER,   // every callback of a manager in one frame
+	DL_PROFILE_COMPUTE,   // recomputing eager components
+	DL_PROFILE_GROW,      // growing the entity table in diana_spawn
+	DL_PROFILE_TIMERS     // advancing the timer wheel, with the fired callbacks
+};
+
+// memory kinds, see diana_getMemoryStats
+enum {
+	DL_MEMORY_TOTAL,       // all of the below that count bytes
+	DL_MEMORY_ENTITIES,    // the entity table, generations and free ids
+	DL_MEMORY_POOL,        // an indexed or multiple component's pool, the index is the component
+	DL_MEMORY_POOL_SLOTS,  // the same pool in slots, free slots are reserved - used
+	DL_MEMORY_BAGS,        // a multiple component's per entity index lists
+	DL_MEMORY_SYSTEM,      // a system's membership and watch sets, the index is the system
+	DL_MEMORY_SIGNALS,     // the pending signal sets and the active set
+	DL_MEMORY_WASTED,      // row bytes of components live entities do not have, out of all
+	DL_MEMORY_OTHER        // change tracking, dirty sets, events, history, journal, profiling, timers, indexes, hierarchy
+};
+
+// counters, see diana_getCounter
+enum {
+	DL_COUNTER_SPAWNS,
+	DL_COUNTER_CLONES,
+	DL_COUNTER_DELETES,       // entities released by the deleted pass
+	DL_COUNTER_SIGNALS,       // the index is the DL_ENTITY_ signal
+	DL_COUNTER_SUBSCRIBED,    // the index is the system
+	DL_COUNTER_UNSUBSCRIBED,
+	DL_COUNTER_RECOMPUTES,    // the index is the component
+	DL_COUNTER_POOL_ALLOCS,
+	DL_COUNTER_POOL_FREES,
+	DL_COUNTER_GROWS,         // the entity table growing
+	DL_COUNTER_GROW_BYTES,    // bytes the entity table had when it grew
+	DL_COUNTER_TIMERS         // timers fired
+};
+
+// entity handles
+// the entity id in the low 32 bits and its generation in the high 32 bits
+typedef unsigned long long diana_handle;
+
+#define DL_HANDLE(E, G)         (((diana_handle)(G) << 32) | (unsigned int)(E))
+#define DL_HANDLE_ENTITY(H)     ((unsigned int)((H) & 0xFFFFFFFFu))
+#define DL_HANDLE_GENERATION(H) ((unsigned int)((H) >> 32))
+
 // ============================================================================
 // DIANA
 struct diana;
@@ -63,6 +127,21 @@ int diana_free(struct diana *);
 // INITIALIZATION TIME
 int diana_initialize(struct diana *);
 
+int diana_entityRecycling(struct diana *diana, unsigned int policy);
+
+// 'fired' is called for each timer that comes due, in one batch per tick
+// during diana_process. a tick is one diana_process, or 'interval' of delta
+int diana_timers(struct diana *diana, float interval, void (*fired)(struct diana *, void *, unsigned int entity, unsigned int payload), void *userData);
+
+// keep the enabled entities with 'component', an inline component, in a grid
+// of 'cellSize' cells by the 2 or 3 floats at 'offsets' in it
+int diana_createSpatialIndex(struct diana *diana, unsigned int component, unsigned int dimensions, const size_t *offsets, float cellSize, unsigned int * index_ptr);
+
+// look entities with 'component' up by the 'size' bytes at 'offset' in it
+int diana_createKeyIndex(struct diana *diana, unsigned int component, size_t offset, size_t size, unsigned int flags, unsigned int * index_ptr);
+
+int diana_rollback(struct diana *diana, unsigned int frames);
+
 // ============================================================================
 // component
 int diana_createComponent(
@@ -75,6 +154,7 @@ int diana_createComponent(
 
 #if DL_COMPUTE
 int diana_componentCompute(struct diana *diana, unsigned int component, void (*compute)(struct diana *, void *, unsigned int entity, unsigned int index, void *), void *userData);
+int diana_componentEager(struct diana *diana, unsigned int component);
 #endif
 
 // ============================================================================
@@ -96,6 +176,18 @@ int diana_watch(struct diana *diana, unsigned int system, unsigned int component
 
 int diana_exclude(struct diana *diana, unsigned int system, unsigned int component);
 
+int diana_watchChanged(struct diana *diana, unsigned int system, unsigned int component);
+
+int diana_subscribeComponentEvents(struct diana *diana, unsigned int system, unsigned int component, unsigned int events);
+
+// run every 'frames' frames, or once 'interval' of delta built up, with the
+// delta since the last run. only one of them can be set
+int diana_systemRate(struct diana *diana, unsigned int system, unsigned int frames, float interval);
+
+// stop a run once it took 'budget' on the diana_profile clock, the next run
+// carries on from there. needs profiling on
+int diana_systemBudget(struct diana *diana, unsigned int system, unsigned long long budget);
+
 // ============================================================================
 // manager
 int diana_createManager(
@@ -116,6 +208,22 @@ int diana_process(struct diana *, float delta);
 
 int diana_processSystem(struct diana *, unsigned int system, float delta);
 
+int diana_drainComponentEvents(struct diana *diana, unsigned int system, unsigned int component, unsigned int event, void (*callback)(struct diana *, void *, unsigned int entity));
+
+int diana_profile(struct diana *diana, unsigned long long (*clock)(void *), void *userData);
+
+int diana_getProfile(struct diana *diana, unsigned int scope, unsigned int index, unsigned long long *p50_ptr, unsigned long long *p99_ptr, unsigned long long *max_ptr);
+
+int diana_trace(struct diana *diana, unsigned int frames, int (*write)(void *, const void *, size_t), void *userData);
+
+int diana_clear(struct diana *);
+
+int diana_compact(struct diana *, unsigned int ** remap_ptr, unsigned int * count_ptr);
+
+int diana_getMemoryStats(struct diana *diana, unsigned int kind, unsigned int index, size_t *used_ptr, size_t *reserved_ptr);
+
+int diana_getCounter(struct diana *diana, unsigned int counter, unsigned int index, unsigned long long *total_ptr, unsigned long long *frame_ptr);
+
 // ============================================================================
 // entity
 int diana_spawn(struct diana *diana, unsigned int * entity_ptr);
@@ -124,13 +232,27 @@ int diana_clone(struct diana *diana, unsigned int parentEntity, unsigned int * e
 
 int diana_signal(struct diana *diana, unsigned int entity, unsigned int signal);
 
+// prefab
+int diana_createPrefab(struct diana *diana, unsigned int entity, unsigned int * prefab_ptr);
+
+int diana_instantiate(struct diana *diana, unsigned int prefab, unsigned int * entity_ptr);
+
+int diana_instantiateN(struct diana *diana, unsigned int prefab, unsigned int count, unsigned int * entities_ptr);
+
+int diana_freePrefab(struct diana *diana, unsigned int prefab);
+
 // single
 int diana_setComponent(struct diana *diana, unsigned int entity, unsigned int component, const void * data);
 
 int diana_getComponent(struct diana *diana, unsigned int entity, unsigned int component, void ** data_ptr);
 
+int diana_markChanged(struct diana *diana, unsigned int entity, unsigned int component);
+
 #if DL_COMPUTE
 int diana_dirtyComponent(struct diana *diana, unsigned int entity, unsigned int component);
+int diana_getDirtyCount(struct diana *diana, unsigned int component, unsigned int * count_ptr);
+int diana_getDirtyEntities(struct diana *diana, unsigned int component, const unsigned int ** entities_ptr, unsigned int * count_ptr);
+int diana_clearDirty(struct diana *diana, unsigned int component);
 #endif
 
 int diana_removeComponent(struct diana *diana, unsigned int entity, unsigned int component);
@@ -149,6 +271,97 @@ int diana_getComponentI(struct diana *diana, unsigned int entity, unsigned int c
 
 int diana_removeComponentI(struct diana *diana, unsigned int entity, unsigned int component, unsigned int i);
 
+// handle
+int diana_getHandle(struct diana *diana, unsigned int entity, diana_handle * handle_ptr);
+
+// returns 1 if the handle still refers to the entity it was made for, 0 otherwise
+int diana_isAlive(struct diana *diana, diana_handle handle);
+
+int diana_setComponentH(struct diana *diana, diana_handle handle, unsigned int component, const void * data);
+
+int diana_getComponentH(struct diana *diana, diana_handle handle, unsigned int component, void ** data_ptr);
+
+int diana_removeComponentH(struct diana *diana, diana_handle handle, unsigned int component);
+
+// timer
+// fire 'ticks' ticks from now. timers of a deleted entity are canceled with it
+int diana_scheduleTimer(struct diana *diana, unsigned int entity, unsigned int payload, unsigned int ticks, unsigned int * timer_ptr);
+
+// ids of timers that fired or were canceled are refused, also once their
+// number is reused
+int diana_cancelTimer(struct diana *diana, unsigned int timer);
+
+// spatial
+// the span is good until the next query on the same index
+int diana_queryBox(struct diana *diana, unsigned int index, const float *min, const float *max, unsigned int ** entities_ptr, unsigned int * count_ptr);
+
+int diana_queryRadius(struct diana *diana, unsigned int index, const float *center, float radius, unsigned int ** entities_ptr, unsigned int * count_ptr);
+
+// key
+int diana_lookup(struct diana *diana, unsigned int index, const void *key, unsigned int * entity_ptr);
+
+// the span is good until the next diana_lookupAll on the same index
+int diana_lookupAll(struct diana *diana, unsigned int index, const void *key, unsigned int ** entities_ptr, unsigned int * count_ptr);
+
+// hierarchy
+// deleting an entity deletes everything under it
+int diana_setParent(struct diana *diana, unsigned int entity, unsigned int parent);
+
+int diana_removeParent(struct diana *diana, unsigned int entity);
+
+int diana_getParent(struct diana *diana, unsigned int entity, unsigned int * parent_ptr);
+
+// the span is good until the next diana_getChildren
+int diana_getChildren(struct diana *diana, unsigned int entity, unsigned int ** children_ptr, unsigned int * count_ptr);
+
+// breadth first, with where each entity's parent is in the same span. only
+// the span is in this order, the rows stay where they are
+int diana_getHierarchy(struct diana *diana, unsigned int ** entities_ptr, unsigned int ** parents_ptr, unsigned int * count_ptr);
+
+// ============================================================================
+// save / load
+// 'write' and 'read' return 0 on success, anything else fails with DL_ERROR_IO
+int diana_save(struct diana *diana, int (*write)(void *, const void *, size_t), void *userData);
+
+int diana_load(struct diana *diana, int (*read)(void *, void *, size_t), void *userData);
+
+// an image is used where it lies, the world keeps pointing into it until
+// diana_free. only one image can be loaded into a world
+int diana_saveImage(struct diana *diana, int (*write)(void *, const void *, size_t), void *userData);
+
+int diana_loadImage(struct diana *diana, void *image, size_t size);
+
+// the entities changed since the last snapshot or delta, applied on top of a
+// world at that snapshot
+int diana_saveDelta(struct diana *diana, int (*write)(void *, const void *, size_t), void *userData);
+
+int diana_applyDelta(struct diana *diana, int (*read)(void *, void *, size_t), void *userData);
+
+int diana_journal(struct diana *diana, int (*write)(void *, const void *, size_t), void *userData);
+
+int diana_commitJournal(struct diana *diana);
+
+int diana_replayJournal(struct diana *diana, int (*read)(void *, void *, size_t), void *userData);
+
+// the calls made on the world from now on, for DianaReplay to make again. a
+// NULL write stops the recording
+int diana_record(struct diana *diana, int (*write)(void *, const void *, size_t), void *userData);
+
+// ============================================================================
+// rollback
+// go back to the start of the frame 'frames' frames ago, a frame starts with
+// diana_process
+int diana_rewind(struct diana *diana, unsigned int frames);
+
+// ============================================================================
+// fork
+// run ahead on the world and then throw it away or keep it
+int diana_fork(struct diana *diana);
+
+int diana_discardFork(struct diana *diana);
+
+int diana_keepFork(struct diana *diana);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,217 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+// DianaBench [max entities]
+// runs every benchmark at 1e3 entities and up by powers of ten, and prints
+// one JSON object per line:
+// {"bench":"set","storage":"indexed","entities":1000,"systems":0,"ops":1000,"ns_per_op":12.3,"allocs_per_op":0.01,"bytes_per_op":1.2}
+
+size_t allocations = 0, num_allocated = 0;
+
+void *bench_malloc(size_t size) {
+    allocations++;
+    num_allocated += size;
+    return malloc(size);
+}
+
+void bench_free(void *ptr) {
+    free(ptr);
+}
+
+#define BENCH(F, ...) do { int ___err = diana_ ## F (diana, ## __VA_ARGS__); if(___err != DL_ERROR_NONE) { fprintf(stderr, "%s:%i diana_" #F "(diana, " #__VA_ARGS__ ") -> %i\n", __FILE__, __LINE__, ___err); exit(1); } } while(0)
+
+struct diana *diana;
+unsigned int components[3];
+const char *storages[3] = { "inline", "indexed", "multiple" };
+unsigned int *entities;
+unsigned long long sink;
+
+struct measure {
+    struct timespec start;
+    size_t allocations, num_allocated;
+};
+
+void begin(struct measure *m) {
+    m->allocations = allocations;
+    m->num_allocated = num_allocated;
+    clock_gettime(CLOCK_MONOTONIC, &m->start);
+}
+
+void end(struct measure *m, const char *bench, const char *storage, unsigned int n, unsigned int systems, unsigned long long ops) {
+    struct timespec now;
+    double ns;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = (double)(now.tv_sec - m->start.tv_sec) * 1e9 + (double)(now.tv_nsec - m->start.tv_nsec);
+    printf("{\"bench\":\"%s\",\"storage\":\"%s\",\"entities\":%u,\"systems\":%u,\"ops\":%llu,\"ns_per_op\":%.3f,\"allocs_per_op\":%.6f,\"bytes_per_op\":%.3f}\n",
+        bench, storage, n, systems, ops, ns / ops, (double)(allocations - m->allocations) / ops, (double)(num_allocated - m->num_allocated) / ops);
+    fflush(stdout);
+}
+
+void bench_process(struct diana *d, void *userData, unsigned int entity, float delta) {
+    void *data;
+    diana_getComponent(d, entity, components[0], &data);
+    sink += *(unsigned long long *)data;
+}
+
+void world(unsigned int systems) {
+    unsigned int i, system;
+    allocate_diana(bench_malloc, bench_free, &diana);
+    BENCH(createComponent, "Inline", 8, DL_COMPONENT_FLAG_INLINE, &components[0]);
+    BENCH(createComponent, "Indexed", 8, DL_COMPONENT_FLAG_INDEXED, &components[1]);
+    BENCH(createComponent, "Multiple", 8, DL_COMPONENT_FLAG_MULTIPLE, &components[2]);
+    for(i = 0; i < systems; i++) {
+        char name[32];
+        sprintf(name, "System %u", i);
+        BENCH(createSystem, name, NULL, bench_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &system);
+        BENCH(watch, system, components[0]);
+    }
+    BENCH(initialize);
+}
+
+// n entities with the inline component, added and processed once
+void populate(unsigned int n) {
+    unsigned long long value = 1;
+    unsigned int i;
+    for(i = 0; i < n; i++) {
+        BENCH(spawn, entities + i);
+        BENCH(setComponent, entities[i], components[0], &value);
+        BENCH(signal, entities[i], DL_ENTITY_ADDED);
+    }
+    BENCH(process, 0);
+}
+
+void bench_spawn(unsigned int n) {
+    struct measure m;
+    unsigned int i;
+    world(0);
+    begin(&m);
+    for(i = 0; i < n; i++) {
+        BENCH(spawn, entities + i);
+    }
+    end(&m, "spawn", "none", n, 0, n);
+    diana_free(diana);
+}
+
+void bench_clone(unsigned int n) {
+    unsigned long long value = 1;
+    struct measure m;
+    unsigned int i, parent;
+    world(0);
+    BENCH(spawn, &parent);
+    BENCH(setComponent, parent, components[0], &value);
+    BENCH(setComponent, parent, components[1], &value);
+    BENCH(appendComponent, parent, components[2], &value);
+    begin(&m);
+    for(i = 0; i < n; i++) {
+        BENCH(clone, parent, entities + i);
+    }
+    end(&m, "clone", "all", n, 0, n);
+    diana_free(diana);
+}
+
+void bench_signal(unsigned int n) {
+    struct measure m;
+    unsigned int i;
+    world(0);
+    for(i = 0; i < n; i++) {
+        BENCH(spawn, entities + i);
+    }
+    begin(&m);
+    for(i = 0; i < n; i++) {
+        BENCH(signal, entities[i], DL_ENTITY_ADDED);
+    }
+    end(&m, "signal", "none", n, 0, n);
+    diana_free(diana);
+}
+
+// the signals and the pass that tears the entities down
+void bench_delete(unsigned int n) {
+    struct measure m;
+    unsigned int i;
+    world(1);
+    populate(n);
+    begin(&m);
+    for(i = 0; i < n; i++) {
+        BENCH(signal, entities[i], DL_ENTITY_DELETED);
+    }
+    BENCH(process, 0);
+    end(&m, "delete", "inline", n, 1, n);
+    diana_free(diana);
+}
+
+void bench_setGet(unsigned int n, unsigned int storage) {
+    unsigned long long value = 1;
+    struct measure m;
+    unsigned int i;
+    void *data;
+    world(0);
+    for(i = 0; i < n; i++) {
+        BENCH(spawn, entities + i);
+    }
+    begin(&m);
+    for(i = 0; i < n; i++) {
+        if(storage == 2) {
+            BENCH(appendComponent, entities[i], components[2], &value);
+        } else {
+            BENCH(setComponent, entities[i], components[storage], &value);
+        }
+    }
+    end(&m, "set", storages[storage], n, 0, n);
+    begin(&m);
+    for(i = 0; i < n; i++) {
+        BENCH(getComponent, entities[i], components[storage], &data);
+        sink += *(unsigned long long *)data;
+    }
+    end(&m, "get", storages[storage], n, 0, n);
+    diana_free(diana);
+}
+
+// one op is one system visiting one entity
+void bench_processSystems(unsigned int n, unsigned int systems) {
+    struct measure m;
+    unsigned int frames = 3, i;
+    world(systems);
+    populate(n);
+    begin(&m);
+    for(i = 0; i < frames; i++) {
+        BENCH(process, 0);
+    }
+    end(&m, "process", "inline", n, systems, (unsigned long long)n * systems * frames);
+    diana_free(diana);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int max = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 1000000;
+    unsigned int systems[] = { 1, 10, 50, 200 }, n, s, i;
+
+    entities = malloc(sizeof(unsigned int) * max);
+    if(entities == NULL) {
+        return 1;
+    }
+
+    for(n = 1000; n <= max; n *= 10) {
+        bench_spawn(n);
+        bench_clone(n);
+        bench_signal(n);
+        bench_delete(n);
+        for(s = 0; s < 3; s++) {
+            bench_setGet(n, s);
+        }
+        // keep a frame under about 1e8 visits
+        for(i = 0; i < sizeof(systems) / sizeof(systems[0]); i++) {
+            if((unsigned long long)n * systems[i] <= 100000000ull) {
+                bench_processSystems(n, systems[i]);
+            }
+        }
+        if(n > max / 10) {
+            break;
+        }
+    }
+
+    free(entities);
+    fprintf(stderr, "%llu\n", sink & 1);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+static unsigned int componentA, componentB, watcher, writer;
+static unsigned int processed[64], num_processed = 0, num_written = 0;
+
+static void watcher_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    processed[num_processed++] = entity;
+}
+
+static void writer_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    int value = 9;
+    diana_setComponent(diana, entity, componentA, &value);
+    num_written++;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int entities[10], i, *remap;
+    int value = 1;
+    void *data;
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "a", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentA);
+    diana_createComponent(diana, "b", sizeof(int), DL_COMPONENT_FLAG_INDEXED, &componentB);
+    diana_createSystem(diana, "watcher", NULL, watcher_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &watcher);
+    diana_watchChanged(diana, watcher, componentA);
+    diana_watchChanged(diana, watcher, componentB);
+    diana_createSystem(diana, "writer", NULL, writer_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_PASSIVE, &writer);
+    diana_watch(diana, writer, componentA);
+    diana_initialize(diana);
+
+    for(i = 0; i < 10; i++) {
+        diana_spawn(diana, entities + i);
+        diana_setComponent(diana, entities[i], componentA, &value);
+        diana_setComponent(diana, entities[i], componentB, &value);
+        diana_signal(diana, entities[i], DL_ENTITY_ADDED);
+    }
+
+    // new entities count as changed once
+    num_processed = 0;
+    diana_process(diana, 0);
+    CHECK(num_processed == 10);
+    num_processed = 0;
+    diana_process(diana, 0);
+    CHECK(num_processed == 0);
+
+    // several writes in a frame show the entity once, in order
+    diana_setComponent(diana, entities[3], componentA, &value);
+    diana_setComponent(diana, entities[3], componentB, &value);
+    diana_setComponent(diana, entities[3], componentA, &value);
+    diana_getComponent(diana, entities[7], componentB, &data);
+    CHECK(diana_markChanged(diana, entities[7], componentB) == DL_ERROR_NONE);
+    num_processed = 0;
+    diana_process(diana, 0);
+    CHECK(num_processed == 2 && processed[0] == 3 && processed[1] == 7);
+
+    // writes made after the watcher ran are seen the next frame
+    diana_processSystem(diana, writer, 0);
+    CHECK(num_written == 10);
+    num_processed = 0;
+    diana_process(diana, 0);
+    CHECK(num_processed == 10);
+    num_processed = 0;
+    diana_process(diana, 0);
+    CHECK(num_processed == 0);
+
+    // deleted entities are skipped
+    diana_markChanged(diana, entities[1], componentA);
+    diana_signal(diana, entities[1], DL_ENTITY_DELETED);
+    diana_signal(diana, entities[2], DL_ENTITY_DELETED);
+    diana_setComponent(diana, entities[4], componentA, &value);
+    num_processed = 0;
+    diana_process(diana, 0);
+    CHECK(num_processed == 1 && processed[0] == 4);
+
+    // pending changes follow a compaction
+    diana_setComponent(diana, entities[5], componentA, &value);
+    diana_compact(diana, &remap, NULL);
+    free(remap);
+    num_processed = 0;
+    diana_process(diana, 0);
+    CHECK(num_processed == 1 && processed[0] == 3);
+
+    // the tick keeps counting past 32 bits
+    diana->changeTick = UINT_MAX - 1;
+    for(i = 0; i < 4; i++) {
+        diana_setComponent(diana, 0, componentA, &value);
+        num_processed = 0;
+        diana_process(diana, 0);
+        CHECK(num_processed == 1 && processed[0] == 0);
+    }
+    num_processed = 0;
+    diana_process(diana, 0);
+    CHECK(num_processed == 0);
+
+    diana_setComponent(diana, 0, componentA, &value);
+    diana_clear(diana);
+    num_processed = 0;
+    diana_process(diana, 0);
+    CHECK(num_processed == 0);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
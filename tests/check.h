@@ -0,0 +1,11 @@
+#ifndef __DIANA_TESTS_CHECK_H__
+#define __DIANA_TESTS_CHECK_H__
+
+#include <stdio.h>
+
+// a failed check is printed and counted, main returns failures != 0
+static int failures = 0;
+
+#define CHECK(X) do { if(!(X)) { printf("%s:%i check failed: %s\n", __FILE__, __LINE__, #X); failures++; } } while(0)
+
+#endif
@@ -0,0 +1,111 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+static size_t allocations = 0, frees = 0;
+
+static void *test_malloc(size_t size) {
+    allocations++;
+    return malloc(size);
+}
+
+static void test_free(void *ptr) {
+    frees++;
+    free(ptr);
+}
+
+static int subscribed = 0;
+
+static void test_subscribed(struct diana *diana, void *user_data, unsigned int entity) {
+    subscribed++;
+}
+
+static void test_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+}
+
+static unsigned char image[1 << 16];
+static size_t imageSize = 0, imageRead = 0;
+
+static int test_write(void *user_data, const void *data, size_t size) {
+    memcpy(image + imageSize, data, size);
+    imageSize += size;
+    return 0;
+}
+
+static int test_read(void *user_data, void *data, size_t size) {
+    memcpy(data, image + imageRead, size);
+    imageRead += size;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int indexed, multiple, system = 0, entity, round, i, n, *remap, count;
+    int value = 1;
+    void *data;
+
+    allocate_diana(test_malloc, test_free, &diana);
+    diana_createComponent(diana, "indexed", sizeof(int), DL_COMPONENT_FLAG_INDEXED, &indexed);
+    diana_createComponent(diana, "multiple", sizeof(int), DL_COMPONENT_FLAG_MULTIPLE, &multiple);
+    diana_createSystem(diana, "system", NULL, test_process, NULL, test_subscribed, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &system);
+    diana_watch(diana, system, multiple);
+    diana_initialize(diana);
+
+    for(round = 0; round < 3; round++) {
+        for(i = 0; i < 500; i++) {
+            diana_spawn(diana, &entity);
+            diana_setComponent(diana, entity, indexed, &value);
+            diana_appendComponent(diana, entity, multiple, &value);
+            diana_appendComponent(diana, entity, multiple, &value);
+            diana_removeComponentI(diana, entity, multiple, 0);
+            diana_signal(diana, entity, DL_ENTITY_ADDED);
+        }
+        diana_process(diana, 0);
+        CHECK(diana_getComponentCount(diana, 5, multiple, &n) == DL_ERROR_NONE && n == 1);
+
+        // ids start over and come back with clean rows
+        CHECK(diana_clear(diana) == DL_ERROR_NONE);
+        CHECK(diana_spawn(diana, &entity) == DL_ERROR_NONE && entity == 0);
+        CHECK(diana_getComponentCount(diana, entity, multiple, &n) == DL_ERROR_NONE && n == 0);
+        CHECK(diana_getComponent(diana, entity, indexed, &data) != DL_ERROR_NONE);
+        CHECK(diana_clear(diana) == DL_ERROR_NONE);
+    }
+    CHECK(subscribed == 1500);
+
+    // rows left by a clear are cleaned before a load or compact rewrites the
+    // table
+    for(i = 0; i < 100; i++) {
+        diana_spawn(diana, &entity);
+        diana_appendComponent(diana, entity, multiple, &value);
+    }
+    diana_clear(diana);
+    diana_spawn(diana, &entity);
+    value = 42;
+    diana_appendComponent(diana, entity, multiple, &value);
+    CHECK(diana_save(diana, test_write, NULL) == DL_ERROR_NONE);
+    for(i = 0; i < 100; i++) {
+        diana_spawn(diana, &entity);
+        diana_appendComponent(diana, entity, multiple, &value);
+    }
+    diana_clear(diana);
+    CHECK(diana_load(diana, test_read, NULL) == DL_ERROR_NONE);
+    CHECK(diana_getComponentI(diana, 0, multiple, 0, &data) == DL_ERROR_NONE && *(int *)data == 42);
+    CHECK(diana_getComponentCount(diana, 1, multiple, &n) != DL_ERROR_NONE || n == 0);
+
+    for(i = 0; i < 100; i++) {
+        diana_spawn(diana, &entity);
+        diana_appendComponent(diana, entity, multiple, &value);
+    }
+    diana_clear(diana);
+    CHECK(diana_compact(diana, &remap, &count) == DL_ERROR_NONE && count == 0);
+    test_free(remap);
+
+    // every bag left behind was freed on the way
+    diana_free(diana);
+    CHECK(allocations == frees);
+
+    return failures != 0;
+}
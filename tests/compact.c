@@ -0,0 +1,73 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+static unsigned int processed[10000], num_processed = 0;
+
+static void test_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    if(num_processed < 10000) {
+        processed[num_processed] = entity;
+    }
+    num_processed++;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int inlined, multiple, system = 0, entity, i, n, *remap;
+    int value;
+    void *data;
+
+    allocate_diana(malloc, free, &diana);
+    CHECK(diana_entityRecycling(diana, DL_ENTITY_RECYCLE_LOWEST) == DL_ERROR_NONE);
+    diana_createComponent(diana, "inline", sizeof(int), DL_COMPONENT_FLAG_INLINE, &inlined);
+    diana_createComponent(diana, "multiple", sizeof(int), DL_COMPONENT_FLAG_MULTIPLE, &multiple);
+    diana_createSystem(diana, "system", NULL, test_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &system);
+    diana_watch(diana, system, inlined);
+    diana_initialize(diana);
+    CHECK(diana_entityRecycling(diana, DL_ENTITY_RECYCLE_LIFO) == DL_ERROR_INVALID_OPERATION);
+
+    for(i = 0; i < 10000; i++) {
+        CHECK(diana_spawn(diana, &entity) == DL_ERROR_NONE && entity == i);
+        value = i;
+        diana_setComponent(diana, entity, inlined, &value);
+        diana_appendComponent(diana, entity, multiple, &value);
+        diana_signal(diana, entity, DL_ENTITY_ADDED);
+    }
+    diana_process(diana, 0);
+    for(i = 0; i < 10000; i++) {
+        if(i % 3) {
+            diana_signal(diana, i, DL_ENTITY_DELETED);
+        }
+    }
+    diana_process(diana, 0);
+
+    // the lowest free id comes back first
+    CHECK(diana_spawn(diana, &entity) == DL_ERROR_NONE && entity == 1);
+    CHECK(diana_spawn(diana, &entity) == DL_ERROR_NONE && entity == 2);
+    diana_signal(diana, 1, DL_ENTITY_DELETED);
+    diana_signal(diana, 2, DL_ENTITY_DELETED);
+    diana_process(diana, 0);
+
+    // survivors move down in order and keep their data
+    CHECK(diana_compact(diana, &remap, &n) == DL_ERROR_NONE);
+    CHECK(n == 10000);
+    CHECK(remap[0] == 0 && remap[3] == 1 && remap[1] == UINT_MAX && remap[9999] == 3333);
+    free(remap);
+
+    num_processed = 0;
+    diana_process(diana, 0);
+    CHECK(num_processed == 3334);
+    for(i = 0; i < 3334; i++) {
+        CHECK(processed[i] == i);
+        CHECK(diana_getComponent(diana, i, inlined, &data) == DL_ERROR_NONE && *(int *)data == (int)i * 3);
+        CHECK(diana_getComponentI(diana, i, multiple, 0, &data) == DL_ERROR_NONE && *(int *)data == (int)i * 3);
+    }
+    CHECK(diana_spawn(diana, &entity) == DL_ERROR_NONE && entity == 3334);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
@@ -0,0 +1,61 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+static void test_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int inlined, indexed, system = 0, entity, clone, i;
+    unsigned long long total, frame;
+    int value = 0;
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "inline", sizeof(int), DL_COMPONENT_FLAG_INLINE, &inlined);
+    diana_createComponent(diana, "indexed", sizeof(int), DL_COMPONENT_FLAG_INDEXED, &indexed);
+    diana_createSystem(diana, "system", NULL, test_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &system);
+    diana_watch(diana, system, inlined);
+    diana_initialize(diana);
+
+    for(i = 0; i < 10; i++) {
+        diana_spawn(diana, &entity);
+        diana_setComponent(diana, entity, inlined, &value);
+        diana_setComponent(diana, entity, indexed, &value);
+        diana_signal(diana, entity, DL_ENTITY_ADDED);
+    }
+    diana_clone(diana, 0, &clone);
+
+    // the frame counts only close with diana_process
+    CHECK(diana_getCounter(diana, DL_COUNTER_SPAWNS, 0, &total, &frame) == DL_ERROR_NONE && total == 11 && frame == 0);
+    CHECK(diana_getCounter(diana, DL_COUNTER_CLONES, 0, &total, &frame) == DL_ERROR_NONE && total == 1);
+    CHECK(diana_getCounter(diana, DL_COUNTER_POOL_ALLOCS, indexed, &total, &frame) == DL_ERROR_NONE && total == 11);
+    diana_process(diana, 0);
+    CHECK(diana_getCounter(diana, DL_COUNTER_SPAWNS, 0, &total, &frame) == DL_ERROR_NONE && total == 11 && frame == 11);
+    CHECK(diana_getCounter(diana, DL_COUNTER_SUBSCRIBED, system, &total, &frame) == DL_ERROR_NONE && total == 10 && frame == 10);
+    CHECK(diana_getCounter(diana, DL_COUNTER_SIGNALS, DL_ENTITY_ADDED, &total, &frame) == DL_ERROR_NONE && total == 10);
+    CHECK(diana_getCounter(diana, DL_COUNTER_GROWS, 0, &total, &frame) == DL_ERROR_NONE && total > 0);
+
+    for(i = 0; i < 4; i++) {
+        diana_signal(diana, i, DL_ENTITY_DELETED);
+    }
+    diana_process(diana, 0);
+    CHECK(diana_getCounter(diana, DL_COUNTER_DELETES, 0, &total, &frame) == DL_ERROR_NONE && total == 4 && frame == 4);
+    CHECK(diana_getCounter(diana, DL_COUNTER_UNSUBSCRIBED, system, &total, &frame) == DL_ERROR_NONE && total == 4);
+    CHECK(diana_getCounter(diana, DL_COUNTER_POOL_FREES, indexed, &total, &frame) == DL_ERROR_NONE && total == 4 && frame == 4);
+    CHECK(diana_getCounter(diana, DL_COUNTER_SPAWNS, 0, &total, &frame) == DL_ERROR_NONE && frame == 0);
+
+    // a quiet frame resets the frame counts only
+    diana_process(diana, 0);
+    CHECK(diana_getCounter(diana, DL_COUNTER_DELETES, 0, &total, &frame) == DL_ERROR_NONE && total == 4 && frame == 0);
+
+    CHECK(diana_getCounter(diana, DL_COUNTER_POOL_FREES, indexed + 1, &total, &frame) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_getCounter(diana, 1000, 0, &total, &frame) == DL_ERROR_INVALID_VALUE);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
@@ -0,0 +1,169 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+static unsigned char buffer[1 << 22];
+static size_t written = 0, readPosition = 0;
+
+static int test_write(void *user_data, const void *data, size_t size) {
+    memcpy(buffer + written, data, size);
+    written += size;
+    return 0;
+}
+
+static int test_read(void *user_data, void *data, size_t size) {
+    if(readPosition + size > written) {
+        return 1;
+    }
+    memcpy(data, buffer + readPosition, size);
+    readPosition += size;
+    return 0;
+}
+
+static unsigned int componentA, componentB, componentC, active, passive;
+
+static void test_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+}
+
+static struct diana *make(void) {
+    struct diana *diana;
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "a", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentA);
+    diana_createComponent(diana, "b", sizeof(long long), DL_COMPONENT_FLAG_INDEXED, &componentB);
+    diana_createComponent(diana, "c", sizeof(short), DL_COMPONENT_FLAG_MULTIPLE, &componentC);
+    diana_createSystem(diana, "active", NULL, test_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &active);
+    diana_createSystem(diana, "passive", NULL, test_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_PASSIVE, &passive);
+    diana_watch(diana, active, componentA);
+    diana_watch(diana, passive, componentB);
+    diana_initialize(diana);
+    return diana;
+}
+
+// both worlds hold the same entities, memberships and component values
+static void same(struct diana *a, struct diana *b) {
+    unsigned int entity, countA, countB, i;
+    void *dataA, *dataB;
+
+    CHECK(a->nextEntityId == b->nextEntityId && a->dataHeight == b->dataHeight);
+    CHECK(a->freeEntityIds.population == b->freeEntityIds.population);
+    if(a->dataHeight != b->dataHeight) {
+        return;
+    }
+    for(entity = 0; entity < a->dataHeight; entity++) {
+        CHECK(a->generations[entity] == b->generations[entity]);
+        CHECK(_denseIntegerSet_contains(a, &a->active, entity) == _denseIntegerSet_contains(b, &b->active, entity));
+        CHECK(_denseIntegerSet_contains(a, &a->systems[active].entities, entity) == _denseIntegerSet_contains(b, &b->systems[active].entities, entity));
+        CHECK(_denseIntegerSet_contains(a, &a->systems[passive].entities, entity) == _denseIntegerSet_contains(b, &b->systems[passive].entities, entity));
+        CHECK(_getEntityData(a, entity)[0] == _getEntityData(b, entity)[0]);
+        if(diana_getComponent(a, entity, componentA, &dataA) == DL_ERROR_NONE) {
+            CHECK(diana_getComponent(b, entity, componentA, &dataB) == DL_ERROR_NONE && *(int *)dataA == *(int *)dataB);
+        }
+        if(diana_getComponent(a, entity, componentB, &dataA) == DL_ERROR_NONE) {
+            CHECK(diana_getComponent(b, entity, componentB, &dataB) == DL_ERROR_NONE && *(long long *)dataA == *(long long *)dataB);
+        }
+        countA = countB = 0;
+        diana_getComponentCount(a, entity, componentC, &countA);
+        diana_getComponentCount(b, entity, componentC, &countB);
+        CHECK(countA == countB);
+        for(i = 0; i < countA && i < countB; i++) {
+            diana_getComponentI(a, entity, componentC, i, &dataA);
+            diana_getComponentI(b, entity, componentC, i, &dataB);
+            CHECK(*(short *)dataA == *(short *)dataB);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana = make(), *follower = make();
+    unsigned int entity, i, *remap;
+    int value;
+    long long wide;
+    short small;
+    size_t full;
+
+    // deltas need a snapshot to start from
+    CHECK(diana_saveDelta(diana, test_write, NULL) == DL_ERROR_INVALID_OPERATION);
+
+    for(i = 0; i < 1000; i++) {
+        diana_spawn(diana, &entity);
+        value = i;
+        diana_setComponent(diana, entity, componentA, &value);
+        if(i % 3 == 0) {
+            wide = i * 1000LL;
+            diana_setComponent(diana, entity, componentB, &wide);
+        }
+        if(i % 5 == 0) {
+            small = i;
+            diana_appendComponent(diana, entity, componentC, &small);
+            small++;
+            diana_appendComponent(diana, entity, componentC, &small);
+        }
+        diana_signal(diana, entity, DL_ENTITY_ADDED);
+    }
+    diana_process(diana, 0);
+    CHECK(diana_save(diana, test_write, NULL) == DL_ERROR_NONE);
+    full = written;
+    CHECK(diana_load(follower, test_read, NULL) == DL_ERROR_NONE);
+    same(diana, follower);
+
+    // a frame of a few changes makes a small delta
+    written = readPosition = 0;
+    value = -1;
+    diana_setComponent(diana, 10, componentA, &value);
+    diana_removeComponent(diana, 12, componentB);
+    diana_removeComponentI(diana, 15, componentC, 0);
+    diana_removeComponents(diana, 25, componentC);
+    wide = 5;
+    diana_setComponent(diana, 13, componentB, &wide);
+    diana_signal(diana, 20, DL_ENTITY_DELETED);
+    diana_signal(diana, 21, DL_ENTITY_DISABLED);
+    diana_spawn(diana, &entity);
+    value = 77;
+    diana_setComponent(diana, entity, componentA, &value);
+    diana_signal(diana, entity, DL_ENTITY_ADDED);
+    diana_process(diana, 0);
+    diana_signal(diana, 22, DL_ENTITY_DELETED);
+    CHECK(diana_saveDelta(diana, test_write, NULL) == DL_ERROR_NONE);
+    CHECK(written < full / 20);
+    CHECK(diana_applyDelta(follower, test_read, NULL) == DL_ERROR_NONE);
+    same(diana, follower);
+    diana_process(follower, 0);
+    diana_process(diana, 0);
+
+    // compaction and recycled ids
+    written = readPosition = 0;
+    diana_compact(diana, &remap, NULL);
+    free(remap);
+    diana_spawn(diana, &entity);
+    CHECK(diana_saveDelta(diana, test_write, NULL) == DL_ERROR_NONE);
+    CHECK(diana_applyDelta(follower, test_read, NULL) == DL_ERROR_NONE);
+    same(diana, follower);
+
+    // a clear shrinks the follower too
+    written = readPosition = 0;
+    diana_clear(diana);
+    diana_spawn(diana, &entity);
+    value = 3;
+    diana_setComponent(diana, entity, componentA, &value);
+    small = 1;
+    diana_appendComponent(diana, entity, componentC, &small);
+    CHECK(diana_saveDelta(diana, test_write, NULL) == DL_ERROR_NONE);
+    CHECK(diana_applyDelta(follower, test_read, NULL) == DL_ERROR_NONE);
+    same(diana, follower);
+
+    // a truncated delta leaves an empty world
+    written = readPosition = 0;
+    diana_setComponent(diana, entity, componentA, &value);
+    diana_saveDelta(diana, test_write, NULL);
+    written -= 3;
+    CHECK(diana_applyDelta(follower, test_read, NULL) == DL_ERROR_IO);
+    CHECK(follower->dataHeight == 0);
+
+    diana_free(diana);
+    diana_free(follower);
+
+    return failures != 0;
+}
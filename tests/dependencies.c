@@ -0,0 +1,100 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+#if DL_COMPUTE
+static unsigned int componentA, componentB, componentC, computedB = 0, computedC = 0;
+
+// b = a * 2, c = b + 1
+static void computeB(struct diana *diana, void *user_data, unsigned int entity, unsigned int index, void *out) {
+    void *a;
+    diana_getComponent(diana, entity, componentA, &a);
+    *(int *)out = *(int *)a * 2;
+    computedB++;
+}
+
+static void computeC(struct diana *diana, void *user_data, unsigned int entity, unsigned int index, void *out) {
+    void *b;
+    diana_getComponent(diana, entity, componentB, &b);
+    *(int *)out = *(int *)b + 1;
+    computedC++;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int first, second, *remap;
+    int value;
+    void *data;
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "a", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentA);
+    diana_createComponent(diana, "b", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentB);
+    diana_createComponent(diana, "c", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentC);
+    diana_componentCompute(diana, componentB, computeB, NULL);
+    diana_componentCompute(diana, componentC, computeC, NULL);
+    CHECK(diana_componentEager(diana, componentA) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_componentEager(diana, componentC) == DL_ERROR_NONE);
+    diana_initialize(diana);
+    CHECK(diana_componentEager(diana, componentC) == DL_ERROR_INVALID_OPERATION);
+
+    diana_spawn(diana, &first);
+    diana_spawn(diana, &second);
+    value = 1;
+    diana_setComponent(diana, first, componentA, &value);
+    diana_setComponent(diana, first, componentB, NULL);
+    diana_setComponent(diana, first, componentC, NULL);
+    value = 10;
+    diana_setComponent(diana, second, componentA, &value);
+    diana_setComponent(diana, second, componentB, NULL);
+    diana_setComponent(diana, second, componentC, NULL);
+    diana_signal(diana, first, DL_ENTITY_ADDED);
+    diana_signal(diana, second, DL_ENTITY_ADDED);
+
+    // eager components are brought up to date by diana_process
+    diana_process(diana, 0);
+    CHECK(computedB == 2 && computedC == 2);
+    CHECK(diana_getComponent(diana, first, componentC, &data) == DL_ERROR_NONE && *(int *)data == 3);
+    CHECK(diana_getComponent(diana, second, componentC, &data) == DL_ERROR_NONE && *(int *)data == 21);
+    CHECK(computedB == 2 && computedC == 2);
+
+    // a change only reaches the dependents of that entity
+    value = 5;
+    diana_setComponent(diana, first, componentA, &value);
+    CHECK(diana_getComponent(diana, second, componentC, &data) == DL_ERROR_NONE && *(int *)data == 21 && computedC == 2);
+    diana_process(diana, 0);
+    CHECK(computedB == 3 && computedC == 3);
+    CHECK(diana_getComponent(diana, first, componentC, &data) == DL_ERROR_NONE && *(int *)data == 11 && computedC == 3);
+
+    // lazy reads recompute just what they read through
+    diana_dirtyComponent(diana, second, componentA);
+    CHECK(diana_getComponent(diana, second, componentB, &data) == DL_ERROR_NONE && *(int *)data == 20 && computedB == 4 && computedC == 3);
+    CHECK(diana_getComponent(diana, second, componentC, &data) == DL_ERROR_NONE && *(int *)data == 21 && computedC == 4);
+
+    // edges follow entities through a compaction and are gone after a clear
+    diana_signal(diana, first, DL_ENTITY_DELETED);
+    diana_process(diana, 0);
+    diana_compact(diana, &remap, NULL);
+    free(remap);
+    value = 7;
+    diana_setComponent(diana, 0, componentA, &value);
+    CHECK(diana_getComponent(diana, 0, componentC, &data) == DL_ERROR_NONE && *(int *)data == 15);
+
+    diana_clear(diana);
+    diana_spawn(diana, &first);
+    value = 2;
+    diana_setComponent(diana, first, componentA, &value);
+    diana_setComponent(diana, first, componentB, NULL);
+    CHECK(diana_getComponent(diana, first, componentB, &data) == DL_ERROR_NONE && *(int *)data == 4);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
+#else
+int main(int argc, char *argv[]) {
+    return 0;
+}
+#endif
@@ -0,0 +1,90 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+#if DL_COMPUTE
+static unsigned int componentA, componentB, computed = 0;
+
+static void computeB(struct diana *diana, void *user_data, unsigned int entity, unsigned int index, void *out) {
+    void *a;
+    diana_getComponent(diana, entity, componentA, &a);
+    *(int *)out = *(int *)a * 2;
+    computed++;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int entities[10], i, n, *remap;
+    const unsigned int *list;
+    int value;
+    void *data;
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "a", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentA);
+    diana_createComponent(diana, "b", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentB);
+    diana_componentCompute(diana, componentB, computeB, NULL);
+    diana_initialize(diana);
+
+    for(i = 0; i < 10; i++) {
+        diana_spawn(diana, entities + i);
+        value = i;
+        diana_setComponent(diana, entities[i], componentA, &value);
+        diana_setComponent(diana, entities[i], componentB, NULL);
+    }
+    CHECK(diana_getDirtyCount(diana, componentB, &n) == DL_ERROR_NONE && n == 10);
+
+    // reading computes and leaves the list
+    for(i = 0; i < 10; i += 2) {
+        CHECK(diana_getComponent(diana, entities[i], componentB, &data) == DL_ERROR_NONE && *(int *)data == (int)i * 2);
+    }
+    CHECK(diana_getDirtyEntities(diana, componentB, &list, &n) == DL_ERROR_NONE && n == 5);
+    for(i = 0; i < n; i++) {
+        CHECK(list[i] % 2 == 1);
+    }
+
+    // toggling does not grow the list
+    for(i = 0; i < 100; i++) {
+        diana_getComponent(diana, entities[0], componentB, &data);
+        diana_dirtyComponent(diana, entities[0], componentA);
+    }
+    CHECK(diana_getDirtyCount(diana, componentB, &n) == DL_ERROR_NONE && n == 6);
+
+    // a cleared entry is taken as up to date
+    CHECK(diana_clearDirty(diana, componentB) == DL_ERROR_NONE);
+    CHECK(diana_getDirtyCount(diana, componentB, &n) == DL_ERROR_NONE && n == 0);
+    computed = 0;
+    diana_getComponent(diana, entities[3], componentB, &data);
+    CHECK(computed == 0);
+
+    // entities without the component never show up
+    diana_removeComponent(diana, entities[5], componentB);
+    diana_dirtyComponent(diana, entities[5], componentA);
+    CHECK(diana_getDirtyCount(diana, componentB, &n) == DL_ERROR_NONE && n == 0);
+
+    // deleted entities leave the list, moved ones are renamed in it
+    diana_dirtyComponent(diana, entities[7], componentB);
+    diana_dirtyComponent(diana, entities[8], componentB);
+    diana_signal(diana, entities[2], DL_ENTITY_DELETED);
+    diana_signal(diana, entities[7], DL_ENTITY_DELETED);
+    diana_process(diana, 0);
+    CHECK(diana_getDirtyEntities(diana, componentB, &list, &n) == DL_ERROR_NONE && n == 1 && list[0] == 8);
+    diana_compact(diana, &remap, NULL);
+    free(remap);
+    CHECK(diana_getDirtyEntities(diana, componentB, &list, &n) == DL_ERROR_NONE && n == 1 && list[0] == 6);
+    CHECK(diana_getComponent(diana, 6, componentB, &data) == DL_ERROR_NONE && *(int *)data == 16);
+
+    diana_clear(diana);
+    CHECK(diana_getDirtyCount(diana, componentB, &n) == DL_ERROR_NONE && n == 0);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
+#else
+int main(int argc, char *argv[]) {
+    return 0;
+}
+#endif
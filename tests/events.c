@@ -0,0 +1,124 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+static unsigned int componentA, componentB;
+static unsigned int received[64], num_received = 0;
+
+static void receive(struct diana *diana, void *user_data, unsigned int entity) {
+    received[num_received++] = entity;
+}
+
+// events queued from a handler are delivered in the same drain
+static void receive_and_add(struct diana *diana, void *user_data, unsigned int entity) {
+    int value = 0;
+    received[num_received++] = entity;
+    if(entity == 0) {
+        diana_setComponent(diana, 5, componentA, &value);
+    }
+}
+
+static void test_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int first, second, entities[10], i, *remap;
+    int value = 1;
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "a", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentA);
+    diana_createComponent(diana, "b", sizeof(int), DL_COMPONENT_FLAG_MULTIPLE, &componentB);
+    diana_createSystem(diana, "first", NULL, test_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &first);
+    diana_createSystem(diana, "second", NULL, test_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &second);
+    CHECK(diana_subscribeComponentEvents(diana, first, componentA, 4) == DL_ERROR_INVALID_VALUE);
+    diana_subscribeComponentEvents(diana, first, componentA, DL_COMPONENT_EVENT_ADDED | DL_COMPONENT_EVENT_REMOVED);
+    diana_subscribeComponentEvents(diana, first, componentB, DL_COMPONENT_EVENT_ADDED | DL_COMPONENT_EVENT_REMOVED);
+    diana_subscribeComponentEvents(diana, second, componentA, DL_COMPONENT_EVENT_ADDED);
+    diana_initialize(diana);
+    CHECK(diana_drainComponentEvents(diana, second, componentA, DL_COMPONENT_EVENT_REMOVED, receive) == DL_ERROR_INVALID_VALUE);
+
+    for(i = 0; i < 10; i++) {
+        diana_spawn(diana, entities + i);
+        if(i < 5) {
+            diana_setComponent(diana, entities[i], componentA, &value);
+        }
+        diana_signal(diana, entities[i], DL_ENTITY_ADDED);
+    }
+
+    // overwriting is not an add
+    diana_setComponent(diana, entities[0], componentA, &value);
+    num_received = 0;
+    CHECK(diana_drainComponentEvents(diana, first, componentA, DL_COMPONENT_EVENT_ADDED, receive_and_add) == DL_ERROR_NONE);
+    CHECK(num_received == 6 && received[5] == 5);
+    num_received = 0;
+    diana_drainComponentEvents(diana, first, componentA, DL_COMPONENT_EVENT_ADDED, receive);
+    CHECK(num_received == 0);
+
+    // every subscriber reads its own position, the queue is kept until all did
+    diana_process(diana, 0);
+    num_received = 0;
+    diana_drainComponentEvents(diana, second, componentA, DL_COMPONENT_EVENT_ADDED, receive);
+    CHECK(num_received == 6);
+    num_received = 0;
+    diana_drainComponentEvents(diana, second, componentA, DL_COMPONENT_EVENT_ADDED, receive);
+    CHECK(num_received == 0);
+
+    // a multiple component is removed with its last instance
+    diana_appendComponent(diana, entities[7], componentB, &value);
+    diana_appendComponent(diana, entities[7], componentB, &value);
+    diana_removeComponentI(diana, entities[7], componentB, 0);
+    num_received = 0;
+    diana_drainComponentEvents(diana, first, componentB, DL_COMPONENT_EVENT_REMOVED, receive);
+    CHECK(num_received == 0);
+
+    // or with all of them at once
+    diana_appendComponent(diana, entities[8], componentB, &value);
+    diana_appendComponent(diana, entities[8], componentB, &value);
+    CHECK(diana_removeComponents(diana, entities[8], componentB) == DL_ERROR_NONE);
+    num_received = 0;
+    diana_drainComponentEvents(diana, first, componentB, DL_COMPONENT_EVENT_REMOVED, receive);
+    CHECK(num_received == 1 && received[0] == 8);
+
+    // deleting an entity removes its components
+    diana_removeComponent(diana, entities[2], componentA);
+    diana_signal(diana, entities[3], DL_ENTITY_DELETED);
+    diana_signal(diana, entities[7], DL_ENTITY_DELETED);
+    diana_process(diana, 0);
+    num_received = 0;
+    diana_drainComponentEvents(diana, first, componentB, DL_COMPONENT_EVENT_REMOVED, receive);
+    CHECK(num_received == 1 && received[0] == 7);
+
+    // queued ids follow a compaction, ones of freed entities are dropped
+    diana_setComponent(diana, entities[8], componentA, &value);
+    diana_compact(diana, &remap, NULL);
+    free(remap);
+    num_received = 0;
+    diana_drainComponentEvents(diana, first, componentA, DL_COMPONENT_EVENT_REMOVED, receive);
+    CHECK(num_received == 1 && received[0] == 2);
+    num_received = 0;
+    diana_drainComponentEvents(diana, first, componentA, DL_COMPONENT_EVENT_ADDED, receive);
+    CHECK(num_received == 1 && received[0] == 6);
+    num_received = 0;
+    diana_drainComponentEvents(diana, second, componentA, DL_COMPONENT_EVENT_ADDED, receive);
+    CHECK(num_received == 1 && received[0] == 6);
+
+    // a clear drops what is queued
+    diana_setComponent(diana, 0, componentB, &value);
+    diana_clear(diana);
+    num_received = 0;
+    diana_drainComponentEvents(diana, first, componentB, DL_COMPONENT_EVENT_ADDED, receive);
+    CHECK(num_received == 0);
+    diana_spawn(diana, entities);
+    diana_setComponent(diana, entities[0], componentA, &value);
+    num_received = 0;
+    diana_drainComponentEvents(diana, second, componentA, DL_COMPONENT_EVENT_ADDED, receive);
+    CHECK(num_received == 1);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
@@ -0,0 +1,102 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+static unsigned int componentA, componentB;
+
+// counts up, spawns an entity at 3 and deletes itself at 4
+static void step(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    unsigned int spawned = 0;
+    int *a, value = 100;
+    diana_getComponent(diana, entity, componentA, (void **)&a);
+    (*a)++;
+    if(*a == 3) {
+        diana_spawn(diana, &spawned);
+        diana_setComponent(diana, spawned, componentB, &value);
+        diana_signal(diana, spawned, DL_ENTITY_ADDED);
+    }
+    if(*a == 4) {
+        diana_signal(diana, entity, DL_ENTITY_DELETED);
+    }
+}
+
+// the live entities with their handles and values
+static void dump(struct diana *diana, char *out) {
+    unsigned int entity;
+    diana_handle handle;
+    int *data;
+
+    out[0] = 0;
+    for(entity = 0; entity < 8; entity++) {
+        if(diana_getHandle(diana, entity, &handle) != DL_ERROR_NONE) {
+            continue;
+        }
+        out += sprintf(out, "%u:%llx", entity, (unsigned long long)handle);
+        if(diana_getComponent(diana, entity, componentA, (void **)&data) == DL_ERROR_NONE) {
+            out += sprintf(out, "a%d", *data);
+        }
+        if(diana_getComponent(diana, entity, componentB, (void **)&data) == DL_ERROR_NONE) {
+            out += sprintf(out, "b%d", *data);
+        }
+        out += sprintf(out, ";");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int system = 0, entity, i;
+    int value = 0;
+    char base[512], ahead[512], now[512];
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "a", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentA);
+    diana_createComponent(diana, "b", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentB);
+    diana_createSystem(diana, "step", NULL, step, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &system);
+    diana_watch(diana, system, componentA);
+    CHECK(diana_fork(diana) == DL_ERROR_INVALID_OPERATION);
+    diana_initialize(diana);
+
+    diana_spawn(diana, &entity);
+    diana_setComponent(diana, entity, componentA, &value);
+    diana_signal(diana, entity, DL_ENTITY_ADDED);
+    diana_spawn(diana, &entity);
+    value = 1;
+    diana_setComponent(diana, entity, componentA, &value);
+    diana_signal(diana, entity, DL_ENTITY_ADDED);
+    diana_process(diana, 0);
+    dump(diana, base);
+
+    // one fork at a time
+    CHECK(diana_discardFork(diana) == DL_ERROR_INVALID_OPERATION);
+    CHECK(diana_fork(diana) == DL_ERROR_NONE);
+    CHECK(diana_fork(diana) == DL_ERROR_INVALID_OPERATION);
+
+    // discarding goes back to where the fork started
+    for(i = 0; i < 4; i++) {
+        diana_process(diana, 0);
+    }
+    dump(diana, ahead);
+    CHECK(strcmp(ahead, base));
+    CHECK(diana_discardFork(diana) == DL_ERROR_NONE);
+    dump(diana, now);
+    CHECK(!strcmp(now, base));
+
+    // the same frames again reach the same state, keeping it ends the fork
+    CHECK(diana_fork(diana) == DL_ERROR_NONE);
+    for(i = 0; i < 4; i++) {
+        diana_process(diana, 0);
+    }
+    dump(diana, now);
+    CHECK(!strcmp(now, ahead));
+    CHECK(diana_keepFork(diana) == DL_ERROR_NONE);
+    CHECK(diana_discardFork(diana) == DL_ERROR_INVALID_OPERATION);
+    dump(diana, now);
+    CHECK(!strcmp(now, ahead));
+
+    diana_free(diana);
+
+    return failures != 0;
+}
@@ -48,6 +48,8 @@ unsigned int components[5];
 
 unsigned int random_system;
 
+unsigned int random_prefab;
+
 struct _sparseIntegerSet disabled_eids;
 
 struct diana *global_diana;
@@ -63,14 +65,14 @@ void add_random_component(unsigned int eid) {
 }
 
 unsigned int spawn(void) {
-    unsigned int eid;
+    unsigned int eid = 0;
     unsigned int actions = R(1, 6), action;
     DIANA(spawn, &eid);
     num_spawns++;
     if(eid > max_eid_spawned) {
         max_eid_spawned = eid;
     }
-    for(action = 0; actions < actions; action++) {
+    for(action = 0; action < actions; action++) {
         add_random_component(eid);
     }
     return eid;
@@ -78,11 +80,18 @@ unsigned int spawn(void) {
 
 unsigned int clone(unsigned int eid) {
     num_spawns++;
-    unsigned int new_eid;
+    unsigned int new_eid = 0;
     DIANA(clone, eid, &new_eid);
     return new_eid;
 }
 
+unsigned int instantiate(void) {
+    unsigned int new_eid = 0;
+    num_spawns++;
+    DIANA(instantiate, random_prefab, &new_eid);
+    return new_eid;
+}
+
 void add(unsigned int eid) {
     DIANA(signal, eid, DL_ENTITY_ADDED);
 }
@@ -129,6 +138,8 @@ void random_process(struct diana *diana, void *ud, unsigned int eid, float delta
             n_clones++;
             break;
         case 1:
+            add(instantiate());
+            n_spawns++;
             break;
         case 2:
             disable(eid);
@@ -187,6 +198,8 @@ int main(int argc, char *argv[]) {
         add(spawn());
     }
 
+    DIANA(createPrefab, spawn(), &random_prefab);
+
     clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time2);
 
     while(stati++ < 100000) {
@@ -0,0 +1,60 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int component = 0, entity, other, *remap;
+    diana_handle handle, reused, moved;
+    int value = 5;
+    void *data;
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "component", sizeof(int), DL_COMPONENT_FLAG_INLINE, &component);
+    diana_initialize(diana);
+
+    diana_spawn(diana, &entity);
+    CHECK(diana_getHandle(diana, entity, &handle) == DL_ERROR_NONE);
+    CHECK(diana_isAlive(diana, handle));
+    CHECK(diana_setComponentH(diana, handle, component, &value) == DL_ERROR_NONE);
+    CHECK(diana_getComponentH(diana, handle, component, &data) == DL_ERROR_NONE && *(int *)data == 5);
+
+    // a handle dies with the deleted pass, not with the signal
+    diana_signal(diana, entity, DL_ENTITY_DELETED);
+    CHECK(diana_isAlive(diana, handle));
+    diana_process(diana, 0);
+    CHECK(!diana_isAlive(diana, handle));
+    CHECK(diana_getHandle(diana, entity, &reused) == DL_ERROR_INVALID_VALUE);
+
+    // the reused id does not answer to the old handle
+    CHECK(diana_spawn(diana, &other) == DL_ERROR_NONE && other == entity);
+    CHECK(diana_getHandle(diana, other, &reused) == DL_ERROR_NONE);
+    CHECK(reused != handle && diana_isAlive(diana, reused) && !diana_isAlive(diana, handle));
+    CHECK(diana_setComponentH(diana, handle, component, &value) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_removeComponentH(diana, handle, component) == DL_ERROR_INVALID_VALUE);
+
+    // an entity that moves in a compaction gets a new generation
+    diana_spawn(diana, &entity);
+    diana_spawn(diana, &entity);
+    diana_getHandle(diana, entity, &moved);
+    diana_signal(diana, 1, DL_ENTITY_DELETED);
+    diana_process(diana, 0);
+    CHECK(diana_compact(diana, &remap, NULL) == DL_ERROR_NONE);
+    free(remap);
+    CHECK(!diana_isAlive(diana, moved) && diana_isAlive(diana, reused));
+    CHECK(diana_getHandle(diana, 1, &moved) == DL_ERROR_NONE && diana_isAlive(diana, moved));
+
+    // a clear kills every handle, later ones do not collide with them
+    diana_clear(diana);
+    CHECK(!diana_isAlive(diana, reused) && !diana_isAlive(diana, moved));
+    diana_spawn(diana, &entity);
+    diana_getHandle(diana, entity, &handle);
+    CHECK(handle != reused && diana_isAlive(diana, handle));
+
+    diana_free(diana);
+
+    return failures != 0;
+}
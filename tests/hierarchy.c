@@ -0,0 +1,108 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+
+// the hierarchy as "entity<parent entity ..." in breadth first order
+static void dump(struct diana *diana, char *out) {
+    unsigned int *entities = NULL, *parents = NULL, count = 0, i;
+
+    out[0] = 0;
+    CHECK(diana_getHierarchy(diana, &entities, &parents, &count) == DL_ERROR_NONE);
+    for(i = 0; i < count; i++) {
+        if(parents[i] == UINT_MAX) {
+            out += sprintf(out, "%u ", entities[i]);
+        } else {
+            CHECK(parents[i] < i);
+            out += sprintf(out, "%u<%u ", entities[i], entities[parents[i]]);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int e[8], i, parent, *children, count;
+    diana_handle three, seven;
+    char before[256], after[256];
+
+    allocate_diana(malloc, free, &diana);
+    CHECK(diana_rollback(diana, 4) == DL_ERROR_NONE);
+    diana_initialize(diana);
+
+    for(i = 0; i < 8; i++) {
+        diana_spawn(diana, e + i);
+        diana_signal(diana, e[i], DL_ENTITY_ADDED);
+    }
+    diana_process(diana, 0);
+
+    //     0       5
+    //   1   2     6
+    //   3   4
+    CHECK(diana_setParent(diana, e[3], e[1]) == DL_ERROR_NONE);
+    CHECK(diana_setParent(diana, e[1], e[0]) == DL_ERROR_NONE);
+    CHECK(diana_setParent(diana, e[2], e[0]) == DL_ERROR_NONE);
+    CHECK(diana_setParent(diana, e[4], e[2]) == DL_ERROR_NONE);
+    CHECK(diana_setParent(diana, e[6], e[5]) == DL_ERROR_NONE);
+
+    // no cycles
+    CHECK(diana_setParent(diana, e[0], e[3]) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_setParent(diana, e[0], e[0]) == DL_ERROR_INVALID_VALUE);
+
+    CHECK(diana_getParent(diana, e[4], &parent) == DL_ERROR_NONE && parent == e[2]);
+    CHECK(diana_getParent(diana, e[0], &parent) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_getChildren(diana, e[0], &children, &count) == DL_ERROR_NONE);
+    CHECK(count == 2 && children[0] == e[1] && children[1] == e[2]);
+
+    // roots in id order, then each level in turn
+    dump(diana, before);
+    CHECK(strcmp(before, "0 5 1<0 2<0 6<5 3<1 4<2 ") == 0);
+
+    // a discarded fork puts the links back, moved and deleted ones too
+    CHECK(diana_fork(diana) == DL_ERROR_NONE);
+    CHECK(diana_setParent(diana, e[4], e[6]) == DL_ERROR_NONE);
+    CHECK(diana_removeParent(diana, e[1]) == DL_ERROR_NONE);
+    CHECK(diana_setParent(diana, e[7], e[3]) == DL_ERROR_NONE);
+    diana_signal(diana, e[5], DL_ENTITY_DELETED);
+    diana_process(diana, 0);
+    dump(diana, after);
+    CHECK(strcmp(after, "0 1 2<0 3<1 7<3 ") == 0);
+    CHECK(diana_discardFork(diana) == DL_ERROR_NONE);
+    dump(diana, after);
+    CHECK(strcmp(before, after) == 0);
+    CHECK(diana_getChildren(diana, e[6], &children, &count) == DL_ERROR_NONE && count == 0);
+
+    // and so does a rewind
+    diana_process(diana, 0);
+    CHECK(diana_removeParent(diana, e[2]) == DL_ERROR_NONE);
+    CHECK(diana_setParent(diana, e[2], e[6]) == DL_ERROR_NONE);
+    diana_process(diana, 0);
+    CHECK(diana_rewind(diana, 2) == DL_ERROR_NONE);
+    dump(diana, after);
+    CHECK(strcmp(before, after) == 0);
+
+    // deleting an entity deletes everything under it, children given to it
+    // after the signal included
+    CHECK(diana_getHandle(diana, e[3], &three) == DL_ERROR_NONE);
+    CHECK(diana_getHandle(diana, e[7], &seven) == DL_ERROR_NONE);
+    diana_signal(diana, e[1], DL_ENTITY_DELETED);
+    CHECK(diana_setParent(diana, e[7], e[3]) == DL_ERROR_NONE);
+    diana_process(diana, 0);
+    CHECK(diana_isAlive(diana, three) == 0);
+    CHECK(diana_isAlive(diana, seven) == 0);
+    dump(diana, after);
+    CHECK(strcmp(after, "0 5 2<0 6<5 4<2 ") == 0);
+
+    // freed ids can not be linked again
+    CHECK(diana_setParent(diana, e[7], e[0]) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_setParent(diana, e[4], e[3]) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_removeParent(diana, e[1]) == DL_ERROR_INVALID_VALUE);
+    dump(diana, after);
+    CHECK(strcmp(after, "0 5 2<0 6<5 4<2 ") == 0);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
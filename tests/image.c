@@ -0,0 +1,130 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "check.h"
+
+static int test_write(void *user_data, const void *data, size_t size) {
+    return fwrite(data, 1, size, (FILE *)user_data) != size;
+}
+
+static unsigned int componentA, componentB, componentC, counter, num_processed = 0;
+
+static void test_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    num_processed++;
+}
+
+static struct diana *make(void) {
+    struct diana *diana;
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "a", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentA);
+    diana_createComponent(diana, "b", sizeof(long long), DL_COMPONENT_FLAG_INDEXED, &componentB);
+    diana_createComponent(diana, "c", sizeof(short), DL_COMPONENT_FLAG_MULTIPLE, &componentC);
+    diana_createSystem(diana, "counter", NULL, test_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &counter);
+    diana_watch(diana, counter, componentA);
+    diana_initialize(diana);
+    return diana;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana = make(), *loaded = make(), *again = make();
+    unsigned int entity, i, n, *remap;
+    int value;
+    long long wide = 0;
+    short small;
+    void *data, *image, *copy;
+    size_t size;
+    FILE *file;
+
+    for(i = 0; i < 300; i++) {
+        diana_spawn(diana, &entity);
+        value = i;
+        diana_setComponent(diana, entity, componentA, &value);
+        if(i % 3 == 0) {
+            wide = i * 1000LL;
+            diana_setComponent(diana, entity, componentB, &wide);
+        }
+        if(i % 5 == 0) {
+            small = i;
+            diana_appendComponent(diana, entity, componentC, &small);
+            small++;
+            diana_appendComponent(diana, entity, componentC, &small);
+        }
+        diana_signal(diana, entity, DL_ENTITY_ADDED);
+    }
+    diana_process(diana, 0);
+    for(i = 0; i < 300; i += 7) {
+        diana_signal(diana, i, DL_ENTITY_DELETED);
+    }
+    diana_process(diana, 0);
+
+    file = tmpfile();
+    CHECK(diana_saveImage(diana, test_write, file) == DL_ERROR_NONE);
+    fflush(file);
+    size = ftell(file);
+    image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+    copy = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+    CHECK(image != MAP_FAILED && copy != MAP_FAILED);
+
+    // a truncated image is refused, a loaded one can not be replaced
+    CHECK(diana_loadImage(loaded, image, size / 2) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_loadImage(loaded, image, size) == DL_ERROR_NONE);
+    CHECK(diana_loadImage(loaded, image, size) == DL_ERROR_INVALID_OPERATION);
+
+    // the rows are used where they lie
+    CHECK((unsigned char *)loaded->data >= (unsigned char *)image && (unsigned char *)loaded->data < (unsigned char *)image + size);
+    for(i = 0; i < 300; i++) {
+        if(i % 7 == 0) {
+            continue;
+        }
+        CHECK(diana_getComponent(loaded, i, componentA, &data) == DL_ERROR_NONE && *(int *)data == (int)i);
+        if(i % 3 == 0) {
+            CHECK(diana_getComponent(loaded, i, componentB, &data) == DL_ERROR_NONE && *(long long *)data == i * 1000LL);
+        }
+        if(i % 5 == 0) {
+            CHECK(diana_getComponentCount(loaded, i, componentC, &n) == DL_ERROR_NONE && n == 2);
+            CHECK(diana_getComponentI(loaded, i, componentC, 1, &data) == DL_ERROR_NONE && *(short *)data == (short)(i + 1));
+        }
+    }
+    num_processed = 0;
+    diana_process(loaded, 0);
+    CHECK(num_processed == 300 - 43);
+
+    // growing, bags in the image and compaction move what they need out of it
+    for(i = 0; i < 100; i++) {
+        diana_spawn(loaded, &entity);
+        value = 1;
+        diana_setComponent(loaded, entity, componentA, &value);
+        small = 3;
+        diana_appendComponent(loaded, entity, componentC, &small);
+        diana_setComponent(loaded, entity, componentB, &wide);
+    }
+    small = 9;
+    CHECK(diana_appendComponent(loaded, 5, componentC, &small) == DL_ERROR_NONE);
+    CHECK(diana_getComponentCount(loaded, 5, componentC, &n) == DL_ERROR_NONE && n == 3);
+    CHECK(diana_removeComponentI(loaded, 10, componentC, 0) == DL_ERROR_NONE);
+    CHECK(diana_removeComponents(loaded, 15, componentC) == DL_ERROR_NONE);
+    CHECK(diana_getComponentCount(loaded, 15, componentC, &n) == DL_ERROR_NONE && n == 0);
+    diana_signal(loaded, 10, DL_ENTITY_DELETED);
+    diana_signal(loaded, 20, DL_ENTITY_DELETED);
+    diana_process(loaded, 0);
+    CHECK(diana_compact(loaded, &remap, NULL) == DL_ERROR_NONE);
+    free(remap);
+    diana_free(loaded);
+
+    // the file underneath is untouched, another world can map it again
+    CHECK(diana_loadImage(again, copy, size) == DL_ERROR_NONE);
+    CHECK(diana_getComponent(again, 6, componentA, &data) == DL_ERROR_NONE && *(int *)data == 6);
+    diana_clear(again);
+    diana_free(again);
+
+    munmap(copy, size);
+    munmap(image, size);
+    fclose(file);
+    diana_free(diana);
+
+    return failures != 0;
+}
@@ -0,0 +1,157 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+static unsigned int componentA, componentB;
+
+// counts up, spawns an entity at 3 and deletes itself at 4
+static void step(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    unsigned int spawned = 0;
+    int *a, value = 100;
+    diana_getComponent(diana, entity, componentA, (void **)&a);
+    (*a)++;
+    if(*a == 3) {
+        diana_spawn(diana, &spawned);
+        diana_setComponent(diana, spawned, componentB, &value);
+        diana_signal(diana, spawned, DL_ENTITY_ADDED);
+    }
+    if(*a == 4) {
+        diana_signal(diana, entity, DL_ENTITY_DELETED);
+    }
+}
+
+// the live entities with their handles and values
+static void dump(struct diana *diana, char *out) {
+    unsigned int entity;
+    diana_handle handle;
+    int *data;
+
+    out[0] = 0;
+    for(entity = 0; entity < 8; entity++) {
+        if(diana_getHandle(diana, entity, &handle) != DL_ERROR_NONE) {
+            continue;
+        }
+        out += sprintf(out, "%u:%llx", entity, (unsigned long long)handle);
+        if(diana_getComponent(diana, entity, componentA, (void **)&data) == DL_ERROR_NONE) {
+            out += sprintf(out, "a%d", *data);
+        }
+        if(diana_getComponent(diana, entity, componentB, (void **)&data) == DL_ERROR_NONE) {
+            out += sprintf(out, "b%d", *data);
+        }
+        out += sprintf(out, ";");
+    }
+}
+
+struct buffer {
+    unsigned char data[1 << 16];
+    size_t size, position;
+    int failing;
+};
+
+static int buffer_write(void *user_data, const void *data, size_t size) {
+    struct buffer *buffer = (struct buffer *)user_data;
+    if(buffer->failing) {
+        return 1;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 0;
+}
+
+static int buffer_read(void *user_data, void *data, size_t size) {
+    struct buffer *buffer = (struct buffer *)user_data;
+    if(size > buffer->size - buffer->position) {
+        return 1;
+    }
+    memcpy(data, buffer->data + buffer->position, size);
+    buffer->position += size;
+    return 0;
+}
+
+static struct buffer snapshot, journal, later;
+
+static struct diana *make(void) {
+    struct diana *diana;
+    unsigned int system = 0;
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "a", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentA);
+    diana_createComponent(diana, "b", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentB);
+    diana_createSystem(diana, "step", NULL, step, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &system);
+    diana_watch(diana, system, componentA);
+    diana_initialize(diana);
+    return diana;
+}
+
+// a fresh world from a snapshot with the journal played over it
+static void recover(struct buffer *from, size_t journalSize, char *out) {
+    struct diana *diana = make();
+    from->position = 0;
+    journal.position = 0;
+    journal.size = journalSize;
+    CHECK(diana_load(diana, buffer_read, from) == DL_ERROR_NONE);
+    CHECK(diana_replayJournal(diana, buffer_read, &journal) == DL_ERROR_NONE);
+    dump(diana, out);
+    diana_free(diana);
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int entity, i;
+    int value = 0;
+    char states[6][512], now[512];
+    size_t ends[6], full;
+
+    diana = make();
+    diana_spawn(diana, &entity);
+    diana_setComponent(diana, entity, componentA, &value);
+    diana_signal(diana, entity, DL_ENTITY_ADDED);
+    diana_process(diana, 0);
+
+    CHECK(diana_save(diana, buffer_write, &snapshot) == DL_ERROR_NONE);
+    CHECK(diana_commitJournal(diana) == DL_ERROR_INVALID_OPERATION);
+    CHECK(diana_journal(diana, buffer_write, &journal) == DL_ERROR_NONE);
+    CHECK(diana_saveDelta(diana, buffer_write, &later) == DL_ERROR_INVALID_OPERATION);
+
+    diana_spawn(diana, &entity);
+    value = 1;
+    diana_setComponent(diana, entity, componentA, &value);
+    diana_signal(diana, entity, DL_ENTITY_ADDED);
+    for(i = 0; i < 6; i++) {
+        CHECK(diana_process(diana, 0) == DL_ERROR_NONE);
+        dump(diana, states[i]);
+        ends[i] = journal.size;
+        if(i == 2) {
+            CHECK(diana_save(diana, buffer_write, &later) == DL_ERROR_NONE);
+        }
+    }
+    full = journal.size;
+
+    // the whole journal over the first snapshot
+    recover(&snapshot, full, now);
+    CHECK(!strcmp(now, states[5]));
+
+    // records older than a newer snapshot are skipped
+    recover(&later, full, now);
+    CHECK(!strcmp(now, states[5]));
+
+    // a torn tail stops replay at the last whole record
+    recover(&snapshot, ends[3] + 5, now);
+    CHECK(!strcmp(now, states[3]));
+
+    // so does a record whose checksum does not match
+    journal.data[ends[3] + 12] ^= 0xff;
+    recover(&snapshot, ends[4], now);
+    CHECK(!strcmp(now, states[3]));
+
+    // a failed write is reported by diana_process and closes the journal
+    journal.failing = 1;
+    CHECK(diana_process(diana, 0) == DL_ERROR_IO);
+    CHECK(diana_commitJournal(diana) == DL_ERROR_INVALID_OPERATION);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
@@ -0,0 +1,86 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#include "check.h"
+
+struct account {
+    int id;
+    int team;
+};
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int account, tag, byId, byTeam, byTag, entity, other, copy, prefab, entities[2], *found, count;
+    struct account a = { 1, 7 }, b = { 2, 7 }, *data;
+    int id, value = 5;
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "account", sizeof(struct account), DL_COMPONENT_FLAG_INDEXED, &account);
+    CHECK(diana_createKeyIndex(diana, account, offsetof(struct account, id), sizeof(int), DL_KEY_INDEX_UNIQUE, &byId) == DL_ERROR_NONE);
+    CHECK(diana_createKeyIndex(diana, account, offsetof(struct account, team), sizeof(int), DL_KEY_INDEX_MULTIPLE, &byTeam) == DL_ERROR_NONE);
+    diana_createComponent(diana, "tag", sizeof(int), DL_COMPONENT_FLAG_INLINE, &tag);
+    CHECK(diana_createKeyIndex(diana, tag, 0, sizeof(int), DL_KEY_INDEX_UNIQUE, &byTag) == DL_ERROR_NONE);
+    diana_initialize(diana);
+
+    diana_spawn(diana, &entity);
+    CHECK(diana_setComponent(diana, entity, account, &a) == DL_ERROR_NONE);
+    diana_spawn(diana, &other);
+    CHECK(diana_setComponent(diana, other, account, &b) == DL_ERROR_NONE);
+
+    id = 2;
+    CHECK(diana_lookup(diana, byId, &id, &copy) == DL_ERROR_NONE && copy == other);
+    CHECK(diana_lookupAll(diana, byTeam, &a.team, &found, &count) == DL_ERROR_NONE && count == 2);
+
+    // a taken key is refused and nothing is written
+    CHECK(diana_setComponent(diana, other, account, &a) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_getComponent(diana, other, account, (void **)&data) == DL_ERROR_NONE && data->id == 2);
+    CHECK(diana_lookup(diana, byId, &a.id, &copy) == DL_ERROR_NONE && copy == entity);
+
+    // a clone would share its parent's key, it is refused and its entity is
+    // released, so the next spawn gets it back
+    copy = UINT_MAX;
+    CHECK(diana_clone(diana, entity, &copy) == DL_ERROR_INVALID_VALUE);
+    CHECK(copy == UINT_MAX);
+    diana_spawn(diana, &copy);
+    CHECK(copy == other + 1);
+    CHECK(diana_getComponent(diana, copy, account, (void **)&data) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_lookupAll(diana, byTeam, &a.team, &found, &count) == DL_ERROR_NONE && count == 2);
+
+    // the same goes for prefabs
+    CHECK(diana_createPrefab(diana, entity, &prefab) == DL_ERROR_NONE);
+    CHECK(diana_instantiate(diana, prefab, &copy) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_lookup(diana, byId, &a.id, &copy) == DL_ERROR_NONE && copy == entity);
+
+    // and an instance may clash with one made before it in the same batch
+    diana_signal(diana, entity, DL_ENTITY_DELETED);
+    diana_process(diana, 0);
+    CHECK(diana_lookup(diana, byId, &a.id, &copy) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_instantiateN(diana, prefab, 2, entities) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_lookup(diana, byId, &a.id, &copy) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_instantiate(diana, prefab, &copy) == DL_ERROR_NONE);
+    CHECK(diana_lookup(diana, byId, &a.id, &entity) == DL_ERROR_NONE && entity == copy);
+
+    // keys in inline components are checked the same way
+    diana_spawn(diana, &entity);
+    CHECK(diana_setComponent(diana, entity, tag, &value) == DL_ERROR_NONE);
+    other = UINT_MAX;
+    CHECK(diana_clone(diana, entity, &other) == DL_ERROR_INVALID_VALUE);
+    CHECK(other == UINT_MAX);
+    CHECK(diana_createPrefab(diana, entity, &prefab) == DL_ERROR_NONE);
+    CHECK(diana_instantiate(diana, prefab, &other) == DL_ERROR_INVALID_VALUE);
+    CHECK(other == UINT_MAX);
+    CHECK(diana_lookupAll(diana, byTag, &value, &found, &count) == DL_ERROR_NONE && count == 1 && found[0] == entity);
+    diana_signal(diana, entity, DL_ENTITY_DELETED);
+    diana_process(diana, 0);
+    CHECK(diana_instantiateN(diana, prefab, 2, entities) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_lookup(diana, byTag, &value, &other) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_instantiate(diana, prefab, &other) == DL_ERROR_NONE);
+    CHECK(diana_lookup(diana, byTag, &value, &entity) == DL_ERROR_NONE && entity == other);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
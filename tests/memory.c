@@ -0,0 +1,56 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int inlined, indexed, multiple, system = 0, entity, i;
+    size_t used, reserved, totalUsed, totalReserved;
+    long long value[2] = {0, 0};
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "inline", 4, DL_COMPONENT_FLAG_INLINE, &inlined);
+    diana_createComponent(diana, "indexed", 16, DL_COMPONENT_FLAG_INDEXED, &indexed);
+    diana_createComponent(diana, "multiple", 8, DL_COMPONENT_FLAG_MULTIPLE, &multiple);
+    diana_createSystem(diana, "system", NULL, NULL, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &system);
+    CHECK(diana_getMemoryStats(diana, DL_MEMORY_TOTAL, 0, &used, &reserved) == DL_ERROR_INVALID_OPERATION);
+    diana_initialize(diana);
+
+    for(i = 0; i < 100; i++) {
+        diana_spawn(diana, &entity);
+        diana_setComponent(diana, entity, inlined, value);
+        if(i % 2) {
+            diana_setComponent(diana, entity, indexed, value);
+        }
+        if(i % 4 == 0) {
+            diana_appendComponent(diana, entity, multiple, value);
+            diana_appendComponent(diana, entity, multiple, value);
+        }
+        diana_signal(diana, entity, DL_ENTITY_ADDED);
+    }
+
+    // pools report slots and bytes, a chunk at a time
+    CHECK(diana_getMemoryStats(diana, DL_MEMORY_POOL_SLOTS, indexed, &used, &reserved) == DL_ERROR_NONE && used == 50 && reserved == 64);
+    CHECK(diana_getMemoryStats(diana, DL_MEMORY_POOL, indexed, &used, &reserved) == DL_ERROR_NONE && used == 800 && reserved >= 1024);
+    CHECK(diana_getMemoryStats(diana, DL_MEMORY_BAGS, multiple, &used, &reserved) == DL_ERROR_NONE && used == 25 * 2 * 4);
+
+    // row columns of components an entity does not have are wasted
+    CHECK(diana_getMemoryStats(diana, DL_MEMORY_WASTED, 0, &used, &reserved) == DL_ERROR_NONE);
+    CHECK(reserved == 100 * (4 + 4 + sizeof(struct _componentBag)));
+    CHECK(used == 50 * 4 + 75 * sizeof(struct _componentBag));
+
+    CHECK(diana_getMemoryStats(diana, DL_MEMORY_ENTITIES, 0, &used, &reserved) == DL_ERROR_NONE && used <= reserved);
+    CHECK(diana_getMemoryStats(diana, DL_MEMORY_SIGNALS, 0, &used, &reserved) == DL_ERROR_NONE && used > 0);
+    CHECK(diana_getMemoryStats(diana, DL_MEMORY_TOTAL, 0, &totalUsed, &totalReserved) == DL_ERROR_NONE && totalUsed <= totalReserved);
+    CHECK(totalUsed >= used);
+
+    CHECK(diana_getMemoryStats(diana, DL_MEMORY_SYSTEM, system + 1, &used, &reserved) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_getMemoryStats(diana, DL_MEMORY_OTHER + 1, 0, &used, &reserved) == DL_ERROR_INVALID_VALUE);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
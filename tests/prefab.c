@@ -0,0 +1,74 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+// fail the bag allocations of five instances after letting some through
+static int failing = 0, passing = 0;
+
+static void *test_malloc(size_t size) {
+    if(failing && size == sizeof(unsigned int) * 5 && passing-- <= 0) {
+        return NULL;
+    }
+    return malloc(size);
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int inlined, indexed, multiple, entity, prefab, other, i, n, entities[100];
+    int value;
+    long long wide;
+    void *data;
+
+    allocate_diana(test_malloc, free, &diana);
+    diana_createComponent(diana, "inline", sizeof(int), DL_COMPONENT_FLAG_INLINE, &inlined);
+    diana_createComponent(diana, "indexed", sizeof(long long), DL_COMPONENT_FLAG_INDEXED, &indexed);
+    diana_createComponent(diana, "multiple", sizeof(int), DL_COMPONENT_FLAG_MULTIPLE, &multiple);
+    diana_initialize(diana);
+
+    diana_spawn(diana, &entity);
+    value = 7;
+    diana_setComponent(diana, entity, inlined, &value);
+    wide = 99;
+    diana_setComponent(diana, entity, indexed, &wide);
+    for(i = 0; i < 5; i++) {
+        value = 100 + i;
+        diana_appendComponent(diana, entity, multiple, &value);
+    }
+    CHECK(diana_createPrefab(diana, entity, &prefab) == DL_ERROR_NONE);
+
+    // every instance gets its own copies of the captured values
+    CHECK(diana_instantiateN(diana, prefab, 100, entities) == DL_ERROR_NONE);
+    for(i = 0; i < 100; i++) {
+        CHECK(diana_getComponent(diana, entities[i], inlined, &data) == DL_ERROR_NONE && *(int *)data == 7);
+        CHECK(diana_getComponent(diana, entities[i], indexed, &data) == DL_ERROR_NONE && *(long long *)data == 99);
+        CHECK(diana_getComponentCount(diana, entities[i], multiple, &n) == DL_ERROR_NONE && n == 5);
+        CHECK(diana_getComponentI(diana, entities[i], multiple, 3, &data) == DL_ERROR_NONE && *(int *)data == 103);
+    }
+    value = 1;
+    diana_setComponentI(diana, entities[0], multiple, 3, &value);
+    CHECK(diana_getComponentI(diana, entities[1], multiple, 3, &data) == DL_ERROR_NONE && *(int *)data == 103);
+
+    // a failed instance is released and never handed out
+    other = UINT_MAX;
+    failing = 1;
+    CHECK(diana_instantiate(diana, prefab, &other) == DL_ERROR_OUT_OF_MEMORY);
+    passing = 2;
+    CHECK(diana_instantiateN(diana, prefab, 3, entities) == DL_ERROR_OUT_OF_MEMORY);
+    failing = 0;
+    CHECK(other == UINT_MAX);
+    for(i = 0; i < 3; i++) {
+        CHECK(diana_spawn(diana, &other) == DL_ERROR_NONE && other >= 101 && other < 104);
+        CHECK(diana_getComponentCount(diana, other, multiple, &n) == DL_ERROR_NONE && n == 0);
+    }
+    CHECK(diana_process(diana, 0) == DL_ERROR_NONE);
+
+    CHECK(diana_freePrefab(diana, prefab) == DL_ERROR_NONE);
+    CHECK(diana_instantiate(diana, prefab, &other) == DL_ERROR_INVALID_VALUE);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
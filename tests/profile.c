@@ -0,0 +1,70 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+// a fake clock that each callback moves forward by a known amount
+static unsigned long long now = 0;
+
+static unsigned long long test_clock(void *user_data) {
+    return now;
+}
+
+static void test_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    now += 10;
+}
+
+static void test_ending(struct diana *diana, void *user_data) {
+    now += 1000;
+}
+
+static void test_added(struct diana *diana, void *user_data, unsigned int entity) {
+    now += 7;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int component, system = 0, manager = 0, entity, i;
+    unsigned long long p50, p99, max;
+    int value = 0;
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "component", sizeof(int), DL_COMPONENT_FLAG_INLINE, &component);
+    diana_createSystem(diana, "system", NULL, test_process, test_ending, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &system);
+    diana_watch(diana, system, component);
+    diana_createManager(diana, "manager", test_added, NULL, NULL, NULL, NULL, 0, &manager);
+    CHECK(diana_profile(diana, test_clock, NULL) == DL_ERROR_INVALID_OPERATION);
+    diana_initialize(diana);
+    CHECK(diana_getProfile(diana, DL_PROFILE_FRAME, 0, &p50, &p99, &max) == DL_ERROR_INVALID_OPERATION);
+
+    diana_process(diana, 0);
+    CHECK(diana_profile(diana, test_clock, NULL) == DL_ERROR_NONE);
+    CHECK(diana_getProfile(diana, DL_PROFILE_FRAME, 0, &p50, &p99, &max) == DL_ERROR_NONE && max == 0);
+
+    // one more entity each frame, so process takes 10, 20 ... 1000
+    for(i = 0; i < 100; i++) {
+        diana_spawn(diana, &entity);
+        diana_setComponent(diana, entity, component, &value);
+        diana_signal(diana, entity, DL_ENTITY_ADDED);
+        diana_process(diana, 0);
+    }
+    CHECK(diana_getProfile(diana, DL_PROFILE_PROCESS, system, &p50, &p99, &max) == DL_ERROR_NONE);
+    CHECK(max == 1000 && p50 == 500 && p99 == 990);
+    CHECK(diana_getProfile(diana, DL_PROFILE_ENDING, system, &p50, &p99, &max) == DL_ERROR_NONE && p50 == 1000 && max == 1000);
+    CHECK(diana_getProfile(diana, DL_PROFILE_STARTING, system, &p50, &p99, &max) == DL_ERROR_NONE && max == 0);
+    CHECK(diana_getProfile(diana, DL_PROFILE_MANAGER, manager, &p50, &p99, &max) == DL_ERROR_NONE && max == 7 && p50 == 7);
+    CHECK(diana_getProfile(diana, DL_PROFILE_SIGNAL, DL_ENTITY_ADDED, &p50, &p99, &max) == DL_ERROR_NONE && max == 7);
+    CHECK(diana_getProfile(diana, DL_PROFILE_FRAME, 0, &p50, &p99, &max) == DL_ERROR_NONE && max == 2007);
+    CHECK(diana_getProfile(diana, DL_PROFILE_MANAGER, manager + 1, &p50, &p99, &max) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_getProfile(diana, DL_PROFILE_SIGNAL, 4, &p50, &p99, &max) == DL_ERROR_INVALID_VALUE);
+
+    // turning it off again
+    CHECK(diana_profile(diana, NULL, NULL) == DL_ERROR_NONE);
+    CHECK(diana_process(diana, 0) == DL_ERROR_NONE);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
@@ -0,0 +1,100 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+enum { EVERY, THIRD, INTERVAL, BUDGET };
+
+static int runs[4];
+static float deltas[4];
+static unsigned int seen[16];
+static unsigned long long now;
+
+static void test_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    int which = (int)(size_t)user_data;
+    runs[which]++;
+    deltas[which] = delta;
+    if(which == BUDGET) {
+        seen[entity]++;
+        // every entity costs the budgeted system 10ns
+        now += 10;
+    }
+}
+
+static unsigned long long test_clock(void *user_data) {
+    return now;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int component, every, third, interval, budget, entity, i;
+    int value = 0;
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "component", sizeof(int), DL_COMPONENT_FLAG_INLINE, &component);
+    diana_createSystem(diana, "every", NULL, test_process, NULL, NULL, NULL, (void *)EVERY, DL_SYSTEM_FLAG_NORMAL, &every);
+    diana_createSystem(diana, "third", NULL, test_process, NULL, NULL, NULL, (void *)THIRD, DL_SYSTEM_FLAG_NORMAL, &third);
+    diana_createSystem(diana, "interval", NULL, test_process, NULL, NULL, NULL, (void *)INTERVAL, DL_SYSTEM_FLAG_NORMAL, &interval);
+    diana_createSystem(diana, "budget", NULL, test_process, NULL, NULL, NULL, (void *)BUDGET, DL_SYSTEM_FLAG_NORMAL, &budget);
+    diana_watch(diana, every, component);
+    diana_watch(diana, third, component);
+    diana_watch(diana, interval, component);
+    diana_watch(diana, budget, component);
+
+    // a system runs every n frames or every interval seconds, not both
+    CHECK(diana_systemRate(diana, third, 3, 0.5f) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_systemRate(diana, third, 3, 0) == DL_ERROR_NONE);
+    CHECK(diana_systemRate(diana, interval, 0, 0.25f) == DL_ERROR_NONE);
+    CHECK(diana_systemBudget(diana, budget, 25) == DL_ERROR_NONE);
+    diana_initialize(diana);
+    CHECK(diana_systemRate(diana, third, 2, 0) == DL_ERROR_INVALID_OPERATION);
+
+    for(i = 0; i < 10; i++) {
+        diana_spawn(diana, &entity);
+        diana_setComponent(diana, entity, component, &value);
+        diana_signal(diana, entity, DL_ENTITY_ADDED);
+    }
+
+    // without a profiling clock the budget is not enforced
+    diana_process(diana, 0.1f);
+    CHECK(runs[EVERY] == 10);
+    CHECK(runs[BUDGET] == 10);
+    CHECK(runs[THIRD] == 0);
+    CHECK(runs[INTERVAL] == 0);
+
+    diana_profile(diana, test_clock, NULL);
+    runs[BUDGET] = 0;
+    for(i = 0; i < 10; i++) {
+        seen[i] = 0;
+    }
+
+    // 25ns fit three entities a frame
+    diana_process(diana, 0.1f);
+    CHECK(runs[BUDGET] == 3);
+
+    // the skipped frames' deltas add up
+    diana_process(diana, 0.1f);
+    CHECK(runs[THIRD] == 10);
+    CHECK(deltas[THIRD] > 0.299f && deltas[THIRD] < 0.301f);
+    CHECK(runs[INTERVAL] == 10);
+    CHECK(deltas[INTERVAL] > 0.299f && deltas[INTERVAL] < 0.301f);
+
+    // the budgeted pass picks up where it stopped, each entity is seen once
+    diana_process(diana, 0.1f);
+    diana_process(diana, 0.1f);
+    for(i = 0; i < 10; i++) {
+        CHECK(seen[i] == 1);
+    }
+
+    // and then starts over
+    diana_process(diana, 0.1f);
+    CHECK(seen[0] == 2);
+    CHECK(seen[3] == 1);
+    CHECK(runs[EVERY] == 60);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
@@ -0,0 +1,106 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+// records a small workload for the ReplayTest to play back, the replay has to
+// hand out the same entity ids
+
+static unsigned int position, velocity, tag, mover, spawner;
+static int frame;
+
+static void mover_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    float *p, *v, moved;
+    diana_getComponent(diana, entity, position, (void **)&p);
+    if(diana_getComponent(diana, entity, velocity, (void **)&v) != DL_ERROR_NONE) {
+        return;
+    }
+    moved = *p + *v * delta;
+    diana_setComponent(diana, entity, position, &moved);
+    if(moved > 50) {
+        diana_signal(diana, entity, DL_ENTITY_DELETED);
+    }
+}
+
+// spawns from inside diana_process
+static void spawner_starting(struct diana *diana, void *user_data) {
+    unsigned int entity = 0;
+    float zero = 0, speed = 3;
+    int value = frame;
+    diana_spawn(diana, &entity);
+    diana_setComponent(diana, entity, position, &zero);
+    diana_setComponent(diana, entity, velocity, &speed);
+    diana_appendComponent(diana, entity, tag, &value);
+    diana_signal(diana, entity, DL_ENTITY_ADDED);
+}
+
+static void spawner_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+}
+
+static int test_write(void *user_data, const void *data, size_t size) {
+    return fwrite(data, 1, size, (FILE *)user_data) != size;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int entity = 0, i, prefab, entities[4], *remap;
+    float one = 1, two = 2;
+    FILE *file;
+
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s <recording>\n", argv[0]);
+        return 1;
+    }
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "position", sizeof(float), DL_COMPONENT_FLAG_INLINE, &position);
+    diana_createComponent(diana, "velocity", sizeof(float), DL_COMPONENT_FLAG_INDEXED, &velocity);
+    diana_createComponent(diana, "tag", sizeof(int), DL_COMPONENT_FLAG_MULTIPLE, &tag);
+    diana_createSystem(diana, "mover", NULL, mover_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &mover);
+    diana_watch(diana, mover, position);
+    diana_watch(diana, mover, velocity);
+    diana_createSystem(diana, "spawner", spawner_starting, spawner_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &spawner);
+    diana_watch(diana, spawner, tag);
+    diana_initialize(diana);
+
+    // the world as it was before the recording starts is part of it
+    for(i = 0; i < 20; i++) {
+        diana_spawn(diana, &entity);
+        diana_setComponent(diana, entity, position, &one);
+        diana_setComponent(diana, entity, velocity, &two);
+        diana_signal(diana, entity, DL_ENTITY_ADDED);
+    }
+    diana_process(diana, 1);
+
+    file = fopen(argv[1], "wb");
+    CHECK(file != NULL);
+    if(file == NULL) {
+        return 1;
+    }
+    CHECK(diana_record(diana, test_write, file) == DL_ERROR_NONE);
+    for(frame = 0; frame < 40; frame++) {
+        diana_spawn(diana, &entity);
+        diana_clone(diana, 0, &entity);
+        diana_signal(diana, entity, DL_ENTITY_ADDED);
+        if(frame == 5) {
+            CHECK(diana_createPrefab(diana, 1, &prefab) == DL_ERROR_NONE);
+            CHECK(diana_instantiateN(diana, prefab, 4, entities) == DL_ERROR_NONE);
+            CHECK(diana_instantiate(diana, prefab, &entity) == DL_ERROR_NONE);
+            diana_signal(diana, entity, DL_ENTITY_ADDED);
+        }
+        if(frame == 30) {
+            CHECK(diana_compact(diana, &remap, NULL) == DL_ERROR_NONE);
+            free(remap);
+        }
+        diana_removeComponent(diana, 2, velocity);
+        CHECK(diana_process(diana, 0.5f) == DL_ERROR_NONE);
+    }
+    CHECK(diana_record(diana, NULL, NULL) == DL_ERROR_NONE);
+    fclose(file);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
@@ -0,0 +1,498 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+// DianaReplay <recording>
+// makes the calls in a recording from diana_record again, on a world made
+// from the description at its start and loaded with the snapshot after it.
+// systems and managers get callbacks that do nothing; what the real ones
+// called is in the recording right after the diana_process it was called in,
+// and is made again there. prints one JSON object per line for each kind of
+// call, split by whether it was made while processing, then a summary:
+// {"phase":"set","processing":false,"calls":1000,"ns":12300,"ns_per_call":12.3,"allocs":10,"bytes":4096}
+// {"phase":"total","frames":60,"calls":60000,"ns":1230000,"diverged":0,"failed":0}
+
+size_t allocations = 0, num_allocated = 0;
+
+void *replay_malloc(size_t size) {
+    allocations++;
+    num_allocated += size;
+    return malloc(size);
+}
+
+void replay_free(void *ptr) {
+    free(ptr);
+}
+
+const char *phases[DL_RECORD_OPS] = {
+    "spawn", "clone", "signal", "set", "get", "remove", "append", "remove_all", "mark_changed",
+    "create_prefab", "instantiate", "instantiate_n", "free_prefab", "process", "process_system",
+    "clear", "compact", "rewind", "fork", "discard_fork", "keep_fork", "schedule_timer", "cancel_timer",
+    "set_parent", "remove_parent"
+};
+
+struct phase {
+    unsigned long long calls, ns, allocs, bytes;
+};
+
+struct phase totals[DL_RECORD_OPS][2];
+
+void replay_starting(struct diana *diana, void *userData) {
+}
+
+void replay_process(struct diana *diana, void *userData, unsigned int entity, float delta) {
+}
+
+void replay_entity(struct diana *diana, void *userData, unsigned int entity) {
+}
+
+void replay_fired(struct diana *diana, void *userData, unsigned int entity, unsigned int payload) {
+}
+
+#define CALLBACK(BITS, BIT, F) ((BITS) & (BIT) ? (F) : NULL)
+
+unsigned long long now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+char *readString(struct _stream *stream) {
+    unsigned int length = _stream_readUInt(stream);
+    char *string;
+    if(stream->err != DL_ERROR_NONE || length > 4096) {
+        stream->err = DL_ERROR_INVALID_VALUE;
+        return NULL;
+    }
+    string = calloc(length + 1, 1);
+    _stream_read(stream, string, length);
+    return string;
+}
+
+unsigned int readUInt(struct _imageReader *reader, int *err) {
+    unsigned int i = 0, shift = 0;
+    unsigned char byte;
+    do {
+        if(reader->pos >= reader->size || shift > 28) {
+            *err = DL_ERROR_INVALID_VALUE;
+            return 0;
+        }
+        byte = reader->image[reader->pos++];
+        i |= (unsigned int)(byte & 0x7f) << shift;
+        shift += 7;
+    } while(byte & 0x80);
+    return i;
+}
+
+// the data of a write, NULL when there is none
+const void *readData(struct _imageReader *reader, size_t size, int *err) {
+    const void *data;
+    if(reader->pos >= reader->size) {
+        *err = DL_ERROR_INVALID_VALUE;
+        return NULL;
+    }
+    if(!reader->image[reader->pos++]) {
+        return NULL;
+    }
+    if(size > reader->size - reader->pos) {
+        *err = DL_ERROR_INVALID_VALUE;
+        return NULL;
+    }
+    data = reader->image + reader->pos;
+    reader->pos += size;
+    return data;
+}
+
+int build(struct diana *diana, struct _stream *stream) {
+    unsigned int policy, frames, timers, rate, n, i, k, count, id, bits, flags, size;
+    float interval;
+    char *name;
+    int err;
+
+    if(_stream_readUInt(stream) != DL_RECORD_MAGIC || _stream_readUInt(stream) != DL_RECORD_VERSION) {
+        return DL_ERROR_INVALID_VALUE;
+    }
+
+    policy = _stream_readUInt(stream);
+    frames = _stream_readUInt(stream);
+    timers = _stream_readUInt(stream);
+    _stream_read(stream, &interval, sizeof(interval));
+    if((err = diana_entityRecycling(diana, policy)) != DL_ERROR_NONE || (err = diana_rollback(diana, frames)) != DL_ERROR_NONE) {
+        return err;
+    }
+    if(timers && (err = diana_timers(diana, interval, replay_fired, NULL)) != DL_ERROR_NONE) {
+        return err;
+    }
+
+    n = _stream_readUInt(stream);
+    for(i = 0; i < n && stream->err == DL_ERROR_NONE; i++) {
+        name = readString(stream);
+        size = _stream_readUInt(stream);
+        flags = _stream_readUInt(stream);
+        err = stream->err == DL_ERROR_NONE ? diana_createComponent(diana, name, size, flags, &id) : stream->err;
+        free(name);
+        if(err != DL_ERROR_NONE) {
+            return err;
+        }
+    }
+
+    n = _stream_readUInt(stream);
+    for(i = 0; i < n && stream->err == DL_ERROR_NONE; i++) {
+        struct _sparseIntegerSet watch, exclude, changed;
+        unsigned int component;
+
+        name = readString(stream);
+        flags = _stream_readUInt(stream);
+        rate = _stream_readUInt(stream);
+        _stream_read(stream, &interval, sizeof(interval));
+        bits = _stream_readUInt(stream);
+        err = stream->err == DL_ERROR_NONE ? diana_createSystem(diana, name, CALLBACK(bits, 1, replay_starting), replay_process, CALLBACK(bits, 2, replay_starting), CALLBACK(bits, 4, replay_entity), CALLBACK(bits, 8, replay_entity), NULL, flags, &id) : stream->err;
+        free(name);
+        if(err != DL_ERROR_NONE || (err = diana_systemRate(diana, id, rate, interval)) != DL_ERROR_NONE) {
+            return err;
+        }
+
+        memset(&watch, 0, sizeof(watch));
+        memset(&exclude, 0, sizeof(exclude));
+        memset(&changed, 0, sizeof(changed));
+        _stream_readSparseSet(diana, stream, &watch, diana->num_components);
+        _stream_readSparseSet(diana, stream, &exclude, diana->num_components);
+        _stream_readSparseSet(diana, stream, &changed, diana->num_components);
+        FOREACH_SPARSEINTSET(component, k, &watch) {
+            if(_sparseIntegerSet_contains(diana, &changed, component)) {
+                diana_watchChanged(diana, id, component);
+            } else {
+                diana_watch(diana, id, component);
+            }
+        }
+        FOREACH_SPARSEINTSET(component, k, &exclude) {
+            diana_exclude(diana, id, component);
+        }
+        _sparseIntegerSet_free(diana, &watch);
+        _sparseIntegerSet_free(diana, &exclude);
+        _sparseIntegerSet_free(diana, &changed);
+
+        count = _stream_readUInt(stream);
+        for(k = 0; k < count && stream->err == DL_ERROR_NONE; k++) {
+            component = _stream_readUInt(stream);
+            diana_subscribeComponentEvents(diana, id, component, _stream_readUInt(stream));
+        }
+    }
+
+    n = _stream_readUInt(stream);
+    for(i = 0; i < n && stream->err == DL_ERROR_NONE; i++) {
+        name = readString(stream);
+        flags = _stream_readUInt(stream);
+        bits = _stream_readUInt(stream);
+        err = stream->err == DL_ERROR_NONE ? diana_createManager(diana, name, CALLBACK(bits, 1, replay_entity), CALLBACK(bits, 2, replay_entity), CALLBACK(bits, 4, replay_entity), CALLBACK(bits, 8, replay_entity), NULL, flags, &id) : stream->err;
+        free(name);
+        if(err != DL_ERROR_NONE) {
+            return err;
+        }
+    }
+
+    // spatial and key indexes are kept up as in the recorded world, queries
+    // and lookups are not recorded
+    n = _stream_readUInt(stream);
+    for(i = 0; i < n && stream->err == DL_ERROR_NONE; i++) {
+        size_t offsets[3] = { 0, 0, 0 };
+        unsigned int component = _stream_readUInt(stream);
+        count = _stream_readUInt(stream);
+        for(k = 0; k < count && k < 3; k++) {
+            offsets[k] = _stream_readUInt(stream);
+        }
+        _stream_read(stream, &interval, sizeof(interval));
+        err = stream->err == DL_ERROR_NONE ? diana_createSpatialIndex(diana, component, count, offsets, interval, &id) : stream->err;
+        if(err != DL_ERROR_NONE) {
+            return err;
+        }
+    }
+
+    n = _stream_readUInt(stream);
+    for(i = 0; i < n && stream->err == DL_ERROR_NONE; i++) {
+        unsigned int component = _stream_readUInt(stream);
+        size_t offset = _stream_readUInt(stream);
+        size = _stream_readUInt(stream);
+        flags = _stream_readUInt(stream);
+        err = stream->err == DL_ERROR_NONE ? diana_createKeyIndex(diana, component, offset, size, flags, &id) : stream->err;
+        if(err != DL_ERROR_NONE) {
+            return err;
+        }
+    }
+
+    if(stream->err != DL_ERROR_NONE) {
+        return stream->err;
+    }
+
+    return diana_initialize(diana);
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    struct _imageReader reader;
+    struct _stream stream = { NULL, _imageReader_read, &reader, DL_ERROR_NONE };
+    unsigned char *image;
+    unsigned int *prefabs = NULL, prefabsCapacity = 0, *entities = NULL, entitiesCapacity = 0, *timers = NULL, timersCapacity = 0, timer, number;
+    unsigned long long frames = 0, calls = 0, ns = 0, diverged = 0, failed = 0;
+    long size;
+    FILE *file;
+    unsigned int op, nested;
+    int err;
+
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s <recording>\n", argv[0]);
+        return 1;
+    }
+
+    file = fopen(argv[1], "rb");
+    if(file == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    image = malloc(size > 0 ? size : 1);
+    if(size <= 0 || fread(image, 1, size, file) != (size_t)size) {
+        fprintf(stderr, "%s: can not read\n", argv[1]);
+        return 1;
+    }
+    fclose(file);
+
+    reader.image = image;
+    reader.size = size;
+    reader.pos = 0;
+
+    allocate_diana(replay_malloc, replay_free, &diana);
+    err = build(diana, &stream);
+    if(err == DL_ERROR_NONE) {
+        err = diana_load(diana, _imageReader_read, &reader);
+    }
+    if(err != DL_ERROR_NONE) {
+        fprintf(stderr, "%s: not a recording this build can replay (%i)\n", argv[1], err);
+        return 1;
+    }
+
+    while(reader.pos < reader.size) {
+        unsigned int a, b, c, recorded, entity, prefab, count;
+        unsigned long long start, allocs = allocations, bytes = num_allocated;
+        const void *data;
+        void *ptr;
+        float delta;
+        int result = DL_ERROR_NONE;
+
+        err = DL_ERROR_NONE;
+        op = reader.image[reader.pos++];
+        nested = (op & DL_RECORD_PROCESSING) != 0;
+        op &= ~DL_RECORD_PROCESSING;
+
+        start = now();
+        switch(op) {
+        case DL_RECORD_SPAWN:
+            recorded = readUInt(&reader, &err);
+            start = now();
+            result = diana_spawn(diana, &entity);
+            diverged += result == DL_ERROR_NONE && entity != recorded;
+            break;
+        case DL_RECORD_CLONE:
+            a = readUInt(&reader, &err);
+            recorded = readUInt(&reader, &err);
+            start = now();
+            result = diana_clone(diana, a, &entity);
+            diverged += result == DL_ERROR_NONE && entity != recorded;
+            break;
+        case DL_RECORD_SIGNAL:
+            a = readUInt(&reader, &err);
+            b = readUInt(&reader, &err);
+            start = now();
+            result = diana_signal(diana, a, b);
+            break;
+        case DL_RECORD_SET:
+        case DL_RECORD_APPEND:
+            a = readUInt(&reader, &err);
+            b = readUInt(&reader, &err);
+            c = op == DL_RECORD_SET ? readUInt(&reader, &err) : 0;
+            if(err != DL_ERROR_NONE || b >= diana->num_components) {
+                err = DL_ERROR_INVALID_VALUE;
+                break;
+            }
+            data = readData(&reader, diana->components[b].size, &err);
+            start = now();
+            result = op == DL_RECORD_SET ? diana_setComponentI(diana, a, b, c, data) : diana_appendComponent(diana, a, b, data);
+            break;
+        case DL_RECORD_GET:
+            a = readUInt(&reader, &err);
+            b = readUInt(&reader, &err);
+            c = readUInt(&reader, &err);
+            start = now();
+            result = diana_getComponentI(diana, a, b, c, &ptr);
+            break;
+        case DL_RECORD_REMOVE:
+            a = readUInt(&reader, &err);
+            b = readUInt(&reader, &err);
+            c = readUInt(&reader, &err);
+            start = now();
+            result = diana_removeComponentI(diana, a, b, c);
+            break;
+        case DL_RECORD_REMOVE_ALL:
+            a = readUInt(&reader, &err);
+            b = readUInt(&reader, &err);
+            start = now();
+            result = diana_removeComponents(diana, a, b);
+            break;
+        case DL_RECORD_MARK_CHANGED:
+            a = readUInt(&reader, &err);
+            b = readUInt(&reader, &err);
+            start = now();
+            result = diana_markChanged(diana, a, b);
+            break;
+        case DL_RECORD_CREATE_PREFAB:
+            a = readUInt(&reader, &err);
+            recorded = readUInt(&reader, &err);
+            if(err != DL_ERROR_NONE || recorded > 1u << 20) {
+                err = DL_ERROR_INVALID_VALUE;
+                break;
+            }
+            if(recorded >= prefabsCapacity) {
+                prefabs = realloc(prefabs, sizeof(unsigned int) * (recorded + 1));
+                memset(prefabs + prefabsCapacity, 0xff, sizeof(unsigned int) * (recorded + 1 - prefabsCapacity));
+                prefabsCapacity = recorded + 1;
+            }
+            start = now();
+            result = diana_createPrefab(diana, a, &prefab);
+            prefabs[recorded] = result == DL_ERROR_NONE ? prefab : UINT_MAX;
+            break;
+        case DL_RECORD_INSTANTIATE:
+        case DL_RECORD_INSTANTIATE_N:
+        case DL_RECORD_FREE_PREFAB:
+            recorded = readUInt(&reader, &err);
+            a = op != DL_RECORD_FREE_PREFAB ? readUInt(&reader, &err) : 0;
+            // prefabs made before the recording started are not in it
+            prefab = recorded < prefabsCapacity ? prefabs[recorded] : UINT_MAX;
+            if(op == DL_RECORD_INSTANTIATE_N && a > entitiesCapacity) {
+                entities = realloc(entities, sizeof(unsigned int) * a);
+                entitiesCapacity = a;
+            }
+            start = now();
+            if(op == DL_RECORD_INSTANTIATE) {
+                result = diana_instantiate(diana, prefab, &entity);
+                diverged += result == DL_ERROR_NONE && entity != a;
+            } else if(op == DL_RECORD_INSTANTIATE_N) {
+                result = diana_instantiateN(diana, prefab, a, entities);
+            } else {
+                result = diana_freePrefab(diana, prefab);
+            }
+            break;
+        case DL_RECORD_PROCESS:
+        case DL_RECORD_PROCESS_SYSTEM:
+            a = op == DL_RECORD_PROCESS_SYSTEM ? readUInt(&reader, &err) : 0;
+            if(sizeof(delta) > reader.size - reader.pos) {
+                err = DL_ERROR_INVALID_VALUE;
+                break;
+            }
+            memcpy(&delta, reader.image + reader.pos, sizeof(delta));
+            reader.pos += sizeof(delta);
+            start = now();
+            result = op == DL_RECORD_PROCESS ? diana_process(diana, delta) : diana_processSystem(diana, a, delta);
+            frames += op == DL_RECORD_PROCESS;
+            break;
+        case DL_RECORD_CLEAR:
+            result = diana_clear(diana);
+            break;
+        case DL_RECORD_COMPACT:
+            {
+                unsigned int *remap = NULL;
+                result = diana_compact(diana, &remap, &count);
+                free(remap);
+            }
+            break;
+        case DL_RECORD_REWIND:
+            a = readUInt(&reader, &err);
+            start = now();
+            result = diana_rewind(diana, a);
+            break;
+        case DL_RECORD_FORK:
+            result = diana_fork(diana);
+            break;
+        case DL_RECORD_DISCARD_FORK:
+            result = diana_discardFork(diana);
+            break;
+        case DL_RECORD_KEEP_FORK:
+            result = diana_keepFork(diana);
+            break;
+        case DL_RECORD_SCHEDULE_TIMER:
+            a = readUInt(&reader, &err);
+            b = readUInt(&reader, &err);
+            c = readUInt(&reader, &err);
+            recorded = readUInt(&reader, &err);
+            start = now();
+            result = diana_scheduleTimer(diana, a, b, c, &timer);
+            // timers are not in the snapshot, so the ids can differ. they
+            // are kept by the recorded number, with the recorded id
+            if(result == DL_ERROR_NONE) {
+                number = recorded & DL_TIMER_INDEX_MASK;
+                if(number >= timersCapacity) {
+                    timers = realloc(timers, sizeof(unsigned int) * 2 * (number + 1) * 2);
+                    memset(timers + 2 * timersCapacity, 0, sizeof(unsigned int) * 2 * ((number + 1) * 2 - timersCapacity));
+                    timersCapacity = (number + 1) * 2;
+                }
+                timers[2 * number] = recorded;
+                timers[2 * number + 1] = timer;
+            }
+            break;
+        case DL_RECORD_CANCEL_TIMER:
+            a = readUInt(&reader, &err);
+            start = now();
+            number = a & DL_TIMER_INDEX_MASK;
+            result = diana_cancelTimer(diana, number < timersCapacity && timers[2 * number] == a ? timers[2 * number + 1] : 0);
+            break;
+        case DL_RECORD_SET_PARENT:
+            a = readUInt(&reader, &err);
+            b = readUInt(&reader, &err);
+            start = now();
+            result = diana_setParent(diana, a, b);
+            break;
+        case DL_RECORD_REMOVE_PARENT:
+            a = readUInt(&reader, &err);
+            start = now();
+            result = diana_removeParent(diana, a);
+            break;
+        default:
+            err = DL_ERROR_INVALID_VALUE;
+        }
+
+        if(err != DL_ERROR_NONE) {
+            fprintf(stderr, "%s: bad record at byte %lu\n", argv[1], (unsigned long)reader.pos);
+            return 1;
+        }
+
+        totals[op][nested].ns += now() - start;
+        totals[op][nested].calls++;
+        totals[op][nested].allocs += allocations - allocs;
+        totals[op][nested].bytes += num_allocated - bytes;
+        failed += result != DL_ERROR_NONE;
+    }
+
+    for(op = 0; op < DL_RECORD_OPS; op++) {
+        for(nested = 0; nested < 2; nested++) {
+            struct phase *p = &totals[op][nested];
+            if(!p->calls) {
+                continue;
+            }
+            printf("{\"phase\":\"%s\",\"processing\":%s,\"calls\":%llu,\"ns\":%llu,\"ns_per_call\":%.3f,\"allocs\":%llu,\"bytes\":%llu}\n",
+                phases[op], nested ? "true" : "false", p->calls, p->ns, (double)p->ns / p->calls, p->allocs, p->bytes);
+            calls += p->calls;
+            ns += p->ns;
+        }
+    }
+    printf("{\"phase\":\"total\",\"frames\":%llu,\"calls\":%llu,\"ns\":%llu,\"diverged\":%llu,\"failed\":%llu}\n", frames, calls, ns, diverged, failed);
+
+    diana_free(diana);
+    free(prefabs);
+    free(entities);
+    free(timers);
+    free(image);
+    return 0;
+}
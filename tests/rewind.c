@@ -0,0 +1,123 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+static unsigned int componentA, componentB, componentC;
+
+// counts up, spawns an entity at 3 and deletes itself at 4
+static void step(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    unsigned int spawned = 0;
+    int *a, value = 100;
+    diana_getComponent(diana, entity, componentA, (void **)&a);
+    (*a)++;
+    if(*a == 3) {
+        diana_spawn(diana, &spawned);
+        diana_setComponent(diana, spawned, componentB, &value);
+        diana_signal(diana, spawned, DL_ENTITY_ADDED);
+    }
+    if(*a == 4) {
+        diana_signal(diana, entity, DL_ENTITY_DELETED);
+    }
+}
+
+// the live entities with their handles and values
+static void dump(struct diana *diana, char *out) {
+    unsigned int entity;
+    diana_handle handle;
+    int *data;
+
+    out[0] = 0;
+    for(entity = 0; entity < 8; entity++) {
+        if(diana_getHandle(diana, entity, &handle) != DL_ERROR_NONE) {
+            continue;
+        }
+        out += sprintf(out, "%u:%llx", entity, (unsigned long long)handle);
+        if(diana_getComponent(diana, entity, componentA, (void **)&data) == DL_ERROR_NONE) {
+            out += sprintf(out, "a%d", *data);
+        }
+        if(diana_getComponent(diana, entity, componentB, (void **)&data) == DL_ERROR_NONE) {
+            out += sprintf(out, "b%d", *data);
+        }
+        out += sprintf(out, ";");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int system = 0, entity, i, n = 0;
+    int value = 0, *data = NULL;
+    char states[7][512], now[512];
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "a", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentA);
+    diana_createComponent(diana, "b", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentB);
+    diana_createComponent(diana, "c", sizeof(int), DL_COMPONENT_FLAG_MULTIPLE, &componentC);
+    diana_createSystem(diana, "step", NULL, step, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &system);
+    diana_watch(diana, system, componentA);
+    CHECK(diana_rollback(diana, 4) == DL_ERROR_NONE);
+    diana_initialize(diana);
+    CHECK(diana_rollback(diana, 4) == DL_ERROR_INVALID_OPERATION);
+
+    diana_spawn(diana, &entity);
+    diana_setComponent(diana, entity, componentA, &value);
+    diana_signal(diana, entity, DL_ENTITY_ADDED);
+    diana_spawn(diana, &entity);
+    value = 1;
+    diana_setComponent(diana, entity, componentA, &value);
+    diana_signal(diana, entity, DL_ENTITY_ADDED);
+
+    for(i = 0; i < 6; i++) {
+        dump(diana, states[i]);
+        diana_process(diana, 0);
+    }
+    dump(diana, states[6]);
+
+    // only the frames kept can be undone
+    CHECK(diana_rewind(diana, 5) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_rewind(diana, 2) == DL_ERROR_NONE);
+    dump(diana, now);
+    CHECK(!strcmp(now, states[4]));
+    CHECK(diana_rewind(diana, 1) == DL_ERROR_NONE);
+    dump(diana, now);
+    CHECK(!strcmp(now, states[4]));
+    CHECK(diana_rewind(diana, 2) == DL_ERROR_NONE);
+    dump(diana, now);
+    CHECK(!strcmp(now, states[3]));
+    CHECK(diana_rewind(diana, 2) == DL_ERROR_NONE);
+    dump(diana, now);
+    CHECK(!strcmp(now, states[2]));
+
+    // resimulating gives the same entities, handles and values
+    for(i = 2; i < 6; i++) {
+        diana_process(diana, 0);
+        dump(diana, now);
+        CHECK(!strcmp(now, states[i + 1]));
+    }
+    CHECK(diana_rewind(diana, 4) == DL_ERROR_NONE);
+    dump(diana, now);
+    CHECK(!strcmp(now, states[2]));
+
+    // a clear drops the history
+    diana_clear(diana);
+    CHECK(diana_rewind(diana, 2) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_rewind(diana, 1) == DL_ERROR_NONE);
+
+    // dropping all instances of a multiple component is undone as well
+    diana_spawn(diana, &entity);
+    value = 7;
+    diana_appendComponent(diana, entity, componentC, &value);
+    value = 8;
+    diana_appendComponent(diana, entity, componentC, &value);
+    diana_process(diana, 0);
+    CHECK(diana_removeComponents(diana, entity, componentC) == DL_ERROR_NONE);
+    CHECK(diana_rewind(diana, 1) == DL_ERROR_NONE);
+    CHECK(diana_getComponentCount(diana, entity, componentC, &n) == DL_ERROR_NONE && n == 2);
+    CHECK(diana_getComponentI(diana, entity, componentC, 1, (void **)&data) == DL_ERROR_NONE && *data == 8);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
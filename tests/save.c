@@ -0,0 +1,123 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+static unsigned char buffer[1 << 20];
+static size_t written = 0, readPosition = 0, readLimit = (size_t)-1;
+
+static int test_write(void *user_data, const void *data, size_t size) {
+    memcpy(buffer + written, data, size);
+    written += size;
+    return 0;
+}
+
+// fails once the limit is reached, like a truncated file
+static int test_read(void *user_data, void *data, size_t size) {
+    if(readPosition + size > readLimit) {
+        return 1;
+    }
+    memcpy(data, buffer + readPosition, size);
+    readPosition += size;
+    return 0;
+}
+
+static unsigned int componentA, componentB, componentC, counter, num_processed = 0;
+
+static void test_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    num_processed++;
+}
+
+static struct diana *make(const char *nameB) {
+    struct diana *diana;
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "a", sizeof(int), DL_COMPONENT_FLAG_INLINE, &componentA);
+    diana_createComponent(diana, nameB, sizeof(long long), DL_COMPONENT_FLAG_INDEXED, &componentB);
+    diana_createComponent(diana, "c", sizeof(short), DL_COMPONENT_FLAG_MULTIPLE, &componentC);
+    diana_createSystem(diana, "counter", NULL, test_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &counter);
+    diana_watch(diana, counter, componentA);
+    diana_initialize(diana);
+    return diana;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana = make("b"), *loaded = make("b"), *other = make("renamed");
+    unsigned int entity, i, n;
+    int value;
+    long long wide;
+    short small;
+    void *data;
+
+    for(i = 0; i < 200; i++) {
+        diana_spawn(diana, &entity);
+        value = i;
+        diana_setComponent(diana, entity, componentA, &value);
+        if(i % 3 == 0) {
+            wide = i * 1000LL;
+            diana_setComponent(diana, entity, componentB, &wide);
+        }
+        if(i % 5 == 0) {
+            small = i;
+            diana_appendComponent(diana, entity, componentC, &small);
+            small++;
+            diana_appendComponent(diana, entity, componentC, &small);
+        }
+        diana_signal(diana, entity, DL_ENTITY_ADDED);
+    }
+    diana_process(diana, 0);
+    for(i = 0; i < 200; i += 7) {
+        diana_signal(diana, i, DL_ENTITY_DELETED);
+    }
+    diana_process(diana, 0);
+
+    // a spawned but not yet added entity is saved too
+    diana_spawn(diana, &entity);
+    CHECK(diana_save(diana, test_write, NULL) == DL_ERROR_NONE);
+
+    // a different schema is refused before anything is touched
+    CHECK(diana_load(other, test_read, NULL) == DL_ERROR_INVALID_VALUE);
+
+    // a short read leaves an empty world
+    readPosition = 0;
+    readLimit = written / 2;
+    diana_spawn(loaded, &entity);
+    CHECK(diana_load(loaded, test_read, NULL) == DL_ERROR_IO);
+    CHECK(loaded->dataHeight == 0);
+
+    readPosition = 0;
+    readLimit = (size_t)-1;
+    CHECK(diana_load(loaded, test_read, NULL) == DL_ERROR_NONE && readPosition == written);
+    CHECK(loaded->dataHeight == diana->dataHeight);
+    CHECK(loaded->freeEntityIds.population == diana->freeEntityIds.population);
+    for(i = 0; i < 200; i++) {
+        if(i % 7 == 0) {
+            continue;
+        }
+        CHECK(diana_getComponent(loaded, i, componentA, &data) == DL_ERROR_NONE && *(int *)data == (int)i);
+        if(i % 3 == 0) {
+            CHECK(diana_getComponent(loaded, i, componentB, &data) == DL_ERROR_NONE && *(long long *)data == i * 1000LL);
+        } else {
+            CHECK(diana_getComponent(loaded, i, componentB, &data) != DL_ERROR_NONE);
+        }
+        if(i % 5 == 0) {
+            CHECK(diana_getComponentCount(loaded, i, componentC, &n) == DL_ERROR_NONE && n == 2);
+            CHECK(diana_getComponentI(loaded, i, componentC, 1, &data) == DL_ERROR_NONE && *(short *)data == (short)(i + 1));
+        }
+    }
+
+    // the loaded world runs and hands out ids like the saved one
+    num_processed = 0;
+    diana_process(loaded, 0);
+    CHECK(num_processed == 200 - 29);
+    diana_spawn(diana, &i);
+    diana_spawn(loaded, &n);
+    CHECK(i == n);
+
+    diana_free(diana);
+    diana_free(loaded);
+    diana_free(other);
+
+    return failures != 0;
+}
@@ -0,0 +1,86 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#include "check.h"
+
+struct position {
+    float x;
+    float y;
+};
+
+static unsigned int position, hp, grid;
+
+// the entities within 'radius' of x, y
+static unsigned int near(struct diana *diana, float x, float y, float radius, unsigned int entity) {
+    float center[2];
+    unsigned int *entities, count, i, found = 0;
+
+    center[0] = x;
+    center[1] = y;
+    CHECK(diana_queryRadius(diana, grid, center, radius, &entities, &count) == DL_ERROR_NONE);
+    for(i = 0; i < count; i++) {
+        found += entities[i] == entity;
+    }
+    return found;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int entity, other, *entities, count;
+    size_t offsets[2] = { offsetof(struct position, x), offsetof(struct position, y) };
+    struct position at = { 1, 1 }, far = { 100, 100 };
+    float min[2] = { 0, 0 }, max[2] = { 2, 2 };
+    int health = 10;
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "position", sizeof(struct position), DL_COMPONENT_FLAG_INLINE, &position);
+    diana_createComponent(diana, "hp", sizeof(int), DL_COMPONENT_FLAG_INLINE, &hp);
+    CHECK(diana_createSpatialIndex(diana, position, 2, offsets, 4, &grid) == DL_ERROR_NONE);
+    diana_initialize(diana);
+
+    diana_spawn(diana, &entity);
+    diana_setComponent(diana, entity, position, &at);
+    diana_setComponent(diana, entity, hp, &health);
+    diana_spawn(diana, &other);
+    diana_setComponent(diana, other, position, &far);
+
+    // only enabled entities are in the index
+    CHECK(near(diana, 1, 1, 1, entity) == 0);
+    diana_signal(diana, entity, DL_ENTITY_ADDED);
+    diana_signal(diana, other, DL_ENTITY_ADDED);
+    diana_process(diana, 0);
+    CHECK(near(diana, 1, 1, 1, entity) == 1);
+    CHECK(near(diana, 1, 1, 1, other) == 0);
+    CHECK(diana_queryBox(diana, grid, min, max, &entities, &count) == DL_ERROR_NONE);
+    CHECK(count == 1 && entities[0] == entity);
+
+    // setting the component moves the entity
+    CHECK(diana_setComponent(diana, other, position, &at) == DL_ERROR_NONE);
+    CHECK(near(diana, 1, 1, 1, other) == 1);
+
+    // removing another component leaves it where it is
+    CHECK(diana_removeComponent(diana, entity, hp) == DL_ERROR_NONE);
+    CHECK(near(diana, 1, 1, 1, entity) == 1);
+
+    // removing the indexed component takes it out
+    CHECK(diana_removeComponent(diana, entity, position) == DL_ERROR_NONE);
+    CHECK(near(diana, 1, 1, 1, entity) == 0);
+
+    // as do disabling and deleting
+    diana_signal(diana, other, DL_ENTITY_DISABLED);
+    diana_process(diana, 0);
+    CHECK(near(diana, 1, 1, 1, other) == 0);
+    diana_signal(diana, other, DL_ENTITY_ENABLED);
+    diana_process(diana, 0);
+    CHECK(near(diana, 1, 1, 1, other) == 1);
+    diana_signal(diana, other, DL_ENTITY_DELETED);
+    diana_process(diana, 0);
+    CHECK(near(diana, 1, 1, 1, other) == 0);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
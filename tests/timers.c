@@ -0,0 +1,117 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+// the payloads fired, in order
+static unsigned int fired[32];
+static unsigned int num_fired;
+
+static void test_fired(struct diana *diana, void *user_data, unsigned int entity, unsigned int payload) {
+    if(num_fired < 32) {
+        fired[num_fired] = payload;
+    }
+    num_fired++;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int entity, other, spawned, timer, i;
+
+    allocate_diana(malloc, free, &diana);
+    CHECK(diana_rollback(diana, 4) == DL_ERROR_NONE);
+    CHECK(diana_timers(diana, 0, test_fired, NULL) == DL_ERROR_NONE);
+    diana_initialize(diana);
+
+    diana_spawn(diana, &entity);
+    diana_signal(diana, entity, DL_ENTITY_ADDED);
+    diana_spawn(diana, &other);
+    diana_signal(diana, other, DL_ENTITY_ADDED);
+    diana_process(diana, 1);
+
+    // a tick per diana_process
+    CHECK(diana_scheduleTimer(diana, entity, 1, 2, &timer) == DL_ERROR_NONE);
+    diana_process(diana, 1);
+    CHECK(num_fired == 0);
+    diana_process(diana, 1);
+    CHECK(num_fired == 1 && fired[0] == 1);
+    CHECK(diana_cancelTimer(diana, timer) == DL_ERROR_INVALID_VALUE);
+
+    // a timer fired in a discarded fork waits again
+    num_fired = 0;
+    CHECK(diana_scheduleTimer(diana, entity, 2, 1, &timer) == DL_ERROR_NONE);
+    CHECK(diana_fork(diana) == DL_ERROR_NONE);
+    diana_process(diana, 1);
+    CHECK(num_fired == 1 && fired[0] == 2);
+    CHECK(diana_discardFork(diana) == DL_ERROR_NONE);
+    diana_process(diana, 1);
+    CHECK(num_fired == 2 && fired[1] == 2);
+
+    // so does one canceled in it, or taken with its deleted entity, and the
+    // ones scheduled in it are gone with it
+    num_fired = 0;
+    CHECK(diana_scheduleTimer(diana, entity, 3, 2, &timer) == DL_ERROR_NONE);
+    CHECK(diana_scheduleTimer(diana, other, 4, 2, &i) == DL_ERROR_NONE);
+    CHECK(diana_fork(diana) == DL_ERROR_NONE);
+    CHECK(diana_cancelTimer(diana, timer) == DL_ERROR_NONE);
+    diana_signal(diana, other, DL_ENTITY_DELETED);
+    diana_spawn(diana, &spawned);
+    diana_signal(diana, spawned, DL_ENTITY_ADDED);
+    CHECK(diana_scheduleTimer(diana, spawned, 5, 1, &i) == DL_ERROR_NONE);
+    CHECK(diana_scheduleTimer(diana, entity, 6, 1, &i) == DL_ERROR_NONE);
+    for(i = 0; i < 3; i++) {
+        diana_process(diana, 1);
+    }
+    CHECK(num_fired == 2);
+    CHECK((fired[0] == 5 && fired[1] == 6) || (fired[0] == 6 && fired[1] == 5));
+    CHECK(diana_scheduleTimer(diana, other, 7, 1, &i) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_discardFork(diana) == DL_ERROR_NONE);
+    num_fired = 0;
+    for(i = 0; i < 3; i++) {
+        diana_process(diana, 1);
+    }
+    CHECK(num_fired == 2);
+    CHECK((fired[0] == 3 && fired[1] == 4) || (fired[0] == 4 && fired[1] == 3));
+
+    // rewinding puts back fired timers and the tick count, so the same frame
+    // fires the same timers again
+    num_fired = 0;
+    CHECK(diana_scheduleTimer(diana, entity, 7, 1, &timer) == DL_ERROR_NONE);
+    CHECK(diana_scheduleTimer(diana, entity, 8, 2, &i) == DL_ERROR_NONE);
+    diana_process(diana, 1);
+    diana_process(diana, 1);
+    CHECK(num_fired == 2 && fired[0] == 7 && fired[1] == 8);
+    CHECK(diana_rewind(diana, 2) == DL_ERROR_NONE);
+    diana_process(diana, 1);
+    CHECK(num_fired == 3 && fired[2] == 7);
+    diana_process(diana, 1);
+    CHECK(num_fired == 4 && fired[3] == 8);
+
+    // an id stays dead when its timer's number is reused
+    CHECK(diana_scheduleTimer(diana, entity, 9, 1, &timer) == DL_ERROR_NONE);
+    diana_process(diana, 1);
+    CHECK(diana_scheduleTimer(diana, entity, 10, 1, &i) == DL_ERROR_NONE);
+    CHECK((i & DL_TIMER_INDEX_MASK) == (timer & DL_TIMER_INDEX_MASK) && i != timer);
+    CHECK(diana_cancelTimer(diana, timer) == DL_ERROR_INVALID_VALUE);
+    num_fired = 0;
+    diana_process(diana, 1);
+    CHECK(num_fired == 1 && fired[0] == 10);
+
+    // and across a clear
+    CHECK(diana_scheduleTimer(diana, entity, 11, 1, &timer) == DL_ERROR_NONE);
+    diana_clear(diana);
+    diana_spawn(diana, &entity);
+    do {
+        CHECK(diana_scheduleTimer(diana, entity, 12, 1, &i) == DL_ERROR_NONE);
+    } while((i & DL_TIMER_INDEX_MASK) < (timer & DL_TIMER_INDEX_MASK));
+    CHECK((i & DL_TIMER_INDEX_MASK) == (timer & DL_TIMER_INDEX_MASK) && i != timer);
+    CHECK(diana_cancelTimer(diana, timer) == DL_ERROR_INVALID_VALUE);
+    CHECK(diana_cancelTimer(diana, i) == DL_ERROR_NONE);
+    CHECK(diana_cancelTimer(diana, i) == DL_ERROR_INVALID_VALUE);
+
+    diana_free(diana);
+
+    return failures != 0;
+}
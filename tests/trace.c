@@ -0,0 +1,82 @@
+#include "../diana.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "check.h"
+
+static unsigned long long now = 0;
+
+static unsigned long long test_clock(void *user_data) {
+    return now;
+}
+
+static void test_process(struct diana *diana, void *user_data, unsigned int entity, float delta) {
+    now += 1500;
+}
+
+static void test_added(struct diana *diana, void *user_data, unsigned int entity) {
+    now += 7;
+}
+
+static char trace[1 << 16];
+static size_t written = 0;
+
+static int test_write(void *user_data, const void *data, size_t size) {
+    if(written + size >= sizeof(trace)) {
+        return 1;
+    }
+    memcpy(trace + written, data, size);
+    written += size;
+    return 0;
+}
+
+static unsigned int occurrences(const char *haystack, const char *needle) {
+    unsigned int n = 0;
+    while((haystack = strstr(haystack, needle)) != NULL) {
+        haystack++;
+        n++;
+    }
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    struct diana *diana;
+    unsigned int component, system = 0, manager = 0, entity, i;
+    int value = 0;
+    const char *end = "],\"displayTimeUnit\":\"ns\"}\n";
+
+    allocate_diana(malloc, free, &diana);
+    diana_createComponent(diana, "component", sizeof(int), DL_COMPONENT_FLAG_INLINE, &component);
+    diana_createSystem(diana, "mov\"er", NULL, test_process, NULL, NULL, NULL, NULL, DL_SYSTEM_FLAG_NORMAL, &system);
+    diana_watch(diana, system, component);
+    diana_createManager(diana, "manager", test_added, NULL, NULL, NULL, NULL, 0, &manager);
+    diana_initialize(diana);
+
+    // tracing needs the profiler clock
+    CHECK(diana_trace(diana, 3, test_write, NULL) == DL_ERROR_INVALID_OPERATION);
+    diana_profile(diana, test_clock, NULL);
+    CHECK(diana_trace(diana, 3, test_write, NULL) == DL_ERROR_NONE);
+    CHECK(diana_trace(diana, 3, test_write, NULL) == DL_ERROR_INVALID_OPERATION);
+
+    for(i = 0; i < 5; i++) {
+        diana_spawn(diana, &entity);
+        diana_setComponent(diana, entity, component, &value);
+        diana_signal(diana, entity, DL_ENTITY_ADDED);
+        diana_process(diana, 0);
+    }
+
+    // stopping writes the last frames kept as one document
+    CHECK(diana_trace(diana, 0, NULL, NULL) == DL_ERROR_NONE);
+    trace[written] = 0;
+    CHECK(!strncmp(trace, "{\"traceEvents\":[\n", 17));
+    CHECK(written > strlen(end) && !strcmp(trace + written - strlen(end), end));
+    CHECK(occurrences(trace, "\"cat\":\"frame\"") == 3);
+    CHECK(occurrences(trace, "\"name\":\"mov\\\"er\",\"cat\":\"process\"") == 3);
+    CHECK(occurrences(trace, "\"name\":\"manager\",\"cat\":\"manager\"") == 3);
+    CHECK(strstr(trace, "\"dur\":4.500") != NULL);
+
+    diana_free(diana);
+
+    return failures != 0;
+}